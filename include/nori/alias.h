@@ -0,0 +1,147 @@
+#if !defined(__NORI_ALIAS_H)
+#define __NORI_ALIAS_H
+
+#include <nori/common.h>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Alias table for sampling discrete distributions in constant time
+ *
+ * Built with Vose's variant of Walker's alias method: every entry of the
+ * table is a bin of probability <tt>1/n</tt>, which is split between the
+ * entry itself (with probability \c q) and one other entry (its alias).
+ * Sampling picks a bin with the integer part of <tt>u * n</tt> and decides
+ * between the entry and its alias with the fractional part, instead of
+ * a binary search over a CDF.
+ *
+ * The bins store the normalized probability of their entry, so that
+ * \ref pdf() is consistent with \ref sample() bit for bit. The static
+ * functions operate on an external array of bins, which allows packing
+ * many tables into one contiguous allocation (see \ref Distribution2D).
+ */
+class AliasTable {
+public:
+    struct Bin {
+        /// Probability of keeping the entry of this bin instead of its alias
+        float q;
+        /// Alternative entry of this bin
+        uint32_t alias;
+        /// Normalized probability of the entry
+        float pdf;
+    };
+
+    AliasTable() { }
+
+    /// Build a table for \c n nonnegative (unnormalized) weights
+    AliasTable(const float *weights, size_t n) { build(weights, n); }
+
+    void build(const float *weights, size_t n) {
+        m_bins.resize(n);
+        m_sum = build(weights, n, m_bins.data());
+    }
+
+    size_t size() const { return m_bins.size(); }
+
+    /// Return the sum of the weights that the table was built from
+    float getSum() const { return m_sum; }
+
+    /// Return the normalized probability of an entry
+    float pdf(size_t index) const { return m_bins[index].pdf; }
+
+    /// Sample an entry, see the static version
+    size_t sample(float u, float *pdf = nullptr, float *uRemapped = nullptr) const {
+        return sample(m_bins.data(), m_bins.size(), u, pdf, uRemapped);
+    }
+
+    const Bin *data() const { return m_bins.data(); }
+
+    /**
+     * \brief Build a table into \c bins (an array of \c n entries)
+     *
+     * All-zero weights result in a uniform distribution.
+     *
+     * \return The sum of the weights
+     */
+    static float build(const float *weights, size_t n, Bin *bins) {
+        double sum = 0;
+        for (size_t i = 0; i < n; ++i)
+            sum += weights[i];
+
+        /* Scaled probabilities, with an average of one */
+        std::vector<double> scaled(n);
+        std::vector<uint32_t> small, large;
+        small.reserve(n);
+        large.reserve(n);
+        for (size_t i = 0; i < n; ++i) {
+            bins[i].pdf = sum > 0 ? (float) (weights[i] / sum) : 1.f / n;
+            bins[i].alias = (uint32_t) i;
+            scaled[i] = sum > 0 ? weights[i] * n / sum : 1.0;
+            if (scaled[i] < 1.0)
+                small.push_back((uint32_t) i);
+            else
+                large.push_back((uint32_t) i);
+        }
+
+        /* Fill each underfull bin with the excess of an overfull one */
+        while (!small.empty() && !large.empty()) {
+            uint32_t s = small.back(), l = large.back();
+            small.pop_back();
+            large.pop_back();
+            bins[s].q = (float) scaled[s];
+            bins[s].alias = l;
+            scaled[l] -= 1.0 - scaled[s];
+            if (scaled[l] < 1.0)
+                small.push_back(l);
+            else
+                large.push_back(l);
+        }
+
+        /* The remaining bins are full (up to roundoff) */
+        for (uint32_t i : large)
+            bins[i].q = 1.f;
+        for (uint32_t i : small)
+            bins[i].q = 1.f;
+
+        return (float) sum;
+    }
+
+    /**
+     * \brief Sample an entry of a table
+     *
+     * \param u
+     *     A uniformly distributed sample on <tt>[0, 1)</tt>
+     * \param pdf
+     *     Optionally returns the normalized probability of the entry
+     * \param uRemapped
+     *     Optionally returns a uniformly distributed sample on <tt>[0, 1)</tt>
+     *     that is independent of the chosen entry, e.g. to sample within it
+     */
+    static size_t sample(const Bin *bins, size_t n, float u, float *pdf = nullptr,
+                         float *uRemapped = nullptr) {
+        float scaled = u * n;
+        size_t index = std::min((size_t) std::max(scaled, 0.f), n - 1);
+        float frac = std::min(std::max(scaled - index, 0.f), 1.f);
+
+        const Bin &bin = bins[index];
+        if (frac < bin.q || bin.q >= 1.f) {
+            if (uRemapped)
+                *uRemapped = std::min(frac / bin.q, 0.99999994f);
+        } else {
+            if (uRemapped)
+                *uRemapped = std::min((frac - bin.q) / (1.f - bin.q), 0.99999994f);
+            index = bin.alias;
+        }
+        if (pdf)
+            *pdf = bins[index].pdf;
+        return index;
+    }
+
+private:
+    std::vector<Bin> m_bins;
+    float m_sum = 0.f;
+};
+
+NORI_NAMESPACE_END
+
+#endif /* __NORI_ALIAS_H */
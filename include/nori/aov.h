@@ -0,0 +1,104 @@
+#if !defined(__NORI_AOV_H)
+#define __NORI_AOV_H
+
+#include <nori/bitmap.h>
+#include <nori/stats.h>
+#include <chrono>
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+#elif defined(_M_IX86) || defined(_M_X64)
+#include <intrin.h>
+#endif
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Per-pixel cost images ("heatmaps") for diagnosing slow renders
+ *
+ * For every pixel, this class records the average over its samples of
+ *
+ * - the time spent in the camera ray and integrator (CPU cycles),
+ * - the number of BVH nodes visited by all rays of the sample,
+ * - the number of ray-triangle intersection tests, and
+ * - the path depth (number of intersection queries, shadow rays excluded).
+ *
+ * The images are written as additional channels of the beauty EXR
+ * (see \ref Bitmap::save()). Except for the time, the values are derived
+ * from the per-thread \ref Statistics counters and are therefore zero
+ * when statistics are compiled out.
+ *
+ * Every pixel is always rendered by the same image block, and the passes
+ * of a render run one after another, so \ref put() needs no locking.
+ */
+class CostAOVs {
+public:
+    enum EChannel {
+        ETime = 0,
+        EBVHNodes,
+        ETriangleTests,
+        EPathDepth,
+        EChannelCount
+    };
+
+    /// Cost counters of the calling thread at a point in time
+    struct Sample {
+        uint64_t value[EChannelCount];
+
+        /// Read the cycle and statistics counters of the calling thread
+        static Sample now() {
+            const Statistics::ThreadCounters &counters = Statistics::local();
+            Sample sample;
+            sample.value[ETime] = cycles();
+            sample.value[EBVHNodes] = counters.get(EStatBVHNodes);
+            sample.value[ETriangleTests] = counters.get(EStatTriangleTests);
+            sample.value[EPathDepth] = counters.get(EStatIntersectionRays);
+            return sample;
+        }
+
+        Sample operator-(const Sample &start) const {
+            Sample result;
+            for (int i = 0; i < EChannelCount; ++i)
+                result.value[i] = value[i] - start.value[i];
+            return result;
+        }
+    };
+
+    /// Allocate cleared cost images of the given size
+    CostAOVs(const Vector2i &size);
+
+    /// Accumulate the cost of one sample of \c pixel
+    void put(const Point2i &pixel, const Sample &cost) {
+        if (pixel.x() < 0 || pixel.y() < 0 || pixel.x() >= m_size.x() || pixel.y() >= m_size.y())
+            return;
+        size_t index = (size_t) pixel.y() * m_size.x() + pixel.x();
+        for (int i = 0; i < EChannelCount; ++i)
+            m_sum[index * EChannelCount + i] += (double) cost.value[i];
+        m_count[index]++;
+    }
+
+    /// Return the per-sample averages as named EXR channels
+    std::vector<Bitmap::Channel> toChannels() const;
+
+    /// Return the EXR channel name of a cost image
+    static const char *channelName(EChannel channel);
+
+    /// Read the CPU cycle counter (or a nanosecond clock where it is unavailable)
+    static uint64_t cycles() {
+#if defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_X64)
+        return (uint64_t) __rdtsc();
+#else
+        return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+private:
+    Vector2i m_size;
+    std::vector<double> m_sum;     ///< EChannelCount sums per pixel
+    std::vector<uint32_t> m_count; ///< Number of samples per pixel
+};
+
+NORI_NAMESPACE_END
+
+#endif /* __NORI_AOV_H */
@@ -21,6 +21,7 @@
 
 #include <nori/color.h>
 #include <nori/vector.h>
+#include <nori/memory.h>
 
 NORI_NAMESPACE_BEGIN
 
@@ -33,6 +34,12 @@ class Bitmap : public Eigen::Array<Color3f, Eigen::Dynamic, Eigen::Dynamic, Eige
 public:
     typedef Eigen::Array<Color3f, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> Base;
 
+    /// An additional single-channel image that is stored next to the RGB data
+    struct Channel {
+        std::string name;        ///< EXR channel name, e.g. "depth.Y"
+        std::vector<float> data; ///< Row-major values, one per pixel
+    };
+
     /**
      * \brief Allocate a new bitmap of the specified size
      *
@@ -45,8 +52,13 @@ public:
     /// Load an OpenEXR file with the specified filename
     Bitmap(const std::string &filename);
 
-    /// Save the bitmap as an EXR file with the specified filename
-    void save(const std::string &filename);
+    /**
+     * \brief Save the bitmap as an EXR file with the specified filename
+     *
+     * \param extra
+     *     Additional channels (e.g. AOVs) that are written to the same file
+     */
+    void save(const std::string &filename, const std::vector<Channel> &extra = std::vector<Channel>());
 
     /// Save the bitmap as a PNG file with the specified filename
     void saveToLDR(const std::string &filename);
@@ -72,6 +84,7 @@ private:
 
 	int m_width, m_height;
 	std::string  m_filename;
+	MemoryRecord m_memory { EMemTextures };
 };
 
 NORI_NAMESPACE_END
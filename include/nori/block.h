@@ -25,6 +25,7 @@
 
 #include <nori/color.h>
 #include <nori/vector.h>
+#include <nori/memory.h>
 #include <tbb/mutex.h>
 
 #define NORI_BLOCK_SIZE 32 /* Block size used for parallelization */
@@ -91,6 +92,24 @@ public:
     /// Convert a bitmap into an image block
     void fromBitmap(const Bitmap &bitmap);
 
+    /**
+     * \brief Save the raw weighted contents as an OpenEXR file
+     *
+     * Unlike \ref toBitmap(), this keeps the border region and stores
+     * the accumulated filter weights in a fourth channel named "W", so
+     * that partial renderings of the same image can later be merged
+     * using \ref addRaw().
+     */
+    void saveRaw(const std::string &filename) const;
+
+    /**
+     * \brief Accumulate a raw OpenEXR file written by \ref saveRaw()
+     *
+     * An empty block adopts the size and border of the file,
+     * otherwise both must match.
+     */
+    void addRaw(const std::string &filename);
+
     /// Clear all contents
     void clear() { setConstant(Color4f()); }
 
@@ -124,6 +143,7 @@ protected:
     float m_lookupFactor = 0;
     uint32_t m_blockId; // id given by the block generator
     mutable tbb::mutex m_mutex;
+    MemoryRecord m_memory { EMemImageBlocks };
 };
 
 /**
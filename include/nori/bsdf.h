@@ -137,6 +137,27 @@ public:
 
 	bool isDelta() const { return m_type == BsdfType::BSDF_MIRROR || m_type == BsdfType::BSDF_DIELECTRIC; }
 
+	/// Can light pass through the surface?
+	bool isTransmissive() const {
+		return m_type == BsdfType::BSDF_DIELECTRIC || m_type == BsdfType::BSDF_ROUGHDIELECTRIC ||
+			m_type == BsdfType::BSDF_NULL;
+	}
+
+	/**
+	 * \brief Return the normal that bounds the directions of incident light
+	 * (see \ref EmitterQueryRecord::refNormal)
+	 *
+	 * \param n   Shading normal in world space
+	 * \param wo  Outgoing direction in world space
+	 * \return The shading normal on the side of \c wo, or zero for
+	 *         surfaces that transmit light
+	 */
+	Normal3f getLightSamplingNormal(const Normal3f &n, const Vector3f &wo) const {
+		if (isTransmissive())
+			return Normal3f(0.0f);
+		return n.dot(wo) < 0.0f ? Normal3f(-n) : n;
+	}
+
 	BsdfType m_type;
 
 protected:
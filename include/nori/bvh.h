@@ -80,6 +80,21 @@ public:
     bool rayIntersect(const Ray3f &ray, Intersection &its, 
         bool shadowRay = false) const;
 
+    /**
+     * \brief Test a batch of shadow rays for occlusion
+     *
+     * Traverses the tree once for up to 64 rays at a time: a node is
+     * visited if any of the rays that are still unoccluded intersects
+     * its bounding box, which shares the node fetches and traversal
+     * decisions between coherent rays (e.g. the shadow rays of one
+     * shading point). <tt>occluded[i]</tt> receives the result of
+     * <tt>rayIntersect(rays[i], its, true)</tt>.
+     */
+    void occluded(const Ray3f *rays, size_t count, bool *occluded) const;
+
+    /// Number of rays that \ref occluded() traverses together
+    static const size_t OcclusionBatchSize = 64;
+
     /// Return the total number of meshes registered with the BVH
     uint32_t getMeshCount() const { return (uint32_t) m_meshes.size(); }
 
@@ -168,6 +183,7 @@ private:
     std::vector<BVHNode> m_nodes;       ///< BVH nodes
     std::vector<uint32_t> m_indices;    ///< Index references by BVH nodes
     BoundingBox3f m_bbox;               ///< Bounding box of the entire BVH
+    MemoryRecord m_memory { EMemBVH };  ///< Accounting of the nodes and indices
 };
 
 NORI_NAMESPACE_END
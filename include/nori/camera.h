@@ -61,15 +61,34 @@ public:
     /// Return the size of the output image in pixels
     const Vector2i &getOutputSize() const { return m_outputSize; }
 
+    /// Return the name of the camera (used to identify views of scenes with several cameras)
+    const std::string &getName() const { return m_name; }
+
     /// Return the camera's reconstruction filter in image space
     const ReconstructionFilter *getReconstructionFilter() const { return m_rfilter; }
 
+    /**
+     * \brief Create a copy of this camera with some parameters replaced
+     *
+     * \param overrides
+     *    Properties (e.g. \c width, \c fov or \c toWorld) that take
+     *    precedence over the ones the camera was created with
+     *
+     * \return
+     *    A new, activated camera that shares the reconstruction filter
+     *    of this instance. The caller takes ownership.
+     */
+    virtual Camera *cloneWithOverrides(const PropertyList &overrides) const {
+        throw NoriException("Camera::cloneWithOverrides(): not supported by %s!", toString());
+    }
+
     /**
      * \brief Return the type of object (i.e. Mesh/Camera/etc.) 
      * provided by this instance
      * */
     virtual EClassType getClassType() const { return ECamera; }
 protected:
+    std::string m_name;
     Vector2i m_outputSize;
     ReconstructionFilter *m_rfilter;
 	float m_focalLength;					// focal length of the lens model.
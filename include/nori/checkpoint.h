@@ -0,0 +1,139 @@
+#if !defined(__NORI_CHECKPOINT_H)
+#define __NORI_CHECKPOINT_H
+
+#include <nori/block.h>
+#include <nori/render.h>
+#include <thread>
+#include <memory>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Snapshot of an in-progress rendering
+ *
+ * A checkpoint stores everything that is needed to continue a progressive
+ * render later on: the raw weighted accumulation buffer of the main
+ * \ref ImageBlock (colors, filter weights and the border region), the
+ * number of sample passes that have been completed, and the serialized
+ * state of every per-block \ref Sampler.
+ *
+ * Since resuming restores the exact random number streams, a resumed
+ * render produces the same image as an uninterrupted one. To guarantee
+ * this, the checkpoint also records the sampler type, its seed and the
+ * \ref RenderPartition, and refuses to resume a render that differs in
+ * any of them.
+ */
+class RenderCheckpoint {
+public:
+    /// Create an empty checkpoint
+    RenderCheckpoint() { }
+
+    /**
+     * \brief Capture the state of a render
+     *
+     * \param block
+     *     The main image block. The caller is responsible for locking it.
+     * \param sampler
+     *     The sampler of the render, which the per-block samplers are cloned from
+     * \param partition
+     *     The part of the frame that the render computes
+     * \param completedPasses
+     *     Number of sample passes that have fully completed
+     * \param samplers
+     *     Per-block samplers, indexed by block id
+     */
+    template <typename SamplerArray>
+    void capture(const ImageBlock &block, const Sampler *sampler, const RenderPartition &partition,
+            uint32_t completedPasses, const SamplerArray &samplers) {
+        captureBlock(block);
+        captureSettings(sampler, partition);
+        m_completedPasses = completedPasses;
+        m_samplers.clear();
+        m_samplers.reserve(samplers.size());
+        for (const auto &sampler : samplers)
+            m_samplers.push_back(serializeSampler(sampler.get()));
+    }
+
+    /**
+     * \brief Restore the accumulation buffer into \c block
+     *
+     * Throws an exception when the checkpoint was created for a different
+     * image size, reconstruction filter, sample count, sampler type, seed
+     * or partition.
+     */
+    void restoreBlock(ImageBlock &block, const Sampler *sampler, const RenderPartition &partition) const;
+
+    /// Restore the per-block sampler states (indexed by block id)
+    template <typename SamplerArray>
+    void restoreSamplers(SamplerArray &samplers) const {
+        if (samplers.size() != m_samplers.size())
+            throw NoriException("Checkpoint contains %i sampler states, expected %i!",
+                m_samplers.size(), samplers.size());
+        for (size_t i = 0; i < m_samplers.size(); ++i)
+            unserializeSampler(samplers[i].get(), m_samplers[i]);
+    }
+
+    /// Return the number of completed sample passes
+    uint32_t getCompletedPasses() const { return m_completedPasses; }
+
+    /// Return the total number of sample passes of the render
+    uint32_t getSampleCount() const { return m_sampleCount; }
+
+    /**
+     * \brief Write the checkpoint to disk
+     *
+     * The data is first written to a temporary file which then replaces
+     * the target, so that a crash while writing never destroys the
+     * previous checkpoint.
+     */
+    void save(const std::string &filename) const;
+
+    /// Load a checkpoint from disk
+    void load(const std::string &filename);
+
+    /// Return a human-readable string summary
+    std::string toString() const;
+
+protected:
+    void captureBlock(const ImageBlock &block);
+    void captureSettings(const Sampler *sampler, const RenderPartition &partition);
+    static std::string samplerType(const Sampler *sampler);
+    static std::string serializeSampler(const Sampler *sampler);
+    static void unserializeSampler(Sampler *sampler, const std::string &state);
+
+protected:
+    Vector2i m_size = Vector2i(0, 0);
+    int m_borderSize = 0;
+    uint32_t m_sampleCount = 0;
+    uint32_t m_completedPasses = 0;
+    std::string m_samplerType;
+    uint64_t m_seed = 0;
+    RenderPartition m_partition;
+    std::vector<float> m_data;           ///< Raw Color4f accumulation buffer
+    std::vector<std::string> m_samplers; ///< Serialized sampler state per block
+};
+
+/**
+ * \brief Writes checkpoints on a background thread
+ *
+ * Only one write is in flight at any time: submitting a new checkpoint
+ * first waits for the previous one to finish.
+ */
+class CheckpointWriter {
+public:
+    /// Wait for any pending write to finish
+    ~CheckpointWriter() { wait(); }
+
+    /// Asynchronously write \c checkpoint to \c filename
+    void write(std::unique_ptr<RenderCheckpoint> checkpoint, const std::string &filename);
+
+    /// Block until the pending write (if any) has finished
+    void wait();
+
+private:
+    std::thread m_thread;
+};
+
+NORI_NAMESPACE_END
+
+#endif /* __NORI_CHECKPOINT_H */
@@ -20,6 +20,7 @@
 #define __NORI_DISCRETE_PDF_H
 
 #include <nori/common.h>
+#include <nori/alias.h>
 #include <memory>
 
 NORI_NAMESPACE_BEGIN
@@ -28,7 +29,15 @@ NORI_NAMESPACE_BEGIN
  * \brief Discrete probability distribution
  * 
  * This data structure can be used to transform uniformly distributed
- * samples to a stored discrete probability distribution.
+ * samples to a stored discrete probability distribution. The entries are
+ * stored as a CDF; \ref normalize() additionally builds an alias table
+ * (see \ref AliasTable), which samples in constant time instead of
+ * performing a binary search over the CDF.
+ *
+ * Unlike the binary search, an alias table lookup is not monotonic in the
+ * sample value, which scrambles the stratification of Sobol, CMJ or
+ * blue-noise samples. Distributions that are sampled with such samples
+ * can be normalized without the alias table to keep it.
  * 
  * \ingroup libcore
  */
@@ -44,17 +53,21 @@ public:
     void clear() {
         m_cdf.clear();
         m_cdf.push_back(0.0f);
+        m_weights.clear();
+        m_alias = AliasTable();
         m_normalized = false;
     }
 
     /// Reserve memory for a certain number of entries
     void reserve(size_t nEntries) {
         m_cdf.reserve(nEntries+1);
+        m_weights.reserve(nEntries);
     }
 
     /// Append an entry with the specified discrete probability
     void append(float pdfValue) {
         m_cdf.push_back(m_cdf[m_cdf.size()-1] + pdfValue);
+        m_weights.push_back(pdfValue);
     }
 
     /// Return the number of entries so far
@@ -64,6 +77,8 @@ public:
 
     /// Access an entry by its index
     float operator[](size_t entry) const {
+        if (m_alias.size() > 0)
+            return m_alias.pdf(entry);
         return m_cdf[entry+1] - m_cdf[entry];
     }
 
@@ -93,11 +108,19 @@ public:
     /**
      * \brief Normalize the distribution
      *
+     * \param aliasTable
+     *     Whether to sample with an alias table, or by inverting the CDF
      * \return Sum of the (previously unnormalized) entries
      */
-    float normalize() {
+    float normalize(bool aliasTable = true) {
         m_sum = m_cdf[m_cdf.size()-1];
         if (m_sum > 0) {
+            /* Build the alias table from the original entries, which are more
+               accurate than differences of the CDF, and release them */
+            if (aliasTable && m_weights.size() == size())
+                m_alias.build(m_weights.data(), m_weights.size());
+            std::vector<float>().swap(m_weights);
+
             m_normalization = 1.0f / m_sum;
             for (size_t i=1; i<m_cdf.size(); ++i) 
                 m_cdf[i] *= m_normalization;
@@ -118,8 +141,11 @@ public:
      *     The discrete index associated with the sample
      */
     size_t sample(float sampleValue) const {
+        if (m_alias.size() > 0)
+            return m_alias.sample(sampleValue);
+        /* The last CDF entry not above the sample, which skips entries of zero probability */
         std::vector<float>::const_iterator entry = 
-                std::lower_bound(m_cdf.begin(), m_cdf.end(), sampleValue);
+                std::upper_bound(m_cdf.begin(), m_cdf.end(), sampleValue);
         size_t index = (size_t) std::max((ptrdiff_t) 0, entry - m_cdf.begin() - 1);
         return std::min(index, m_cdf.size()-2);
     }
@@ -151,6 +177,8 @@ public:
      *     The discrete index associated with the sample
      */
     size_t sampleReuse(float &sampleValue) const {
+        if (m_alias.size() > 0)
+            return m_alias.sample(sampleValue, nullptr, &sampleValue);
         size_t index = sample(sampleValue);
         sampleValue = (sampleValue - m_cdf[index])
             / (m_cdf[index + 1] - m_cdf[index]);
@@ -170,6 +198,8 @@ public:
      *     The discrete index associated with the sample
      */
     size_t sampleReuse(float &sampleValue, float &pdf) const {
+        if (m_alias.size() > 0)
+            return m_alias.sample(sampleValue, &pdf, &sampleValue);
         size_t index = sample(sampleValue, pdf);
         sampleValue = (sampleValue - m_cdf[index])
             / (m_cdf[index + 1] - m_cdf[index]);
@@ -186,15 +216,17 @@ public:
         std::string result = tfm::format("DiscretePDF[sum=%f, "
             "normalized=%f, pdf = {", m_sum, m_normalized);
 
-        for (size_t i=0; i<m_cdf.size(); ++i) {
+        for (size_t i=0; i<size(); ++i) {
             result += std::to_string(operator[](i));
-            if (i != m_cdf.size()-1)
+            if (i != size()-1)
                 result += ", ";
         }
         return result + "}]";
     }
 private:
     std::vector<float> m_cdf;
+    std::vector<float> m_weights; // entries until normalize()
+    AliasTable m_alias;
     float m_sum, m_normalization;
     bool m_normalized;
 };
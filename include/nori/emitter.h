@@ -20,6 +20,7 @@
 #define __NORI_EMITTER_H
 
 #include <nori/object.h>
+#include <nori/bbox.h>
 
 NORI_NAMESPACE_BEGIN
 
@@ -52,6 +53,17 @@ struct EmitterQueryRecord {
     Vector3f wi;
     /// Distance between 'ref' and 'p'
     float dist;
+    /// Triangle of the emitter's mesh that contains 'p', if known
+    uint32_t primIndex = (uint32_t) -1;
+    /**
+     * \brief Normal at 'ref' if only light from its positive hemisphere
+     * matters (zero otherwise)
+     *
+     * Emitters may use it to avoid sampling directions below the surface.
+     * The same normal must be passed to \ref Emitter::sample() and
+     * \ref Emitter::pdf() for a shading point.
+     */
+    Normal3f refNormal = Normal3f(0.0f);
 
     /// Create an unitialized query record
     EmitterQueryRecord() : emitter(nullptr) { }
@@ -65,7 +77,8 @@ struct EmitterQueryRecord {
      */
     EmitterQueryRecord(const Emitter *emitter, 
             const Point3f &ref, const Point3f &p,
-            const Normal3f &n) : emitter(emitter), ref(ref), p(p), n(n) {
+            const Normal3f &n, uint32_t primIndex = (uint32_t) -1)
+        : emitter(emitter), ref(ref), p(p), n(n), primIndex(primIndex) {
         wi = p - ref;
         dist = wi.norm();
         wi /= dist;
@@ -75,6 +88,28 @@ struct EmitterQueryRecord {
     std::string toString() const;
 };
 
+/**
+ * \brief Spatial and directional bounds of the emission of a light
+ *
+ * Used to build the light BVH (see \ref LightSampler). Light leaves the
+ * box \c bbox in directions within <tt>acos(cosThetaE)</tt> of the
+ * surface normals, which in turn lie within <tt>acos(cosThetaO)</tt> of
+ * \c axis (the "orientation cone" of Conty Estevez and Kulla).
+ */
+struct LightBounds {
+    BoundingBox3f bbox;
+    /// Center of the cone of normals
+    Vector3f axis = Vector3f(0, 0, 1);
+    /// Cosine of the spread of the normals around \c axis
+    float cosThetaO = -1.f;
+    /// Cosine of the spread of the emission around each normal
+    float cosThetaE = 0.f;
+    /// Total emitted power (luminance)
+    float power = 0.f;
+    /// Does the light emit on both sides of its surface?
+    bool twoSided = false;
+};
+
 /**
  * \brief Superclass of all emitters
  */
@@ -118,6 +153,14 @@ public:
      */
     virtual Color3f eval(const EmitterQueryRecord &lRec) const = 0;
 
+    /**
+     * \brief Return the bounds of the emitted light
+     *
+     * \return \c false for lights that surround the scene (environment
+     * maps, distant lights), which have no finite bounds
+     */
+    virtual bool getLightBounds(LightBounds &bounds) const { return false; }
+
     /// Sample a photon
     virtual Color3f samplePhoton(Ray3f &ray, const Point2f &sample1, const Point2f &sample2, float another_u) const {
         throw NoriException("Emitter::samplePhoton(): not implemented!");
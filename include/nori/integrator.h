@@ -23,6 +23,16 @@
 
 NORI_NAMESPACE_BEGIN
 
+/// Location of a camera sample, see \ref Integrator::LiPixel()
+struct PixelQuery {
+    /// Index of the rendered view (i.e. camera)
+    size_t view = 0;
+    /// Pixel that is being sampled
+    Point2i pixel = Point2i(0, 0);
+    /// Sample index of the current pass
+    uint32_t pass = 0;
+};
+
 /**
  * \brief Abstract integrator (i.e. a rendering technique)
  *
@@ -54,6 +64,28 @@ public:
      */
     virtual Color3f Li(const Scene *scene, Sampler *sampler, const Ray3f &ray) const = 0;
 
+    /**
+     * \brief Prepare for rendering the given views
+     *
+     * Called once before the first pass by the renderer. Integrators that
+     * keep per-pixel state across pixels and passes allocate it here.
+     */
+    virtual void beginRender(const std::vector<const Camera *> &cameras) { }
+
+    /**
+     * \brief Sample the incident radiance along a camera ray
+     *
+     * This is what the renderer calls for each pixel sample. In addition to
+     * \ref Li(), it knows the pixel and pass of the sample, which allows
+     * reusing information between neighboring pixels and successive passes.
+     * The passes are rendered one after another, but the pixels of a pass
+     * in parallel. The default implementation simply calls \ref Li().
+     */
+    virtual Color3f LiPixel(const Scene *scene, Sampler *sampler, const Ray3f &ray,
+                            const PixelQuery &query) const {
+        return Li(scene, sampler, ray);
+    }
+
     /**
      * \brief Return the type of object (i.e. Mesh/BSDF/etc.) 
      * provided by this instance
@@ -0,0 +1,86 @@
+#if !defined(__NORI_LIGHTSAMPLER_H)
+#define __NORI_LIGHTSAMPLER_H
+
+#include <nori/emitter.h>
+#include <nori/memory.h>
+#include <memory>
+#include <unordered_map>
+
+NORI_NAMESPACE_BEGIN
+
+/// Cone of directions, e.g. bounding the surface normals of a light
+struct DirectionCone {
+    Vector3f axis = Vector3f(0, 0, 1);
+    /// Cosine of the opening angle (> 1 for an empty cone)
+    float cosTheta = 2.f;
+
+    DirectionCone() { }
+    DirectionCone(const Vector3f &axis, float cosTheta = 1.f) : axis(axis), cosTheta(cosTheta) { }
+
+    bool isEmpty() const { return cosTheta > 1.f; }
+
+    /// Cone that contains all directions
+    static DirectionCone entireSphere() { return DirectionCone(Vector3f(0, 0, 1), -1.f); }
+
+    /// Return the smallest cone that contains both cones
+    static DirectionCone merge(const DirectionCone &a, const DirectionCone &b);
+};
+
+/**
+ * \brief Chooses the emitter that is sampled by next event estimation
+ *
+ * Instead of selecting one of the scene's emitters uniformly, integrators
+ * ask the scene's light sampler for an emitter given the shading point
+ * (and its normal, if there is a surface), and divide by the returned
+ * discrete probability. Available strategies (the \c lightSampler
+ * property of the scene):
+ *
+ * <pre>
+ *   uniform   Every emitter has the same probability (default, as
+ *             before light samplers existed)
+ *   power     Proportional to the emitted power
+ *   bvh       Light BVH over the power, bounds and orientation of the
+ *             emitters
+ * </pre>
+ *
+ * The light BVH follows Conty Estevez and Kulla's "Importance Sampling of
+ * Many Lights with Adaptive Tree Splitting" in the formulation of PBRT v4:
+ * each node bounds the position, normals and power of its lights, and the
+ * traversal descends into a child with a probability proportional to an
+ * importance estimate of the child for the shading point. Emitters
+ * without finite bounds (environment maps, distant lights) are chosen
+ * uniformly with the same total probability as a single bounded light
+ * for the \c power and \c bvh strategies.
+ */
+class LightSampler {
+public:
+    virtual ~LightSampler() { }
+
+    /**
+     * \brief Choose an emitter for a shading point
+     *
+     * \param ref
+     *     Shading point
+     * \param n
+     *     Surface normal at the shading point, or zero in a medium
+     * \param sample
+     *     A uniformly distributed sample on <tt>[0, 1)</tt>
+     * \param pdf
+     *     Returns the discrete probability of the chosen emitter
+     * \return The chosen emitter, or \c nullptr if there is none
+     */
+    virtual const Emitter *sample(const Point3f &ref, const Normal3f &n, float sample, float &pdf) const = 0;
+
+    /// Return the probability of choosing \c emitter for the shading point
+    virtual float pdf(const Point3f &ref, const Normal3f &n, const Emitter *emitter) const = 0;
+
+    virtual std::string toString() const = 0;
+
+    /// Create a light sampler of the given type (see above) for a set of emitters
+    static std::unique_ptr<LightSampler> create(const std::string &type,
+                                                const std::vector<Emitter *> &emitters);
+};
+
+NORI_NAMESPACE_END
+
+#endif /* __NORI_LIGHTSAMPLER_H */
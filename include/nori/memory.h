@@ -0,0 +1,110 @@
+#if !defined(__NORI_MEMORY_H)
+#define __NORI_MEMORY_H
+
+#include <nori/common.h>
+
+NORI_NAMESPACE_BEGIN
+
+/// Subsystems whose memory usage is tracked by \ref MemoryAccounting
+enum EMemCategory {
+    EMemMeshes = 0,     ///< Vertex and index buffers of triangle meshes
+    EMemBVH,            ///< BVH nodes and triangle index lists
+    EMemTextures,       ///< Image textures and environment maps
+    EMemDistributions,  ///< Sampling tables (DiscretePDF, Distribution2D)
+    EMemPhotonMap,      ///< Photon map kd-tree
+    EMemImageBlocks,    ///< Output image and per-thread image blocks
+    EMemSamplers,       ///< Per-block sample generators
+    EMemIntegrator,     ///< Per-pixel state of integrators (e.g. ReSTIR reservoirs)
+    EMemCategoryCount
+};
+
+/**
+ * \brief Central bookkeeping of the memory used by the renderer
+ *
+ * Subsystems report their large allocations (usually through a
+ * \ref MemoryRecord member), which allows printing a breakdown of the
+ * current and peak usage per subsystem. An optional budget makes any
+ * allocation that would exceed it fail with a \ref NoriException that
+ * names the offending subsystem.
+ */
+class MemoryAccounting {
+public:
+    /// Register \c bytes of new memory. Throws if the budget would be exceeded
+    static void allocate(EMemCategory category, size_t bytes);
+
+    /// Release \c bytes of memory that were previously registered
+    static void release(EMemCategory category, size_t bytes);
+
+    /// Set the maximum total memory usage in bytes (0 disables the limit)
+    static void setBudget(size_t bytes);
+
+    /// Return the memory that is currently registered for a subsystem
+    static size_t getUsage(EMemCategory category);
+
+    /// Return the total memory that is currently registered
+    static size_t getTotalUsage();
+
+    /// Return the highest total memory usage so far
+    static size_t getPeakUsage();
+
+    /// Restart peak tracking from the current usage (e.g. between two renderings)
+    static void resetPeak();
+
+    /**
+     * \brief Return a per-subsystem breakdown of the memory usage
+     *
+     * \param peak
+     *     Report the usage at the time of the peak instead of the current one
+     */
+    static std::string report(bool peak = false);
+
+    /// Return the name of a subsystem
+    static const char *categoryName(EMemCategory category);
+};
+
+/**
+ * \brief Keeps the memory accounting of an object up to date
+ *
+ * Objects embed a record and call \ref set() whenever the size of their
+ * data changes; the memory is released again when the object is destroyed.
+ * Copies of an object register their own copy of the memory.
+ */
+class MemoryRecord {
+public:
+    MemoryRecord(EMemCategory category) : m_category(category) { }
+
+    MemoryRecord(const MemoryRecord &other) : m_category(other.m_category) {
+        set(other.m_bytes);
+    }
+
+    MemoryRecord &operator=(const MemoryRecord &other) {
+        if (this != &other) {
+            set(0);
+            m_category = other.m_category;
+            set(other.m_bytes);
+        }
+        return *this;
+    }
+
+    ~MemoryRecord() { set(0); }
+
+    /// Update the number of bytes that are used by the owner
+    void set(size_t bytes) {
+        if (bytes > m_bytes)
+            MemoryAccounting::allocate(m_category, bytes - m_bytes);
+        else if (bytes < m_bytes)
+            MemoryAccounting::release(m_category, m_bytes - bytes);
+        m_bytes = bytes;
+    }
+
+    /// Return the number of bytes that are used by the owner
+    size_t get() const { return m_bytes; }
+
+private:
+    EMemCategory m_category;
+    size_t m_bytes = 0;
+};
+
+NORI_NAMESPACE_END
+
+#endif /* __NORI_MEMORY_H */
@@ -23,9 +23,12 @@
 #include <nori/frame.h>
 #include <nori/bbox.h>
 #include <nori/dpdf.h>
+#include <nori/memory.h>
 
 NORI_NAMESPACE_BEGIN
 
+struct DirectionCone;
+
 /**
  * \brief Intersection data structure
  *
@@ -47,9 +50,11 @@ struct Intersection {
     Frame geoFrame;
     /// Pointer to the associated mesh
     const Mesh *mesh;
+    /// Index of the intersected triangle within \c mesh
+    uint32_t primIndex;
 
     /// Create an uninitialized intersection record
-    Intersection() : mesh(nullptr) { }
+    Intersection() : mesh(nullptr), primIndex((uint32_t) -1) { }
 
     /// Transform a direction vector into the local shading frame
     Vector3f toLocal(const Vector3f &d) const {
@@ -72,6 +77,11 @@ struct Intersection {
  * for querying the individual triangles. Subclasses of \c Mesh implement
  * the specifics of how to create its contents (e.g. by loading from an
  * external file)
+ *
+ * Analytic shapes (spheres, disks, rectangles) are subclasses as well:
+ * they have no triangles and instead override the virtual per-primitive
+ * queries (\ref getPrimitiveCount(), \ref rayIntersect(), ...) that the
+ * \ref BVH and the area emitters use.
  */
 class Mesh : public NoriObject {
 public:
@@ -87,14 +97,56 @@ public:
     /// Return the total number of vertices in this hsape
     uint32_t getVertexCount() const { return (uint32_t) m_V.cols(); }
 
+    /// Return the number of primitives that the BVH stores for this shape
+    virtual uint32_t getPrimitiveCount() const { return getTriangleCount(); }
+
     /**
      * \brief Uniformly sample a position on the mesh with
      * respect to surface area. Returns both position and normal
      */
-    void samplePosition(const Point2f &sample, Point3f &p, Normal3f &n, float optional_u) const;
+    virtual void samplePosition(const Point2f &sample, Point3f &p, Normal3f &n, float optional_u) const;
+
+    /**
+     * \brief Sample a position on the shape as seen from \c ref
+     *
+     * Triangles are chosen by area and sampled uniformly within the
+     * spherical triangle that they subtend (Arvo 1995), unless that is too
+     * small to be sampled accurately. Analytic shapes sample the solid
+     * angle exactly where they can.
+     *
+     * \return \c false if sampling failed
+     */
+    virtual bool sampleSolidAngle(const Point3f &ref, const Point2f &sample, float optional_u,
+                                  Point3f &p, Normal3f &n, uint32_t &index) const;
+
+    /**
+     * \brief Density of \ref sampleSolidAngle() with respect to solid angle
+     *
+     * \c index is the primitive that contains \c p, e.g. \ref
+     * Intersection::primIndex. Triangle meshes throw a \ref NoriException
+     * for an invalid index.
+     */
+    virtual float pdfSolidAngle(const Point3f &ref, const Point3f &p, const Normal3f &n,
+                                uint32_t index) const;
+
+    /**
+     * \brief Choose a triangle with probability proportional to its area
+     *
+     * \return The index of the triangle, \c pdf returns its discrete probability
+     */
+    uint32_t sampleTriangle(float sample, float &pdf) const;
+
+    /// Return the probability of choosing a triangle in \ref sampleTriangle()
+    float trianglePdf(uint32_t index) const { return m_pdfs[index]; }
+
+    /**
+     * \brief Return the position and (interpolated) normal at the given
+     * barycentric coordinates of a triangle
+     */
+    void evalPosition(uint32_t index, const Point2f &bary, Point3f &p, Normal3f &n) const;
 
 	/// Return the surface area of the given triangle
-    float surfaceArea(uint32_t index) const;
+    virtual float surfaceArea(uint32_t index) const;
 
 	/// Return total surface aea
 	float totalSurfaceArea() const { return m_totalSurfaceArea; }
@@ -103,10 +155,13 @@ public:
     const BoundingBox3f &getBoundingBox() const { return m_bbox; }
 
     //// Return an axis-aligned bounding box containing the given triangle
-    BoundingBox3f getBoundingBox(uint32_t index) const;
+    virtual BoundingBox3f getBoundingBox(uint32_t index) const;
 
     //// Return the centroid of the given triangle
-    Point3f getCentroid(uint32_t index) const;
+    virtual Point3f getCentroid(uint32_t index) const;
+
+    /// Return a cone that contains the surface normals
+    virtual DirectionCone getNormalCone() const;
 
     /** \brief Ray-triangle intersection test
      *
@@ -133,7 +188,16 @@ public:
      * \return
      *   \c true if an intersection has been detected
      */
-    bool rayIntersect(uint32_t index, const Ray3f &ray, float &u, float &v, float &t) const;
+    virtual bool rayIntersect(uint32_t index, const Ray3f &ray, float &u, float &v, float &t) const;
+
+    /**
+     * \brief Fill in the surface information of an intersection
+     *
+     * Called once for the closest hit of a ray: \c its.t and \c its.uv
+     * contain the values returned by \ref rayIntersect(). Computes the
+     * position, (texture) coordinates and frames.
+     */
+    virtual void setHitInformation(uint32_t index, const Ray3f &ray, Intersection &its) const;
 
 	// Computes a ray-mesh intersection test, returning the point to the nearest intersection on the mesh.
 	bool rayMeshIntersect(const Ray3f& ray, Intersection& isect) const;
@@ -172,7 +236,7 @@ public:
     const std::string &getName() const { return m_name; }
 
     /// Return a human-readable summary of this instance
-    std::string toString() const;
+    virtual std::string toString() const;
 
     /**
      * \brief Return the type of object (i.e. Mesh/BSDF/etc.)
@@ -189,6 +253,12 @@ protected:
     /// Create an empty mesh
     Mesh();
 
+    /// Primitives that subtend less than this solid angle are sampled by area
+    static constexpr float MinSampledSolidAngle = 3e-4f;
+
+    /// Solid angle of a triangle seen from 'ref', and the directions to its vertices
+    float triangleSolidAngle(uint32_t index, const Point3f &ref, Vector3f &a, Vector3f &b, Vector3f &c) const;
+
 protected:
     std::string m_name;                  ///< Identifying name
     MatrixXf      m_V;                   ///< Vertex positions
@@ -202,6 +272,8 @@ protected:
     BoundingBox3f m_bbox;                ///< Bounding box of the mesh
 	DiscretePDF	  m_pdfs;			     // We store pdfs for sampling the mesh.
 	float		  m_totalSurfaceArea;
+    MemoryRecord  m_memory { EMemMeshes };          ///< Accounting of the vertex and index buffers
+    MemoryRecord  m_pdfMemory { EMemDistributions }; ///< Accounting of the area sampling table
 };
 
 NORI_NAMESPACE_END
@@ -149,6 +149,15 @@ public:
         return (*m_constructors)[name](propList);
     }
 
+    /// Return the names of all registered classes
+    static std::vector<std::string> getRegisteredClasses() {
+        std::vector<std::string> result;
+        if (m_constructors)
+            for (const auto &v : *m_constructors)
+                result.push_back(v.first);
+        return result;
+    }
+
     static void printRegisteredClasses() {
         if(m_constructors)
             for(auto v : *m_constructors)
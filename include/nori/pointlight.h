@@ -23,6 +23,8 @@ public:
 
 	Color3f eval(const EmitterQueryRecord &lRec) const;
 
+	bool getLightBounds(LightBounds &bounds) const;
+
 	std::string toString() const;
 
 private:
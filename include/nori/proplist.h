@@ -126,6 +126,9 @@ public:
 
     /// Get a transform property, and use a default value if it does not exist
     Transform getTransform(const std::string &name, const Transform &defaultValue) const;
+
+    /// Copy all properties of \c other, replacing existing values of the same name
+    void merge(const PropertyList &other);
 private:
     /* Custom variant data type (stores one of boolean/integer/float/...) */
     struct Property {
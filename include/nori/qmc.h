@@ -0,0 +1,91 @@
+#if !defined(__NORI_QMC_H)
+#define __NORI_QMC_H
+
+#include <nori/vector.h>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Building blocks of the quasi-Monte Carlo samplers
+ *
+ * The first two dimensions of the Sobol sequence and the hash-based Owen
+ * scrambling of Burley's "Practical Hash-based Owen Scrambling" (JCGT
+ * 2020), shared by the \c sobol and \c bluenoise samplers.
+ */
+class QMC {
+public:
+    /**
+     * \brief Owen-scrambled 1D Sobol point
+     *
+     * The sample index is shuffled by a scramble as well, so different
+     * seeds yield decorrelated sequences (used to pad dimensions)
+     */
+    static float scrambledSobol1D(uint32_t index, uint32_t seed) {
+        index = nestedUniformScramble(index, seed);
+        return toUnitFloat(nestedUniformScramble(sobol0(index), hashCombine(seed, 0)));
+    }
+
+    /// Owen-scrambled 2D Sobol point with a shuffled sample index
+    static Point2f scrambledSobol2D(uint32_t index, uint32_t seed) {
+        index = nestedUniformScramble(index, seed);
+        return Point2f(
+            toUnitFloat(nestedUniformScramble(sobol0(index), hashCombine(seed, 0))),
+            toUnitFloat(nestedUniformScramble(sobol1(index), hashCombine(seed, 1)))
+        );
+    }
+
+    /// First Sobol dimension (the van der Corput sequence)
+    static uint32_t sobol0(uint32_t index) {
+        return reverseBits(index);
+    }
+
+    /// Second Sobol dimension (primitive polynomial x + 1)
+    static uint32_t sobol1(uint32_t index) {
+        uint32_t result = 0;
+        for (uint32_t v = 1u << 31; index != 0; index >>= 1, v ^= v >> 1) {
+            if (index & 1)
+                result ^= v;
+        }
+        return result;
+    }
+
+    static uint32_t reverseBits(uint32_t value) {
+        value = (value << 16) | (value >> 16);
+        value = ((value & 0x00ff00ffu) << 8) | ((value & 0xff00ff00u) >> 8);
+        value = ((value & 0x0f0f0f0fu) << 4) | ((value & 0xf0f0f0f0u) >> 4);
+        value = ((value & 0x33333333u) << 2) | ((value & 0xccccccccu) >> 2);
+        value = ((value & 0x55555555u) << 1) | ((value & 0xaaaaaaaau) >> 1);
+        return value;
+    }
+
+    /// Owen scramble of the bits of \c value (Laine-Karras hash on the reversed bits)
+    static uint32_t nestedUniformScramble(uint32_t value, uint32_t seed) {
+        value = reverseBits(value);
+        value += seed;
+        value ^= value * 0x6c50b47cu;
+        value ^= value * 0xb82f1e52u;
+        value ^= value * 0xc7afe638u;
+        value ^= value * 0x8d22f6e6u;
+        return reverseBits(value);
+    }
+
+    static uint32_t hashCombine(uint32_t seed, uint32_t value) {
+        return seed ^ (value + 0x9e3779b9u + (seed << 6) + (seed >> 2));
+    }
+
+    /// Map the upper 24 bits to a float in <tt>[0, 1)</tt>
+    static float toUnitFloat(uint32_t value) {
+        return (value >> 8) * (1.f / (1u << 24));
+    }
+
+    /// SplitMix64 finalizer, used to decorrelate nearby seeds
+    static uint64_t mix64(uint64_t value) {
+        value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+        return value ^ (value >> 31);
+    }
+};
+
+NORI_NAMESPACE_END
+
+#endif /* __NORI_QMC_H */
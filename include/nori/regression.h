@@ -0,0 +1,95 @@
+#if !defined(__NORI_REGRESSION_H)
+#define __NORI_REGRESSION_H
+
+#include <nori/bitmap.h>
+#include <map>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief End-to-end render performance and quality regression suite
+ *
+ * A suite file lists one test case per line as whitespace-separated
+ * <tt>key=value</tt> pairs (the format of \ref RenderServer jobs):
+ *
+ * <pre>
+ *   name=cbox                Case name (required)
+ *   scene=cbox.xml           Scene file (required)
+ *   reference=cbox.ref.exr   Converged reference (default: name.ref.exr)
+ *   spp=16                   Samples per pixel (default: 16)
+ *   seed=1                   Sampler seed (default: 1)
+ *   threads=4                Rendering threads (default: 4)
+ *   referenceSpp=1024        Samples per pixel of the reference (default: 64*spp)
+ *   timeTolerance=0.1        Allowed relative increase of the wall time
+ *   errorTolerance=0.1       Allowed relative increase of the relMSE
+ *   ssimTolerance=0.01       Allowed absolute decrease of the SSIM
+ *   memoryTolerance=0.1      Allowed relative increase of the peak memory
+ *   significance=0.01        Significance level of the bias test
+ * </pre>
+ *
+ * Paths are relative to the suite file; empty lines and lines starting
+ * with '#' are ignored. Every case is rendered at its fixed seed and
+ * thread count, and the wall time, Mrays/s, peak memory, relMSE and SSIM
+ * against the reference are recorded. A Student's t-test on the mean
+ * luminance differences of 16x16 pixel blocks (see \c hypothesis.h)
+ * detects a biased mean; blocks rather than pixels, because the
+ * reconstruction filter correlates neighboring pixels.
+ *
+ * The measurements of a known-good build are stored next to the
+ * reference in <tt>name.baseline</tt> (written by \ref run() in update
+ * mode, which also renders missing references and skips the bias test).
+ * Later runs flag every metric that is worse than the baseline by more
+ * than its tolerance. Baselines contain wall times and are therefore
+ * specific to a machine: the first run on a machine has to be in update
+ * mode.
+ */
+class RegressionSuite {
+public:
+    /// Measurements of one test case
+    struct Result {
+        std::string name;
+        double wallTime = 0;        ///< Seconds (scene loading and rendering)
+        double mraysPerSecond = 0;  ///< Traced rays (including shadow rays) per second
+        double peakMemory = 0;      ///< Peak accounted memory in bytes
+        double relMSE = 0;          ///< Relative mean squared error w.r.t. the reference
+        double ssim = 0;            ///< Structural similarity w.r.t. the reference
+        std::string biasTest;       ///< Output of the t-test
+        std::vector<std::string> regressions;
+    };
+
+    /// Load a suite file
+    RegressionSuite(const std::string &filename);
+
+    /**
+     * \brief Run all test cases
+     *
+     * \param update
+     *     Record the measurements as the new baselines instead of
+     *     comparing against them, and render missing references
+     * \return The number of failed test cases
+     */
+    int run(bool update);
+
+    /// Return the results of the last run as a JSON document
+    std::string toJSON() const;
+
+    /// Relative mean squared error of \c image w.r.t. \c reference
+    static double relMSE(const Bitmap &image, const Bitmap &reference);
+
+    /// Mean structural similarity of the tonemapped luminance (7x7 windows)
+    static double ssim(const Bitmap &image, const Bitmap &reference);
+
+protected:
+    typedef std::map<std::string, std::string> Parameters;
+
+    Result runCase(const Parameters &params, bool update);
+
+private:
+    std::string m_basePath;
+    std::vector<Parameters> m_cases;
+    std::vector<Result> m_results;
+};
+
+NORI_NAMESPACE_END
+
+#endif /* __NORI_REGRESSION_H */
@@ -22,21 +22,187 @@
 #include <nori/common.h>
 #include <thread>
 #include <nori/block.h>
+#include <nori/bbox.h>
+#include <nori/stats.h>
 #include <atomic>
+#include <functional>
+#include <memory>
 
 NORI_NAMESPACE_BEGIN
 
+/**
+ * \brief Part of an image that is computed by one render process
+ *
+ * This is used to split a single frame across several processes or
+ * machines. Each process renders its part into a full-size accumulation
+ * buffer that is written as a raw weighted OpenEXR file (see
+ * \ref ImageBlock::saveRaw()), and the \c imagemerge tool sums these
+ * files into the final image. Since samples are seeded per pixel and
+ * sample index (see \ref Sampler::setSampleIndex()), the merged result
+ * matches a render of the whole frame.
+ */
+struct RenderPartition {
+    /// Pixels to render (inclusive bounds). An invalid box selects the whole image
+    BoundingBox2i region;
+
+    /// Range <tt>[tileBegin, tileEnd)</tt> of block ids to render, in row-major order. A negative end selects all blocks
+    int tileBegin = 0, tileEnd = -1;
+
+    /// Range <tt>[sampleBegin, sampleEnd)</tt> of sample indices to render. A negative end selects all samples
+    int sampleBegin = 0, sampleEnd = -1;
+
+    /// Does this partition cover less than the whole frame?
+    bool isPartial() const {
+        return region.isValid() || tileBegin > 0 || tileEnd >= 0 ||
+               sampleBegin > 0 || sampleEnd >= 0;
+    }
+
+    /// Does the given image block contain pixels of this partition?
+    bool containsBlock(const ImageBlock &block) const;
+
+    /// Does \c other select the same pixels, blocks and samples?
+    bool operator==(const RenderPartition &other) const;
+
+    bool operator!=(const RenderPartition &other) const { return !operator==(other); }
+
+    /**
+     * \brief Suffix that identifies the partition in file names
+     *
+     * For example <tt>_region-0-0-64-64_samples-0-16</tt>, using the
+     * arguments of the command line options. Empty for the whole frame.
+     */
+    std::string getSuffix() const;
+};
+
+/// Progress information that is passed to \ref RenderThread::ProgressCallback
+struct RenderProgress {
+    float progress = 0.f;          ///< Completed fraction of the rendering
+    uint64_t samples = 0;          ///< Number of pixel samples computed so far
+    double elapsed = 0;            ///< Elapsed time in milliseconds
+    double remaining = 0;          ///< Estimated remaining time in milliseconds
+    double samplesPerSecond = 0;   ///< Average number of pixel samples per second
+};
+
 class RenderThread {
 
 public:
+    /// Receives progress updates (called from a rendering thread)
+    typedef std::function<void (const RenderProgress &)> ProgressCallback;
+
     RenderThread(ImageBlock & block);
     ~RenderThread();
 
     void renderScene(const std::string & filename);
 
+    /**
+     * \brief Load a scene and run the integrator's preprocessing step
+     *
+     * \return The scene, or \c nullptr if the file does not describe
+     * a scene. The caller takes ownership.
+     */
+    static Scene *loadScene(const std::string &filename);
+
+    /**
+     * \brief Render a scene that has already been loaded by \ref loadScene()
+     *
+     * \param cameras
+     *     Cameras to render with (e.g. the scene's cameras or a copy with
+     *     overridden parameters). Several cameras are rendered as separate
+     *     views, whose blocks are scheduled in a single work pool. Their
+     *     images are named after the cameras (<tt>base_name.exr</tt>).
+     * \param sampler
+     *     Sample generator prototype, which also determines the number
+     *     of samples per pixel
+     * \param outputBase
+     *     Output filename without extension
+     * \param ownsScene
+     *     Delete the scene when done. Otherwise the caller keeps ownership,
+     *     and the scene can be rendered again. The cameras and sampler must
+     *     remain valid until rendering has finished.
+     */
+    void renderLoadedScene(Scene *scene, const std::vector<const Camera *> &cameras,
+                           const Sampler *sampler, const std::string &outputBase, bool ownsScene);
+
+    /**
+     * \brief Periodically write checkpoints while rendering
+     *
+     * A checkpoint is written in the background after the first sample
+     * pass that completes at least \c seconds after the previous one, and
+     * when the rendering is interrupted, to <tt>scene.ckpt</tt>. Partial
+     * renders add \ref RenderPartition::getSuffix() to the name, so that
+     * workers with different partitions never overwrite each other's
+     * checkpoints. A value of zero disables checkpointing.
+     */
+    void setCheckpointInterval(float seconds) { m_checkpointInterval = seconds; }
+
+    /// Continue the next rendering from the given checkpoint file
+    void setResumeFile(const std::string &filename) { m_resumeFile = filename; }
+
+    /// Only render part of the image (see \ref RenderPartition)
+    void setPartition(const RenderPartition &partition) { m_partition = partition; }
+
+    /**
+     * \brief Write the raw weighted accumulation buffer to \c filename
+     * instead of a normalized image
+     *
+     * Partial renders (see \ref setPartition()) always write a raw file,
+     * which defaults to <tt>scene.raw.exr</tt> with the partition suffix
+     * (e.g. <tt>scene_samples-0-16.raw.exr</tt>).
+     */
+    void setRawOutput(const std::string &filename) { m_rawOutput = filename; }
+
+    /// Write the image to \c filename instead of next to the scene file
+    void setOutputName(const std::string &filename) { m_outputName = filename; }
+
+    /// Use \c count rendering threads (zero: one per core)
+    void setThreadCount(int count) { m_threadCount = count; }
+
+    /// Override the number of samples per pixel of the scene (zero: keep)
+    void setSampleCount(int sampleCount) { m_sampleCount = sampleCount; }
+
+    /// Override the image resolution of the scene's cameras (zero: keep)
+    void setResolution(const Vector2i &resolution) { m_resolution = resolution; }
+
+    /// Write the render statistics (see \ref Statistics) as JSON to \c filename
+    void setStatsFile(const std::string &filename) { m_statsFile = filename; }
+
+    /**
+     * \brief Record per-pixel cost images (see \ref CostAOVs)
+     *
+     * They are written as extra channels of the output EXR. Raw outputs
+     * of partial renders do not include them.
+     */
+    void setCostAOVs(bool enabled) { m_costAOVs = enabled; }
+
+    /// Override the seed of the scene's sample generator
+    void setSeed(uint64_t seed) { m_seed = seed; m_hasSeed = true; }
+
+    /**
+     * \brief Receive progress updates while rendering
+     *
+     * The callback is invoked at most once every \c interval seconds,
+     * and once more when the rendering has finished.
+     */
+    void setProgressCallback(const ProgressCallback &callback, float interval = 1.f) {
+        m_progressCallback = callback;
+        m_progressInterval = interval;
+    }
+
     bool isBusy();
     void stopRendering();
 
+    /// Block until the current rendering (if any) has finished
+    void wait();
+
+    /// Return the statistics counted during the last rendering (valid after \ref wait())
+    const Statistics::Snapshot &getStatistics() const { return m_lastStats; }
+
+    /// Return the duration of the last rendering in milliseconds (valid after \ref wait())
+    double getRenderTime() const { return m_lastRenderTime; }
+
+    /// Return the error message of the last rendering (empty if it succeeded)
+    const std::string &getError() const { return m_error; }
+
     float getProgress();
 
 protected:
@@ -45,6 +211,25 @@ protected:
     std::thread m_render_thread;
     std::atomic<int> m_render_status; // 0: free, 1: busy, 2: interruption, 3: done
     std::atomic<float> m_progress;
+    float m_checkpointInterval = 0.f;
+    std::string m_resumeFile;
+    RenderPartition m_partition;
+    std::string m_rawOutput;
+    std::string m_outputName;
+    std::string m_statsFile;
+    bool m_costAOVs = false;
+    Statistics::Snapshot m_lastStats;
+    double m_lastRenderTime = 0;
+    int m_threadCount = 0;
+    int m_sampleCount = 0;
+    Vector2i m_resolution = Vector2i(0, 0);
+    uint64_t m_seed = 0;
+    bool m_hasSeed = false;
+    ProgressCallback m_progressCallback;
+    float m_progressInterval = 1.f;
+    std::string m_error;
+    std::vector<std::unique_ptr<Camera>> m_overrideCameras;
+    std::unique_ptr<Sampler> m_overrideSampler;
 
 };
 
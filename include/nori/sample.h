@@ -5,125 +5,166 @@
 #include <nori/common.h>
 #include <nori/vector.h>
 #include <nori/color.h>
+#include <nori/memory.h>
+#include <nori/alias.h>
+#include <algorithm>
 #include <memory>
+#include <cmath>
 
 NORI_NAMESPACE_BEGIN
 
+// Position 'u' in [0, 1) within cell 'index' of 'count' equal cells of the unit interval. The division can
+// round into a neighboring cell, so the result is moved back into the cell, where int(x * count) finds it again.
+inline float cellCoordinate(int index, float u, int count)
+{
+	float x = (index + u) / count;
+	while ((int) (x * count) > index)
+		x = std::nextafter(x, 0.0f);
+	while ((int) (x * count) < index)
+		x = std::nextafter(x, 1.0f);
+	return x;
+}
+
+// Build the normalized CDF (n + 1 entries) of the step function 'f' with 'n' segments on the unit interval,
+// and return its integral. An all-zero function gives a uniform CDF.
+inline float buildCdf(const float *f, int n, float *cdf)
+{
+	cdf[0] = 0;
+	for (int i = 1; i < n + 1; ++i) cdf[i] = cdf[i - 1] + f[i - 1] / n;
+
+	float funcInt = cdf[n];
+	if (funcInt == 0) {
+		for (int i = 1; i < n + 1; ++i) cdf[i] = float(i) / float(n);
+	}
+	else {
+		for (int i = 1; i < n + 1; ++i) cdf[i] /= funcInt;
+	}
+	return funcInt;
+}
+
+// Find the segment of the normalized CDF 'cdf' that contains 'u', and the position 'du' of 'u' within it.
+// Segments of zero probability are never returned.
+inline int invertCdf(const float *cdf, int n, float u, float *du)
+{
+	int offset = clamp((int) (std::upper_bound(cdf, cdf + n + 1, u) - cdf) - 1, 0, n - 1);
+	*du = clamp((u - cdf[offset]) / (cdf[offset + 1] - cdf[offset]), 0.0f, 0.99999994f);
+	return offset;
+}
+
 // We are following the book for our distribution as this is highly unclear as in how to get pdfs from 2d distributions
 // for our env lights.
+// Samples are drawn with an alias table (see AliasTable) in constant time. An alias table lookup is not
+// monotonic in the sample though, so it scrambles the stratification of Sobol, CMJ or blue-noise samples.
+// With 'invertCdf', samples are drawn by a binary search over the CDF instead, which keeps it.
+// Both ways report the densities of pdf().
 struct Distribution1D {
 
-	Distribution1D(const float *f, int n) : func(f, f + n), cdf(n + 1)
+	Distribution1D(const float *f, int n, bool invertCdf = false) : func(f, f + n), cdf(n + 1), bins(n), invertCdf(invertCdf)
 	{
-		// Compute integral of step function at $x_i$
-		cdf[0] = 0;
-		for (int i = 1; i < n + 1; ++i) cdf[i] = cdf[i - 1] + func[i - 1] / n;
-
-		// Transform step function integral into CDF
-		funcInt = cdf[n];
-		if (funcInt == 0) {
-			for (int i = 1; i < n + 1; ++i) cdf[i] = float(i) / float(n);
-		}
-		else {
-			for (int i = 1; i < n + 1; ++i) cdf[i] /= funcInt;
-		}
+		funcInt = buildCdf(f, n, cdf.data());
+		AliasTable::build(f, n, bins.data());
 	}
 
 	int count() const { return static_cast<int>(func.size()); }
 
 	float sample_continuous(float u, float *pdf, int *off = nullptr) const
 	{
-		// Find surrounding CDF segments and _offset_
-		std::vector<float>::const_iterator entry =
-			std::lower_bound(cdf.begin(), cdf.end(), u);
-
-		size_t index = (size_t)std::max((ptrdiff_t)0, entry - cdf.begin() - 1);
-		int offset = std::min(index, cdf.size() - 2);
+		// Choose a segment, and the offset within it
+		float du, p;
+		int offset = (int) sample_discrete(u, &p, &du);
 
 		if (off) *off = offset;
 
-		// Compute offset along CDF segment
-		float du = u - cdf[offset];
-
-		if ((cdf[offset + 1] - cdf[offset]) > 0)
-			du /= (cdf[offset + 1] - cdf[offset]);
-		assert(!std::isnan(du));
-
 		// Compute PDF for sampled offset
-		if (pdf) *pdf = func[offset] / funcInt;
+		if (pdf) *pdf = p * count();
 
-		return (offset + du) / count();
+		return cellCoordinate(offset, du, count());
 	}
 
 	int sample_discrete(float u, float *pdf = nullptr, float *uRemapped = nullptr) const
 	{
-		// Find surrounding CDF segments and _offset_
-		std::vector<float>::const_iterator entry =
-			std::lower_bound(cdf.begin(), cdf.end(), u);
-
-		size_t index = (size_t)std::max((ptrdiff_t)0, entry - cdf.begin() - 1);
-		int offset = std::min(index, cdf.size() - 2);
+		if (!invertCdf)
+			return (int) AliasTable::sample(bins.data(), bins.size(), u, pdf, uRemapped);
 
-		if (pdf) *pdf = func[offset] / (funcInt * count());
-		if (uRemapped)
-			*uRemapped = (u - cdf[offset]) / (cdf[offset + 1] - cdf[offset]);
-		if (uRemapped) assert(*uRemapped >= 0.f && *uRemapped <= 1.f);
+		float du;
+		int offset = nori::invertCdf(cdf.data(), count(), u, &du);
+		if (pdf) *pdf = bins[offset].pdf;
+		if (uRemapped) *uRemapped = du;
 		return offset;
 	}
 
 	// Return the discrete pdf
 	float pdf(int index) const {
 		assert(index >= 0 && index < count());
-		return func[index] / (funcInt * count());
+		return bins[index].pdf;
 	}
 
 	// Distribution1D Public Data
 	std::vector<float> func, cdf;
+	std::vector<AliasTable::Bin> bins;
 	float funcInt;
+	bool invertCdf;
 };
 
 // Create a discrete 2d pdf for sampling images
+// The conditional distributions of all rows are stored as alias tables in one contiguous array.
+// With 'invertCdf', the CDFs of the rows are stored as well and sampled by binary search (see Distribution1D).
 struct Distribution2D
 {
 public:
 
-	Distribution2D(const float *data, int nu, int nv)
+	Distribution2D(const float *data, int nu, int nv, bool invertCdf = false)
+		: m_nu(nu), m_nv(nv), m_conditional((size_t) nu * nv)
 	{
-		// copy the data
-		pConditionalV.reserve(nv);
-		for (int v = 0; v < nv; ++v) {
-			// Compute conditional sampling distribution for the column with the row
-			pConditionalV.emplace_back(new Distribution1D(&data[v * nu], nu));
-		}
-		// Compute marginal sampling distribution corresponding row
-		std::vector<float> marginalFunc;
-		marginalFunc.reserve(nv);
+		// Compute conditional sampling distribution for the column with the row,
+		// and the marginal sampling distribution corresponding row
+		std::vector<float> marginalFunc(nv);
 		for (int v = 0; v < nv; ++v)
-			marginalFunc.push_back(pConditionalV[v]->funcInt);
-		pMarginal.reset(new Distribution1D(&marginalFunc[0], nv));
+			marginalFunc[v] = AliasTable::build(&data[(size_t) v * nu], nu, &m_conditional[(size_t) v * nu]) / nu;
+		m_marginal.reset(new Distribution1D(&marginalFunc[0], nv, invertCdf));
+
+		if (invertCdf)
+		{
+			m_conditionalCdf.resize((size_t) (nu + 1) * nv);
+			for (int v = 0; v < nv; ++v)
+				buildCdf(&data[(size_t) v * nu], nu, &m_conditionalCdf[(size_t) v * (nu + 1)]);
+		}
+
+		// Alias tables and CDFs of all rows, and the marginal distribution
+		m_memory.set(sizeof(AliasTable::Bin) * ((size_t) nu * nv + nv) + sizeof(float) * (m_conditionalCdf.size() + 2 * nv + 1));
 	}
 
 	Point2f sample_continuous(const Point2f &u, float *pdf) const
 	{
-		float pdfs[2];
-		int v;
-		float d1 = pMarginal->sample_continuous(u[1], &pdfs[1], &v);
-		float d0 = pConditionalV[v]->sample_continuous(u[0], &pdfs[0]);
-		*pdf = pdfs[0] * pdfs[1];
+		float pdfs[2], du;
+		int v, iu;
+		float d1 = m_marginal->sample_continuous(u[1], &pdfs[1], &v);
+		if (m_conditionalCdf.empty())
+			iu = (int) AliasTable::sample(&m_conditional[(size_t) v * m_nu], m_nu, u[0], &pdfs[0], &du);
+		else
+		{
+			iu = invertCdf(&m_conditionalCdf[(size_t) v * (m_nu + 1)], m_nu, u[0], &du);
+			pdfs[0] = m_conditional[(size_t) v * m_nu + iu].pdf;
+		}
+		float d0 = cellCoordinate(iu, du, m_nu);
+		*pdf = (pdfs[0] * m_nu) * pdfs[1];
 		return Point2f(d0, d1);
 	}
 
 	float pdf(const Point2f &p) const
 	{
-		int iu = clamp(int(p[0] * pConditionalV[0]->count()), 0, pConditionalV[0]->count() - 1);
-		int iv = clamp(int(p[1] * pMarginal->count()), 0, pMarginal->count() - 1);
-		return pConditionalV[iv]->func[iu] / pMarginal->funcInt;
+		int iu = clamp(int(p[0] * m_nu), 0, m_nu - 1);
+		int iv = clamp(int(p[1] * m_nv), 0, m_nv - 1);
+		return (m_conditional[(size_t) iv * m_nu + iu].pdf * m_nu) * (m_marginal->pdf(iv) * m_nv);
 	}
 
 private:
 	// Distribution2D Private Data
-	std::vector<std::unique_ptr<Distribution1D>> pConditionalV;
-	std::unique_ptr<Distribution1D> pMarginal;
+	int m_nu, m_nv;
+	std::vector<AliasTable::Bin> m_conditional;
+	std::vector<float> m_conditionalCdf;
+	std::unique_ptr<Distribution1D> m_marginal;
+	MemoryRecord m_memory { EMemDistributions };
 };
 
 NORI_NAMESPACE_END
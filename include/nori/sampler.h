@@ -21,6 +21,7 @@
 
 #include <nori/object.h>
 #include <memory>
+#include <iosfwd>
 
 NORI_NAMESPACE_BEGIN
 
@@ -89,15 +90,92 @@ public:
     /// Advance to the next sample
     virtual void advance() = 0;
 
+    /**
+     * \brief Prepare to compute a specific sample of a specific pixel
+     *
+     * The renderer calls this function before computing the sample with
+     * index \c sampleIndex of the pixel \c pixel. Samplers implementing
+     * it derive their random numbers from these two values alone, so a
+     * pixel sample is identical no matter which thread, image block or
+     * process computes it. This makes partial renders of disjoint pixel
+     * regions or sample ranges statistically independent, and merging
+     * them reproduces a single full render. The default implementation
+     * does nothing.
+     */
+    virtual void setSampleIndex(const Point2i &pixel, uint32_t sampleIndex) { }
+
     /// Retrieve the next component value from the current sample
     virtual float next1D() = 0;
 
     /// Retrieve the next two component values from the current sample
     virtual Point2f next2D() = 0;
 
+    /**
+     * \brief Retrieve the next \c count 1D components of the current sample
+     *
+     * Equivalent to \c count calls of \ref next1D(), but costs a single
+     * virtual call. Samplers should override it with a loop that the
+     * compiler can inline.
+     */
+    virtual void next1DArray(float *values, size_t count) {
+        for (size_t i = 0; i < count; ++i)
+            values[i] = next1D();
+    }
+
+    /// Retrieve the next \c count 2D components of the current sample (see \ref next1DArray())
+    virtual void next2DArray(Point2f *values, size_t count) {
+        for (size_t i = 0; i < count; ++i)
+            values[i] = next2D();
+    }
+
     /// Return the number of configured pixel samples
     virtual size_t getSampleCount() const { return m_sampleCount; }
 
+    /**
+     * \brief Change the number of pixel samples
+     *
+     * Used to override the scene's setting (e.g. for render jobs).
+     * This must be called before \ref prepare().
+     */
+    virtual void setSampleCount(size_t sampleCount) { m_sampleCount = sampleCount; }
+
+    /**
+     * \brief Set the seed that all random numbers are derived from
+     *
+     * Renderings with different seeds use independent random
+     * numbers. This must be called before \ref prepare().
+     */
+    virtual void setSeed(uint64_t seed) { m_seed = seed; }
+
+    /// Return the seed that all random numbers are derived from
+    uint64_t getSeed() const { return m_seed; }
+
+    /**
+     * \brief Return the approximate memory footprint of this instance in bytes
+     *
+     * Used for memory accounting (see \ref MemoryAccounting). Samplers
+     * with precomputed tables should include them.
+     */
+    virtual size_t getMemoryUsage() const { return sizeof(Sampler); }
+
+    /**
+     * \brief Write the internal state of the sampler to a stream
+     *
+     * This is used by render checkpoints (see \ref RenderCheckpoint) to
+     * continue an interrupted rendering with exactly the same random
+     * number streams. The default implementation throws an exception.
+     */
+    virtual void serialize(std::ostream &stream) const {
+        throw NoriException("Sampler::serialize(): checkpointing is not "
+            "supported by %s", toString());
+    }
+
+    /// Restore the internal state written by \ref serialize()
+    virtual void unserialize(std::istream &stream) {
+        throw NoriException("Sampler::unserialize(): checkpointing is not "
+            "supported by %s", toString());
+    }
+
     /**
      * \brief Return the type of object (i.e. Mesh/Sampler/etc.) 
      * provided by this instance
@@ -105,6 +183,7 @@ public:
     virtual EClassType getClassType() const { return ESampler; }
 protected:
     size_t m_sampleCount;
+    uint64_t m_seed = 0;
 };
 
 NORI_NAMESPACE_END
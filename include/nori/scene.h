@@ -21,6 +21,7 @@
 
 #include <nori/bvh.h>
 #include <nori/emitter.h>
+#include <nori/lightsampler.h>
 
 
 NORI_NAMESPACE_BEGIN
@@ -49,9 +50,18 @@ public:
     /// Return a pointer to the scene's integrator
     Integrator *getIntegrator() { return m_integrator; }
 
-    /// Return a pointer to the scene's camera
+    /// Return a pointer to the scene's (first) camera
     const Camera *getCamera() const { return m_camera; }
 
+    /**
+     * \brief Return all cameras of the scene
+     *
+     * A scene may declare several cameras, which are then rendered
+     * as separate views. In that case, every camera needs a unique
+     * name (see \ref Camera::getName()).
+     */
+    const std::vector<Camera *> &getCameras() const { return m_cameras; }
+
     /// Return a pointer to the scene's sample generator (const version)
     const Sampler *getSampler() const { return m_sampler; }
 
@@ -64,6 +74,14 @@ public:
     /// Return a reference to an array containing all lights
     const std::vector<Emitter *> &getLights() const { return m_emitters; }
 
+    /**
+     * \brief Return the strategy that chooses the emitter for next event estimation
+     *
+     * Configured with the \c lightSampler property of the scene (see
+     * \ref LightSampler), and available after \ref activate().
+     */
+    const LightSampler *getLightSampler() const { return m_lightSampler.get(); }
+
     /// Return a random emitter
     const Emitter * getRandomEmitter(float rnd) const {
         auto const & n = m_emitters.size();
@@ -111,6 +129,19 @@ public:
         return m_bvh->rayIntersect(ray, its, true);
     }
 
+    /**
+     * \brief Test a batch of shadow rays for occlusion in a single query
+     *
+     * Equivalent to calling the above function for each ray, but traverses
+     * the scene once for the whole batch (see \ref BVH::occluded()).
+     *
+     * \param occluded
+     *    Receives \c true for each ray that has an intersection
+     */
+    void occluded(const Ray3f *rays, size_t count, bool *occluded) const {
+        m_bvh->occluded(rays, count, occluded);
+    }
+
     /**
      * \brief Return an axis-aligned box that bounds the scene
      */
@@ -149,9 +180,12 @@ private:
     Integrator *m_integrator = nullptr;
     Sampler *m_sampler = nullptr;
     Camera *m_camera = nullptr;
+    std::vector<Camera *> m_cameras;
     BVH *m_bvh = nullptr;
 	Emitter* m_bgEmitter = nullptr;
 	Medium* m_scene_medium = nullptr;
+    std::string m_lightSamplerType;
+    std::unique_ptr<LightSampler> m_lightSampler;
 };
 
 NORI_NAMESPACE_END
@@ -0,0 +1,81 @@
+#if !defined(__NORI_SERVER_H)
+#define __NORI_SERVER_H
+
+#include <nori/common.h>
+#include <iosfwd>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Keeps a scene resident in memory and renders a sequence of jobs
+ *
+ * The scene is loaded only once, which includes parsing the XML file,
+ * loading the meshes, building the BVH and running the integrator's
+ * preprocessing step (e.g. photon tracing). All of this is then shared
+ * by the subsequent render jobs.
+ *
+ * A job is a single line of whitespace-separated <tt>key=value</tt> pairs:
+ *
+ * <pre>
+ *   output=view.exr    Output file (required)
+ *   camera=front       Name of the scene camera to start from
+ *   spp=64             Number of samples per pixel
+ *   width=640          Image width in pixels
+ *   height=480         Image height in pixels
+ *   fov=40             Horizontal field of view in degrees
+ *   origin=0,1,5       Camera look-at; all three of origin,
+ *   target=0,0,0       target and up must be specified
+ *   up=0,1,0
+ * </pre>
+ *
+ * Parameters that are not specified keep the values of the scene file.
+ * Empty lines and lines starting with '#' are ignored, and \c quit stops
+ * the server. Every job is answered with a line <tt>ok &lt;output&gt;</tt>
+ * or <tt>error &lt;message&gt;</tt>.
+ */
+class RenderServer {
+public:
+    /// Load and preprocess the given scene
+    RenderServer(const std::string &sceneFile);
+
+    /// Release the scene
+    ~RenderServer();
+
+    /// Render a single job (throws an exception on failure)
+    void render(const std::string &job);
+
+    /**
+     * \brief Read jobs line by line from \c input until the end
+     * of the stream or \c quit, and write replies to \c output
+     *
+     * \return The number of failed jobs
+     */
+    int serve(std::istream &input, std::ostream &output);
+
+    /**
+     * \brief Accept jobs over a local UNIX domain socket
+     *
+     * Clients are served one after the other. Each client sends job
+     * lines and receives one reply line per job. Returns when a client
+     * sends \c quit. Not supported on Windows.
+     *
+     * \return The number of failed jobs
+     */
+    int serveSocket(const std::string &path);
+
+protected:
+    /**
+     * \brief Process one line of input
+     *
+     * \return \c false if the server should stop. Otherwise \c reply
+     * is set to the reply line (empty for ignored lines).
+     */
+    bool process(const std::string &line, std::string &reply, int &failures);
+
+private:
+    Scene *m_scene = nullptr;
+};
+
+NORI_NAMESPACE_END
+
+#endif /* __NORI_SERVER_H */
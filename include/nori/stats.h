@@ -0,0 +1,96 @@
+#if !defined(__NORI_STATS_H)
+#define __NORI_STATS_H
+
+#include <nori/common.h>
+#include <atomic>
+
+NORI_NAMESPACE_BEGIN
+
+/// Render statistics that are counted by \ref Statistics
+enum EStatCounter {
+    EStatCameraRays = 0,    ///< Camera rays (one per pixel sample)
+    EStatIntersectionRays,  ///< Full intersection queries (camera and extension rays)
+    EStatShadowRays,        ///< Shadow (occlusion) queries
+    EStatBVHNodes,          ///< BVH nodes visited
+    EStatTriangleTests,     ///< Ray-triangle intersection tests
+    EStatBSDFSamples,       ///< Calls to BSDF::sample()
+    EStatBSDFEvals,         ///< Calls to BSDF::eval()
+    EStatEmitterSamples,    ///< Calls to Emitter::sample()
+    EStatPhotonLookups,     ///< Photon map range queries
+    EStatPhotonsTouched,    ///< Photons returned by photon map range queries
+    EStatCounterCount
+};
+
+/**
+ * \brief Cheap per-thread render statistics
+ *
+ * Every thread increments its own set of counters, which avoids any
+ * synchronization on the hot paths. \ref collect() sums the counters of
+ * all threads (including ones that have already terminated).
+ *
+ * Counting is compiled out unless \c NORI_ENABLE_STATS is defined (see
+ * the \c NORI_STATS CMake option). Use the \ref NORI_STAT() and
+ * \ref NORI_STAT_ADD() macros to increment a counter.
+ */
+class Statistics {
+public:
+    /// A snapshot of all counters
+    struct Snapshot {
+        uint64_t value[EStatCounterCount] = { };
+
+        uint64_t operator[](EStatCounter counter) const { return value[counter]; }
+
+        /// Return the counts that were added since \c start
+        Snapshot operator-(const Snapshot &start) const;
+    };
+
+    /// Counters of a single thread. Only the owning thread writes to them
+    struct ThreadCounters {
+        std::atomic<uint64_t> value[EStatCounterCount];
+
+        ThreadCounters();
+        ~ThreadCounters();
+
+        void add(EStatCounter counter, uint64_t amount) {
+            /* Single writer: a relaxed load and store suffice (no locked instruction) */
+            value[counter].store(value[counter].load(std::memory_order_relaxed) + amount,
+                                 std::memory_order_relaxed);
+        }
+
+        /// Return the current value of a counter (only meaningful on the owning thread)
+        uint64_t get(EStatCounter counter) const {
+            return value[counter].load(std::memory_order_relaxed);
+        }
+    };
+
+    /// Return the counters of the calling thread
+    static ThreadCounters &local() {
+        static thread_local ThreadCounters counters;
+        return counters;
+    }
+
+    /// Sum the counters of all threads
+    static Snapshot collect();
+
+    /// Return a human-readable summary (Mrays/s, average path length, ...)
+    static std::string summary(const Snapshot &stats, double elapsed);
+
+    /// Return the counters and derived quantities as a JSON object
+    static std::string toJSON(const Snapshot &stats, double elapsed);
+
+    /// Return the name of a counter
+    static const char *counterName(EStatCounter counter);
+};
+
+#if defined(NORI_ENABLE_STATS)
+#define NORI_STAT_ADD(counter, amount) nori::Statistics::local().add(counter, (uint64_t) (amount))
+#else
+#define NORI_STAT_ADD(counter, amount) ((void) (amount))
+#endif
+
+/// Increment a render statistics counter by one
+#define NORI_STAT(counter) NORI_STAT_ADD(counter, 1)
+
+NORI_NAMESPACE_END
+
+#endif /* __NORI_STATS_H */
@@ -0,0 +1,96 @@
+#if !defined(__NORI_TRACE_H)
+#define __NORI_TRACE_H
+
+#include <nori/common.h>
+#include <atomic>
+#include <chrono>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Records timed phases of a render for trace viewers
+ *
+ * Scoped events (see \ref TraceScope and \ref NORI_TRACE_SCOPE()) are
+ * appended to a buffer of the calling thread and can be exported in the
+ * Chrome trace event format, which is understood by chrome://tracing,
+ * Perfetto and Speedscope. Recording is disabled by default, in which
+ * case a trace scope costs a single atomic load.
+ */
+class Trace {
+public:
+    /// A single complete ("X") event
+    struct Event {
+        const char *name;     ///< Event name (a string literal)
+        const char *category; ///< Event category (a string literal)
+        uint64_t start;       ///< Start time in microseconds since \ref enable()
+        uint64_t duration;    ///< Duration in microseconds
+        std::string args;     ///< Optional JSON object with event arguments
+    };
+
+    /// Start recording events and reset the time origin
+    static void enable();
+
+    /// Is event recording enabled?
+    static bool isEnabled() { return s_enabled.load(std::memory_order_relaxed); }
+
+    /// Return the current time in microseconds since \ref enable()
+    static uint64_t now() {
+        return (uint64_t) std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - s_origin).count();
+    }
+
+    /// Append an event to the buffer of the calling thread
+    static void record(Event &&event);
+
+    /// Name the calling thread in the exported trace
+    static void setThreadName(const std::string &name);
+
+    /**
+     * \brief Write all recorded events as a Chrome trace JSON file
+     *
+     * Must not be called while other threads are still recording
+     * (e.g. during a render)
+     */
+    static void save(const std::string &filename);
+
+private:
+    static std::atomic<bool> s_enabled;
+    static std::chrono::steady_clock::time_point s_origin;
+};
+
+/// Records an event that spans the lifetime of this object
+class TraceScope {
+public:
+    TraceScope(const char *name, const char *category = "nori")
+        : m_name(name), m_category(category), m_active(Trace::isEnabled()) {
+        if (m_active)
+            m_start = Trace::now();
+    }
+
+    /// Attach arguments (a JSON object, e.g. <tt>{"pass": 3}</tt>) to the event
+    void setArgs(const std::string &args) { m_args = args; }
+
+    ~TraceScope() {
+        if (m_active)
+            Trace::record(Trace::Event { m_name, m_category, m_start, Trace::now() - m_start,
+                                         std::move(m_args) });
+    }
+
+private:
+    const char *m_name;
+    const char *m_category;
+    bool m_active;
+    uint64_t m_start = 0;
+    std::string m_args;
+};
+
+#define NORI_TRACE_CONCAT2(a, b) a##b
+#define NORI_TRACE_CONCAT(a, b) NORI_TRACE_CONCAT2(a, b)
+
+/// Trace the remainder of the current scope as an event of the given name and category
+#define NORI_TRACE_SCOPE(name, category) \
+    nori::TraceScope NORI_TRACE_CONCAT(__noriTraceScope, __LINE__)(name, category)
+
+NORI_NAMESPACE_END
+
+#endif /* __NORI_TRACE_H */
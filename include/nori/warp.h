@@ -48,6 +48,22 @@ public:
     /// Probability density of \ref squareToUniformSphere()
     static float squareToUniformSpherePdf(const Vector3f &v);
 
+    /**
+     * \brief Map the unit square to the unit sphere, preserving areas
+     *
+     * Clarberg's equal-area octahedral mapping ("Fast Equal-Area Mapping of
+     * the (Hemi)Sphere using SIMD", 2008) in the formulation of PBRT v4: the
+     * square is folded into an octahedron whose faces cover the octants of
+     * the sphere. Every region of the square maps to a region of the sphere
+     * with <tt>4 pi</tt> times its area, and the mapping is continuous
+     * across the edges of the square when they are mirrored about their
+     * midpoints.
+     */
+    static Vector3f squareToEqualAreaSphere(const Point2f &sample);
+
+    /// Inverse of \ref squareToEqualAreaSphere() for unit vectors, without trigonometric functions
+    static Point2f equalAreaSphereToSquare(const Vector3f &v);
+
 	/**
      * \brief Uniformly sample a vector on a spherical cap around (0, 0, 1)
      *
@@ -60,6 +76,20 @@ public:
     /// Probability density of \ref squareToUniformSphereCap()
     static float squareToUniformSphereCapPdf(const Vector3f &v, float cosThetaMax);
 
+    /**
+     * \brief Uniformly sample a direction within a spherical triangle
+     *
+     * The triangle is spanned by the unit vectors \c a, \c b and \c c.
+     * Implements Arvo's "Stratified Sampling of Spherical Triangles"
+     * (SIGGRAPH 1995): the first dimension chooses the sub-triangle with
+     * the desired area, the second a point along its edge from \c b.
+     */
+    static Vector3f squareToSphericalTriangle(const Point2f &sample, const Vector3f &a,
+                                              const Vector3f &b, const Vector3f &c);
+
+    /// Solid angle of the spherical triangle spanned by the unit vectors \c a, \c b and \c c
+    static float sphericalTriangleArea(const Vector3f &a, const Vector3f &b, const Vector3f &c);
+
     /// Uniformly sample a vector on the unit hemisphere around the pole (0,0,1) with respect to solid angles
     static Vector3f squareToUniformHemisphere(const Point2f &sample);
 
@@ -0,0 +1,36 @@
+#include <nori/aov.h>
+
+NORI_NAMESPACE_BEGIN
+
+CostAOVs::CostAOVs(const Vector2i &size) : m_size(size) {
+    size_t pixels = (size_t) size.x() * size.y();
+    m_sum.resize(pixels * EChannelCount, 0.0);
+    m_count.resize(pixels, 0);
+}
+
+std::vector<Bitmap::Channel> CostAOVs::toChannels() const {
+    std::vector<Bitmap::Channel> channels(EChannelCount);
+    size_t pixels = m_count.size();
+
+    for (int i = 0; i < EChannelCount; ++i) {
+        channels[i].name = channelName((EChannel) i);
+        channels[i].data.resize(pixels);
+        for (size_t j = 0; j < pixels; ++j)
+            channels[i].data[j] = m_count[j] > 0 ?
+                (float) (m_sum[j * EChannelCount + i] / m_count[j]) : 0.f;
+    }
+
+    return channels;
+}
+
+const char *CostAOVs::channelName(EChannel channel) {
+    switch (channel) {
+        case ETime:          return "time.Y";
+        case EBVHNodes:      return "bvhNodes.Y";
+        case ETriangleTests: return "triangleTests.Y";
+        case EPathDepth:     return "pathDepth.Y";
+        default:             return "unknown.Y";
+    }
+}
+
+NORI_NAMESPACE_END
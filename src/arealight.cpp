@@ -19,22 +19,46 @@
 #include <nori/emitter.h>
 #include <nori/warp.h>
 #include <nori/mesh.h>
+#include <nori/lightsampler.h>
 
 NORI_NAMESPACE_BEGIN
 
+/**
+ * \brief Emissive triangle mesh or analytic shape
+ *
+ * The \c sampling property chooses how \ref sample() picks points:
+ *
+ * <pre>
+ *   area        Uniformly with respect to the surface area (default)
+ *   solidangle  Uniformly within the solid angle that the shape subtends
+ *               where possible (see \ref Mesh::sampleSolidAngle())
+ * </pre>
+ *
+ * Solid angle sampling removes the distance and cosine terms from the
+ * weight of the samples, which greatly reduces the variance of large
+ * lights seen from close by or at grazing angles.
+ */
 class AreaEmitter : public Emitter {
 public:
     AreaEmitter(const PropertyList &props) {
 		m_type = EmitterType::EMITTER_AREA;
 		m_radiance = props.getColor("radiance");
+
+		std::string sampling = props.getString("sampling", "area");
+		if (sampling == "solidangle")
+			m_solidAngleSampling = true;
+		else if (sampling != "area")
+			throw NoriException("AreaLight: unknown sampling strategy \"%s\" (expected area or solidangle)", sampling);
     }
 
     virtual std::string toString() const {
         return tfm::format(
                 "AreaLight[\n"
                 "  radiance = %s,\n"
+                "  sampling = %s\n"
                 "]",
-                m_radiance.toString());
+                m_radiance.toString(),
+                m_solidAngleSampling ? "solidangle" : "area");
     }
 
 	// We don't assume anything about the visibility of points specified in 'ref' and 'p' in the EmitterQueryRecord.
@@ -54,10 +78,14 @@ public:
         if(!m_mesh)
             throw NoriException("There is no shape attached to this Area light!");
 
+		if (m_solidAngleSampling)
+			return sampleSolidAngle(lRec, sample, optional_u);
+
 		// Sample the underlying mesh for a position and normal.
 		m_mesh->samplePosition(sample, lRec.p, lRec.n, optional_u);
 
 		// Construct the EmitterQueryRecord structure.
+		lRec.primIndex = (uint32_t) -1;
 		lRec.wi = (lRec.p - lRec.ref).normalized();
 		lRec.emitter = this;
 		lRec.dist = (lRec.p - lRec.ref).norm();
@@ -76,6 +104,11 @@ public:
         if(!m_mesh)
             throw NoriException("There is no shape attached to this Area light!");
 
+		if (m_solidAngleSampling) {
+			float pW = m_mesh->pdfSolidAngle(lRec.ref, lRec.p, lRec.n, lRec.primIndex);
+			return std::isfinite(pW) ? pW : 0.0f;
+		}
+
 		Vector3f inv_wi = -lRec.wi;
 		float costheta_here = fabsf(lRec.n.dot(inv_wi));
 		float pW = m_mesh->pdf() * lRec.dist * lRec.dist / costheta_here;
@@ -111,6 +144,22 @@ public:
 		return M_PI * m_mesh->totalSurfaceArea() * m_radiance;
     }
 
+	// Bound the normals of the mesh by a cone, light leaves within 90 degrees of them
+	bool getLightBounds(LightBounds &bounds) const {
+		if (!m_mesh)
+			throw NoriException("There is no shape attached to this Area light!");
+
+		DirectionCone cone = m_mesh->getNormalCone();
+
+		bounds.bbox = m_mesh->getBoundingBox();
+		bounds.axis = cone.axis;
+		bounds.cosThetaO = cone.cosTheta;
+		bounds.cosThetaE = 0.0f;
+		bounds.power = M_PI * m_mesh->totalSurfaceArea() * m_radiance.getLuminance();
+		bounds.twoSided = false;
+		return true;
+	}
+
 	// Get the parent mesh
 	void setParent(NoriObject *parent)
 	{
@@ -121,7 +170,23 @@ public:
 
 
 protected:
+	Color3f sampleSolidAngle(EmitterQueryRecord &lRec, const Point2f &sample, float optional_u) const {
+		if (!m_mesh->sampleSolidAngle(lRec.ref, sample, optional_u, lRec.p, lRec.n, lRec.primIndex))
+			return 0.0f;
+
+		lRec.emitter = this;
+		lRec.wi = lRec.p - lRec.ref;
+		lRec.dist = lRec.wi.norm();
+		lRec.wi /= lRec.dist;
+		lRec.pdf = pdf(lRec);
+
+		if (lRec.pdf == 0.0f || !std::isfinite(lRec.pdf))
+			return 0.0f;
+		return eval(lRec) / lRec.pdf;
+	}
+
     Color3f m_radiance;
+	bool m_solidAngleSampling = false;
 };
 
 NORI_REGISTER_CLASS(AreaEmitter, "area")
@@ -0,0 +1,588 @@
+/* Microbenchmarks of Nori's core kernels.
+ *
+ * Usage: nori-bench [--filter <substring>] [--json <file>] [--time <sec>] [--obj <mesh.obj>]...
+ *
+ * All inputs are generated from fixed seeds, so that the results of
+ * different commits can be compared. Every benchmark is calibrated to
+ * run for a minimum amount of time and repeated several times; the
+ * median time per operation is reported. */
+
+#include <nori/bbox.h>
+#include <nori/bitmap.h>
+#include <nori/block.h>
+#include <nori/bsdf.h>
+#include <nori/bvh.h>
+#include <nori/distributions.h>
+#include <nori/dpdf.h>
+#include <nori/optionsparser.h>
+#include <nori/photon.h>
+#include <nori/rfilter.h>
+#include <nori/sample.h>
+#include <nori/sampler.h>
+#include <nori/warp.h>
+#include <pcg32.h>
+#include <filesystem/path.h>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+
+NORI_NAMESPACE_BEGIN
+
+/* Keeps the compiler from optimizing away the benchmarked computations */
+static volatile float benchSink;
+
+/// Number of precomputed inputs that every benchmark cycles through
+static const uint32_t BENCH_INPUTS = 4096;
+
+/// Triangle mesh that is generated in memory
+class GeneratedMesh : public Mesh {
+public:
+    /// Create a bumpy sphere with 2 * rings * segments triangles
+    static GeneratedMesh *sphere(uint32_t rings, uint32_t segments) {
+        GeneratedMesh *mesh = new GeneratedMesh("sphere");
+        mesh->m_V.resize(3, (rings + 1) * segments);
+        for (uint32_t i = 0; i <= rings; ++i) {
+            float theta = M_PI * i / rings;
+            for (uint32_t j = 0; j < segments; ++j) {
+                float phi = 2 * M_PI * j / segments;
+                float r = 1.f + 0.05f * std::sin(13 * theta) * std::cos(17 * phi);
+                mesh->m_V.col(i * segments + j) = r * Vector3f(std::sin(theta) * std::cos(phi),
+                    std::sin(theta) * std::sin(phi), std::cos(theta));
+            }
+        }
+        mesh->m_F.resize(3, 2 * rings * segments);
+        uint32_t f = 0;
+        for (uint32_t i = 0; i < rings; ++i) {
+            for (uint32_t j = 0; j < segments; ++j) {
+                uint32_t i0 = i * segments + j, i1 = i * segments + (j + 1) % segments;
+                uint32_t i2 = i0 + segments, i3 = i1 + segments;
+                mesh->setFace(f++, i0, i2, i1);
+                mesh->setFace(f++, i1, i2, i3);
+            }
+        }
+        mesh->finish();
+        return mesh;
+    }
+
+    /// Create a soup of randomly placed and oriented triangles (a bad case for BVHs)
+    static GeneratedMesh *soup(uint32_t count, uint64_t seed) {
+        GeneratedMesh *mesh = new GeneratedMesh("soup");
+        pcg32 rng(seed);
+        mesh->m_V.resize(3, 3 * count);
+        mesh->m_F.resize(3, count);
+        for (uint32_t i = 0; i < count; ++i) {
+            Point3f center(2 * rng.nextFloat() - 1, 2 * rng.nextFloat() - 1, 2 * rng.nextFloat() - 1);
+            for (uint32_t k = 0; k < 3; ++k)
+                mesh->m_V.col(3 * i + k) = center + 0.1f * Vector3f(rng.nextFloat() - .5f,
+                    rng.nextFloat() - .5f, rng.nextFloat() - .5f);
+            mesh->setFace(i, 3 * i, 3 * i + 1, 3 * i + 2);
+        }
+        mesh->finish();
+        return mesh;
+    }
+
+private:
+    GeneratedMesh(const std::string &name) { m_name = name; }
+
+    void setFace(uint32_t f, uint32_t i0, uint32_t i1, uint32_t i2) {
+        m_F(0, f) = i0; m_F(1, f) = i1; m_F(2, f) = i2;
+    }
+
+    void finish() {
+        for (uint32_t i = 0; i < m_V.cols(); ++i)
+            m_bbox.expandBy(m_V.col(i));
+        activate();
+    }
+};
+
+/// One benchmark measurement
+struct BenchResult {
+    std::string name;
+    uint64_t iterations;   ///< Operations per repetition
+    double nsPerOp;        ///< Median over all repetitions
+    double minNsPerOp;     ///< Fastest repetition
+};
+
+/// Runs benchmarks and collects their results
+class BenchRunner {
+public:
+    BenchRunner(const std::string &filter, double minTime)
+        : m_filter(filter), m_minTime(minTime) { }
+
+    /**
+     * \brief Time a benchmark
+     *
+     * \param func
+     *     Function that performs the given number of operations and
+     *     returns a value that depends on all of them
+     */
+    template <typename Func> void run(const std::string &name, Func func) {
+        if (!m_filter.empty() && name.find(m_filter) == std::string::npos)
+            return;
+
+        /* Double the number of operations until a repetition takes long enough */
+        uint64_t n = 1;
+        while (time(func, n) < m_minTime / REPETITIONS && n < ((uint64_t) 1 << 32))
+            n *= 2;
+
+        std::vector<double> samples;
+        for (int i = 0; i < REPETITIONS; ++i)
+            samples.push_back(time(func, n) * 1e9 / n);
+        std::sort(samples.begin(), samples.end());
+
+        BenchResult result { name, n, samples[REPETITIONS / 2], samples[0] };
+        cout << tfm::format("%-40s %12.2f ns/op (min %.2f, %i ops)", name,
+                            result.nsPerOp, result.minNsPerOp, n) << endl;
+        m_results.push_back(result);
+    }
+
+    /// Return the results as a JSON document
+    std::string toJSON() const {
+        std::string result = "{\n  \"benchmarks\": [";
+        for (size_t i = 0; i < m_results.size(); ++i) {
+            const BenchResult &r = m_results[i];
+            result += tfm::format("%s\n    {\"name\": \"%s\", \"iterations\": %i, "
+                "\"nsPerOp\": %.4f, \"minNsPerOp\": %.4f}", i > 0 ? "," : "",
+                r.name, r.iterations, r.nsPerOp, r.minNsPerOp);
+        }
+        result += "\n  ]\n}\n";
+        return result;
+    }
+
+private:
+    template <typename Func> static double time(Func &func, uint64_t n) {
+        auto start = std::chrono::steady_clock::now();
+        benchSink = (float) func(n);
+        auto end = std::chrono::steady_clock::now();
+        return std::chrono::duration<double>(end - start).count();
+    }
+
+    static const int REPETITIONS = 5;
+    std::string m_filter;
+    double m_minTime;
+    std::vector<BenchResult> m_results;
+};
+
+/* Fixed-seed input sets */
+static std::vector<Point2f> samples2D(uint64_t seed) {
+    pcg32 rng(seed);
+    std::vector<Point2f> result(BENCH_INPUTS);
+    for (Point2f &p : result)
+        p = Point2f(rng.nextFloat(), rng.nextFloat());
+    return result;
+}
+
+static std::vector<float> samples1D(uint64_t seed) {
+    pcg32 rng(seed);
+    std::vector<float> result(BENCH_INPUTS);
+    for (float &v : result)
+        v = rng.nextFloat();
+    return result;
+}
+
+static std::vector<Vector3f> hemisphereDirections(uint64_t seed) {
+    std::vector<Vector3f> result;
+    for (const Point2f &p : samples2D(seed))
+        result.push_back(Warp::squareToCosineHemisphere(p));
+    return result;
+}
+
+/// Rays that start on a sphere around \c bbox and point at random positions inside of it
+static std::vector<Ray3f> raysTowards(const BoundingBox3f &bbox, uint64_t seed) {
+    pcg32 rng(seed);
+    Point3f center = bbox.getCenter();
+    float radius = 2 * bbox.getExtents().norm();
+    std::vector<Ray3f> result;
+    for (uint32_t i = 0; i < BENCH_INPUTS; ++i) {
+        Point3f o = center + radius * Warp::squareToUniformSphere(Point2f(rng.nextFloat(), rng.nextFloat()));
+        Point3f target = bbox.min + bbox.getExtents().cwiseProduct(
+            Vector3f(rng.nextFloat(), rng.nextFloat(), rng.nextFloat()));
+        result.push_back(Ray3f(o, (target - o).normalized()));
+    }
+    return result;
+}
+
+static void benchBoundingBox(BenchRunner &runner) {
+    BoundingBox3f bbox(Point3f(-1, -1, -1), Point3f(1, 1, 1));
+    std::vector<Ray3f> rays = raysTowards(BoundingBox3f(Point3f(-2, -2, -2), Point3f(2, 2, 2)), 1);
+    runner.run("bbox.rayIntersect", [&](uint64_t n) {
+        float sum = 0;
+        for (uint64_t i = 0; i < n; ++i) {
+            float nearT, farT;
+            if (bbox.rayIntersect(rays[i % BENCH_INPUTS], nearT, farT))
+                sum += nearT;
+        }
+        return sum;
+    });
+}
+
+typedef std::vector<std::pair<std::string, Mesh *>> MeshList;
+
+static void benchMeshes(BenchRunner &runner, const MeshList &meshes) {
+    for (const auto &entry : meshes) {
+        const Mesh *mesh = entry.second;
+        /* Single ray-triangle tests */
+        std::vector<Ray3f> rays = raysTowards(mesh->getBoundingBox(), 2);
+        uint32_t triangles = mesh->getTriangleCount();
+        runner.run("mesh.rayIntersect." + entry.first, [&](uint64_t n) {
+            float sum = 0;
+            for (uint64_t i = 0; i < n; ++i) {
+                float u, v, t;
+                if (mesh->rayIntersect((uint32_t) (i % triangles), rays[i % BENCH_INPUTS], u, v, t))
+                    sum += t;
+            }
+            return sum;
+        });
+    }
+
+    for (const auto &entry : meshes) {
+        /* Full traversals. The BVH takes ownership of the mesh */
+        BVH bvh;
+        bvh.addMesh(entry.second);
+        bvh.build();
+        std::vector<Ray3f> rays = raysTowards(bvh.getBoundingBox(), 3);
+
+        runner.run("bvh.rayIntersect." + entry.first, [&](uint64_t n) {
+            float sum = 0;
+            Intersection its;
+            for (uint64_t i = 0; i < n; ++i)
+                if (bvh.rayIntersect(rays[i % BENCH_INPUTS], its))
+                    sum += its.t;
+            return sum;
+        });
+        runner.run("bvh.shadowRay." + entry.first, [&](uint64_t n) {
+            float sum = 0;
+            Intersection its;
+            for (uint64_t i = 0; i < n; ++i)
+                sum += bvh.rayIntersect(rays[i % BENCH_INPUTS], its, true) ? 1.f : 0.f;
+            return sum;
+        });
+    }
+}
+
+static void benchWarps(BenchRunner &runner) {
+    std::vector<Point2f> s = samples2D(4);
+
+#define BENCH_WARP(name, expr) \
+    runner.run("warp." name, [&](uint64_t n) { \
+        float sum = 0; \
+        for (uint64_t i = 0; i < n; ++i) { \
+            const Point2f &sample = s[i % BENCH_INPUTS]; \
+            sum += (expr).x(); \
+        } \
+        return sum; \
+    })
+
+    BENCH_WARP("squareToUniformSquare", Warp::squareToUniformSquare(sample));
+    BENCH_WARP("squareToUniformDisk", Warp::squareToUniformDisk(sample));
+    BENCH_WARP("squareToUniformSphere", Warp::squareToUniformSphere(sample));
+    BENCH_WARP("squareToUniformSphereCap", Warp::squareToUniformSphereCap(sample, 0.5f));
+    BENCH_WARP("squareToUniformHemisphere", Warp::squareToUniformHemisphere(sample));
+    BENCH_WARP("squareToCosineHemisphere", Warp::squareToCosineHemisphere(sample));
+    BENCH_WARP("squareToBeckmann", Warp::squareToBeckmann(sample, 0.3f));
+    BENCH_WARP("squareToGgx", Warp::squareToGgx(sample, 0.3f));
+    BENCH_WARP("squareToPhong", Warp::squareToPhong(sample, 0.3f));
+    BENCH_WARP("squareToEqualAreaSphere", Warp::squareToEqualAreaSphere(sample));
+#undef BENCH_WARP
+
+    std::vector<Vector3f> d;
+    for (const Point2f &p : s)
+        d.push_back(Warp::squareToUniformSphere(p));
+    runner.run("warp.equalAreaSphereToSquare", [&](uint64_t n) {
+        float sum = 0;
+        for (uint64_t i = 0; i < n; ++i)
+            sum += Warp::equalAreaSphereToSquare(d[i % BENCH_INPUTS]).x();
+        return sum;
+    });
+}
+
+static void benchBSDFs(BenchRunner &runner) {
+    std::vector<Point2f> s = samples2D(5);
+    std::vector<float> u = samples1D(6);
+    std::vector<Vector3f> wi = hemisphereDirections(7), wo = hemisphereDirections(8);
+
+    /* Every registered BSDF that can be created with its default parameters */
+    for (const std::string &name : NoriObjectFactory::getRegisteredClasses()) {
+        std::unique_ptr<NoriObject> obj;
+        try {
+            obj.reset(NoriObjectFactory::createInstance(name, PropertyList()));
+        } catch (const std::exception &) {
+            continue;
+        }
+        if (obj->getClassType() != NoriObject::EBSDF)
+            continue;
+        obj->activate();
+        const BSDF *bsdf = static_cast<const BSDF *>(obj.get());
+
+        runner.run("bsdf." + name + ".sample", [&](uint64_t n) {
+            float sum = 0;
+            for (uint64_t i = 0; i < n; ++i) {
+                BSDFQueryRecord bRec(wi[i % BENCH_INPUTS]);
+                sum += bsdf->sample(bRec, s[i % BENCH_INPUTS], u[i % BENCH_INPUTS]).r();
+            }
+            return sum;
+        });
+        runner.run("bsdf." + name + ".eval", [&](uint64_t n) {
+            float sum = 0;
+            for (uint64_t i = 0; i < n; ++i) {
+                BSDFQueryRecord bRec(wi[i % BENCH_INPUTS], wo[i % BENCH_INPUTS], ESolidAngle);
+                sum += bsdf->eval(bRec).r();
+            }
+            return sum;
+        });
+    }
+}
+
+static void benchSamplers(BenchRunner &runner) {
+    /* One operation is a pixel sample with 16 2D and 8 1D components
+       (roughly a path of length 5), drawn through one virtual call per
+       component and through the bulk next1DArray()/next2DArray() calls */
+    const uint32_t dimensions2D = 16, dimensions1D = 8;
+    for (const std::string &name : NoriObjectFactory::getRegisteredClasses()) {
+        std::unique_ptr<NoriObject> obj;
+        try {
+            PropertyList props;
+            props.setInteger("sampleCount", 64);
+            obj.reset(NoriObjectFactory::createInstance(name, props));
+        } catch (const std::exception &) {
+            continue;
+        }
+        if (obj->getClassType() != NoriObject::ESampler)
+            continue;
+        Sampler *sampler = static_cast<Sampler *>(obj.get());
+
+        runner.run("sampler." + name + ".next", [&](uint64_t n) {
+            float sum = 0;
+            for (uint64_t i = 0; i < n; ++i) {
+                sampler->setSampleIndex(Point2i((int) (i / 64) % 512, (int) (i / 32768)), (uint32_t) (i % 64));
+                for (uint32_t k = 0; k < dimensions2D; ++k)
+                    sum += sampler->next2D().x();
+                for (uint32_t k = 0; k < dimensions1D; ++k)
+                    sum += sampler->next1D();
+            }
+            return sum;
+        });
+        runner.run("sampler." + name + ".array", [&](uint64_t n) {
+            Point2f values2D[dimensions2D];
+            float values1D[dimensions1D];
+            float sum = 0;
+            for (uint64_t i = 0; i < n; ++i) {
+                sampler->setSampleIndex(Point2i((int) (i / 64) % 512, (int) (i / 32768)), (uint32_t) (i % 64));
+                sampler->next2DArray(values2D, dimensions2D);
+                sampler->next1DArray(values1D, dimensions1D);
+                for (uint32_t k = 0; k < dimensions2D; ++k)
+                    sum += values2D[k].x();
+                for (uint32_t k = 0; k < dimensions1D; ++k)
+                    sum += values1D[k];
+            }
+            return sum;
+        });
+    }
+}
+
+static void benchDistributions(BenchRunner &runner) {
+    std::vector<Vector3f> wi = hemisphereDirections(9), wo = hemisphereDirections(10);
+    std::vector<Vector3f> m;
+    for (uint32_t i = 0; i < BENCH_INPUTS; ++i)
+        m.push_back((wi[i] + wo[i]).normalized());
+
+    for (const char *type : { "beckmann", "ggx", "phong" }) {
+        Distribution distr(type, 0.3f);
+        runner.run(tfm::format("distribution.%s.D", type), [&](uint64_t n) {
+            float sum = 0;
+            for (uint64_t i = 0; i < n; ++i)
+                sum += distr.D(m[i % BENCH_INPUTS]);
+            return sum;
+        });
+        runner.run(tfm::format("distribution.%s.G", type), [&](uint64_t n) {
+            float sum = 0;
+            for (uint64_t i = 0; i < n; ++i) {
+                uint32_t k = i % BENCH_INPUTS;
+                sum += distr.G(wi[k], wo[k], m[k]);
+            }
+            return sum;
+        });
+    }
+}
+
+static void benchTables(BenchRunner &runner) {
+    std::vector<float> u = samples1D(11);
+    std::vector<Point2f> s = samples2D(12);
+    pcg32 rng(13);
+
+    DiscretePDF dpdf;
+    for (int i = 0; i < 4096; ++i)
+        dpdf.append(rng.nextFloat());
+    dpdf.normalize();
+    runner.run("dpdf.sample", [&](uint64_t n) {
+        float sum = 0;
+        for (uint64_t i = 0; i < n; ++i)
+            sum += (float) dpdf.sample(u[i % BENCH_INPUTS]);
+        return sum;
+    });
+
+    /* Roughly the size of a small environment map */
+    int nu = 512, nv = 256;
+    std::vector<float> image(nu * nv);
+    for (float &v : image)
+        v = rng.nextFloat() * rng.nextFloat();
+    Distribution2D distr2D(image.data(), nu, nv);
+    runner.run("distribution2d.sample", [&](uint64_t n) {
+        float sum = 0;
+        for (uint64_t i = 0; i < n; ++i) {
+            float pdf;
+            sum += distr2D.sample_continuous(s[i % BENCH_INPUTS], &pdf).x();
+        }
+        return sum;
+    });
+}
+
+static void benchKDTree(BenchRunner &runner) {
+    pcg32 rng(14);
+    PointKDTree<Photon> photons;
+    photons.reserve(100000);
+    for (int i = 0; i < 100000; ++i) {
+        Point3f p(rng.nextFloat(), rng.nextFloat(), rng.nextFloat());
+        photons.push_back(Photon(p, Vector3f(0, 0, 1), Color3f(1.f)));
+    }
+    photons.build();
+
+    std::vector<Point3f> queries;
+    for (uint32_t i = 0; i < BENCH_INPUTS; ++i)
+        queries.push_back(Point3f(rng.nextFloat(), rng.nextFloat(), rng.nextFloat()));
+
+    runner.run("kdtree.search", [&](uint64_t n) {
+        std::vector<uint32_t> results;
+        float sum = 0;
+        for (uint64_t i = 0; i < n; ++i) {
+            results.clear();
+            photons.search(queries[i % BENCH_INPUTS], 0.02f, results);
+            sum += (float) results.size();
+        }
+        return sum;
+    });
+}
+
+static void benchImages(BenchRunner &runner) {
+    std::unique_ptr<ReconstructionFilter> filter(static_cast<ReconstructionFilter *>(
+        NoriObjectFactory::createInstance("gaussian", PropertyList())));
+    std::vector<Point2f> s = samples2D(15);
+
+    ImageBlock block(Vector2i(NORI_BLOCK_SIZE), filter.get());
+    block.clear();
+    runner.run("imageblock.put", [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; ++i)
+            block.put(s[i % BENCH_INPUTS] * (float) NORI_BLOCK_SIZE, Color3f(1.f));
+        return block.coeff(1, 1).w();
+    });
+
+    Bitmap bitmap(Vector2i(256, 256));
+    pcg32 rng(16);
+    for (int y = 0; y < bitmap.rows(); ++y)
+        for (int x = 0; x < bitmap.cols(); ++x)
+            bitmap.coeffRef(y, x) = Color3f(rng.nextFloat(), rng.nextFloat(), rng.nextFloat());
+
+    std::string filename = "nori-bench-tmp.exr";
+    std::streambuf *coutBuffer = cout.rdbuf(nullptr); /* Silence the I/O messages */
+    runner.run("bitmap.save", [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; ++i)
+            bitmap.save(filename);
+        return 0.f;
+    });
+    runner.run("bitmap.load", [&](uint64_t n) {
+        float sum = 0;
+        for (uint64_t i = 0; i < n; ++i)
+            sum += Bitmap(filename).coeff(0, 0).r();
+        return sum;
+    });
+    cout.rdbuf(coutBuffer);
+    cout.clear();
+    std::remove(filename.c_str());
+}
+
+NORI_NAMESPACE_END
+
+using namespace nori;
+
+enum OptionIndex { UNKNOWN, HELP, FILTER, JSON, TIME, OBJ };
+
+struct Arg : public option::Arg {
+    static option::ArgStatus Required(const option::Option &option, bool msg) {
+        if (option.arg != 0)
+            return option::ARG_OK;
+        if (msg)
+            cerr << "Error: option '" << std::string(option.name, option.namelen) << "' requires an argument" << endl;
+        return option::ARG_ILLEGAL;
+    }
+};
+
+const option::Descriptor usage[] = {
+    { UNKNOWN, 0, "",  "",       Arg::None,     "Usage: nori-bench [options]\n\nOptions:" },
+    { HELP,    0, "h", "help",   Arg::None,     "  -h, --help  \tPrint usage and exit." },
+    { FILTER,  0, "f", "filter", Arg::Required, "  -f, --filter <str>  \tOnly run benchmarks whose name contains <str>." },
+    { JSON,    0, "j", "json",   Arg::Required, "  -j, --json <file>  \tWrite the results as JSON ('-' for stdout)." },
+    { TIME,    0, "t", "time",   Arg::Required, "  -t, --time <sec>  \tMinimum run time per benchmark (default: 0.5)." },
+    { OBJ,     0, "",  "obj",    Arg::Required, "  --obj <file>  \tAlso benchmark the given OBJ mesh (may be repeated)." },
+    { 0, 0, 0, 0, 0, 0 }
+};
+
+int main(int argc, char **argv) {
+    argc -= (argc > 0);
+    argv += (argc > 0);
+
+    option::Stats stats(usage, argc, argv);
+    std::vector<option::Option> options(stats.options_max), buffer(stats.buffer_max);
+    option::Parser parse(usage, argc, argv, options.data(), buffer.data());
+    if (parse.error() || options[UNKNOWN] || parse.nonOptionsCount() > 0) {
+        option::printUsage(std::cerr, usage);
+        return 2;
+    }
+    if (options[HELP]) {
+        option::printUsage(std::cout, usage);
+        return 0;
+    }
+
+    try {
+        std::string filter = options[FILTER] ? options[FILTER].last()->arg : "";
+        double minTime = options[TIME] ? toFloat(options[TIME].last()->arg) : 0.5;
+        BenchRunner runner(filter, minTime);
+
+        /* Generated meshes, plus any meshes given on the command line */
+        MeshList meshes;
+        meshes.emplace_back("sphere", GeneratedMesh::sphere(256, 512));
+        meshes.emplace_back("soup", GeneratedMesh::soup(50000, 17));
+        for (option::Option *opt = options[OBJ]; opt; opt = opt->next()) {
+            PropertyList props;
+            props.setString("filename", opt->arg);
+            Mesh *mesh = static_cast<Mesh *>(NoriObjectFactory::createInstance("obj", props));
+            mesh->activate();
+            meshes.emplace_back(filesystem::path(opt->arg).filename(), mesh);
+        }
+
+        benchBoundingBox(runner);
+        benchMeshes(runner, meshes);
+        benchWarps(runner);
+        benchBSDFs(runner);
+        benchSamplers(runner);
+        benchDistributions(runner);
+        benchTables(runner);
+        benchKDTree(runner);
+        benchImages(runner);
+
+        if (options[JSON]) {
+            std::string filename = options[JSON].last()->arg;
+            if (filename == "-") {
+                cout << runner.toJSON();
+            } else {
+                std::ofstream os(filename);
+                os << runner.toJSON();
+                if (!os)
+                    throw NoriException("Unable to write \"%s\"", filename);
+            }
+        }
+    } catch (const std::exception &e) {
+        cerr << "Error: " << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -17,6 +17,7 @@
 */
 
 #include <nori/bitmap.h>
+#include <nori/trace.h>
 #include <ImfInputFile.h>
 #include <ImfOutputFile.h>
 #include <ImfChannelList.h>
@@ -79,7 +80,8 @@ Bitmap::Bitmap(const std::string &filename) {
     file.readPixels(dw.min.y, dw.max.y);
 }
 
-void Bitmap::save(const std::string &filename) {
+void Bitmap::save(const std::string &filename, const std::vector<Channel> &extra) {
+    NORI_TRACE_SCOPE("Bitmap::save", "output");
     cout << "Writing a " << cols() << "x" << rows() 
          << " OpenEXR file to \"" << filename << "\"" << endl;
 
@@ -90,6 +92,11 @@ void Bitmap::save(const std::string &filename) {
     channels.insert("R", Imf::Channel(Imf::FLOAT));
     channels.insert("G", Imf::Channel(Imf::FLOAT));
     channels.insert("B", Imf::Channel(Imf::FLOAT));
+    for (const Channel &channel : extra) {
+        if (channel.data.size() != (size_t) (cols() * rows()))
+            throw NoriException("Channel \"%s\" does not match the bitmap size!", channel.name);
+        channels.insert(channel.name, Imf::Channel(Imf::FLOAT));
+    }
 
     Imf::FrameBuffer frameBuffer;
     size_t compStride = sizeof(float),
@@ -100,6 +107,10 @@ void Bitmap::save(const std::string &filename) {
     frameBuffer.insert("R", Imf::Slice(Imf::FLOAT, ptr, pixelStride, rowStride)); ptr += compStride;
     frameBuffer.insert("G", Imf::Slice(Imf::FLOAT, ptr, pixelStride, rowStride)); ptr += compStride;
     frameBuffer.insert("B", Imf::Slice(Imf::FLOAT, ptr, pixelStride, rowStride)); 
+    for (const Channel &channel : extra) {
+        char *base = reinterpret_cast<char *>(const_cast<float *>(channel.data.data()));
+        frameBuffer.insert(channel.name, Imf::Slice(Imf::FLOAT, base, compStride, compStride * cols()));
+    }
 
     Imf::OutputFile file(filename.c_str(), header);
     file.setFrameBuffer(frameBuffer);
@@ -145,6 +156,7 @@ Texture::Texture(const std::string& filename) : Bitmap(filename)
 	m_width = static_cast<int>(Base::cols());
 	m_height = static_cast<int>(Base::rows());
 	m_filename = filename;
+	m_memory.set(sizeof(Color3f) * m_width * m_height);
 }
 
 Color3f Texture::getval(float x, float y) const
@@ -20,7 +20,14 @@
 #include <nori/bitmap.h>
 #include <nori/rfilter.h>
 #include <nori/bbox.h>
+#include <nori/trace.h>
 #include <tbb/tbb.h>
+#include <ImfInputFile.h>
+#include <ImfOutputFile.h>
+#include <ImfChannelList.h>
+#include <ImfStringAttribute.h>
+#include <ImfIntAttribute.h>
+#include <memory>
 
 NORI_NAMESPACE_BEGIN
 
@@ -70,6 +77,7 @@ void ImageBlock::init(const Vector2i &size, const ReconstructionFilter *filter)
     }
 
     /* Allocate space for pixels and border regions */
+    m_memory.set(sizeof(Color4f) * (size.x() + 2*m_borderSize) * (size.y() + 2*m_borderSize));
     resize(size.y() + 2*m_borderSize, size.x() + 2*m_borderSize);
 }
 
@@ -90,6 +98,86 @@ void ImageBlock::fromBitmap(const Bitmap &bitmap) {
             coeffRef(y, x) << bitmap.coeff(y, x), 1;
 }
 
+void ImageBlock::saveRaw(const std::string &filename) const {
+    NORI_TRACE_SCOPE("ImageBlock::saveRaw", "output");
+    cout << "Writing a raw " << m_size.x() << "x" << m_size.y()
+         << " OpenEXR file to \"" << filename << "\"" << endl;
+
+    Imf::Header header((int) cols(), (int) rows());
+    header.insert("comments", Imf::StringAttribute("Generated by Nori"));
+    header.insert("noriBorderSize", Imf::IntAttribute(m_borderSize));
+
+    Imf::ChannelList &channels = header.channels();
+    channels.insert("R", Imf::Channel(Imf::FLOAT));
+    channels.insert("G", Imf::Channel(Imf::FLOAT));
+    channels.insert("B", Imf::Channel(Imf::FLOAT));
+    channels.insert("W", Imf::Channel(Imf::FLOAT));
+
+    Imf::FrameBuffer frameBuffer;
+    size_t compStride = sizeof(float),
+           pixelStride = 4 * compStride,
+           rowStride = pixelStride * cols();
+
+    char *ptr = reinterpret_cast<char *>(const_cast<Color4f *>(data()));
+    frameBuffer.insert("R", Imf::Slice(Imf::FLOAT, ptr, pixelStride, rowStride)); ptr += compStride;
+    frameBuffer.insert("G", Imf::Slice(Imf::FLOAT, ptr, pixelStride, rowStride)); ptr += compStride;
+    frameBuffer.insert("B", Imf::Slice(Imf::FLOAT, ptr, pixelStride, rowStride)); ptr += compStride;
+    frameBuffer.insert("W", Imf::Slice(Imf::FLOAT, ptr, pixelStride, rowStride));
+
+    Imf::OutputFile file(filename.c_str(), header);
+    file.setFrameBuffer(frameBuffer);
+    file.writePixels((int) rows());
+}
+
+void ImageBlock::addRaw(const std::string &filename) {
+    Imf::InputFile file(filename.c_str());
+    const Imf::Header &header = file.header();
+
+    const Imf::IntAttribute *borderAttr =
+        header.findTypedAttribute<Imf::IntAttribute>("noriBorderSize");
+    const Imf::ChannelList &channels = header.channels();
+    if (!borderAttr || !channels.findChannel("R") || !channels.findChannel("G") ||
+        !channels.findChannel("B") || !channels.findChannel("W"))
+        throw NoriException("\"%s\" is not a raw Nori OpenEXR file!", filename);
+
+    Imath::Box2i dw = header.dataWindow();
+    int borderSize = borderAttr->value();
+    Vector2i fullSize(dw.max.x - dw.min.x + 1, dw.max.y - dw.min.y + 1);
+    Vector2i size = fullSize - Vector2i::Constant(2 * borderSize);
+
+    if (this->size() == 0) {
+        m_size = size;
+        m_borderSize = borderSize;
+        m_memory.set(sizeof(Color4f) * fullSize.x() * fullSize.y());
+        resize(fullSize.y(), fullSize.x());
+        clear();
+    } else if (size != m_size || borderSize != m_borderSize) {
+        throw NoriException("\"%s\" has size %s and border %i, expected %s and border %i!",
+            filename, size.toString(), borderSize, m_size.toString(), m_borderSize);
+    }
+
+    std::unique_ptr<Color4f[]> pixels(new Color4f[fullSize.x() * fullSize.y()]);
+    size_t compStride = sizeof(float),
+           pixelStride = 4 * compStride,
+           rowStride = pixelStride * fullSize.x();
+
+    /* The frame buffer is addressed using absolute data window coordinates */
+    char *ptr = reinterpret_cast<char *>(pixels.get())
+        - dw.min.x * pixelStride - dw.min.y * rowStride;
+
+    Imf::FrameBuffer frameBuffer;
+    frameBuffer.insert("R", Imf::Slice(Imf::FLOAT, ptr, pixelStride, rowStride)); ptr += compStride;
+    frameBuffer.insert("G", Imf::Slice(Imf::FLOAT, ptr, pixelStride, rowStride)); ptr += compStride;
+    frameBuffer.insert("B", Imf::Slice(Imf::FLOAT, ptr, pixelStride, rowStride)); ptr += compStride;
+    frameBuffer.insert("W", Imf::Slice(Imf::FLOAT, ptr, pixelStride, rowStride));
+    file.setFrameBuffer(frameBuffer);
+    file.readPixels(dw.min.y, dw.max.y);
+
+    for (int y=0; y<fullSize.y(); ++y)
+        for (int x=0; x<fullSize.x(); ++x)
+            coeffRef(y, x) += pixels[y * fullSize.x() + x];
+}
+
 void ImageBlock::put(const Point2f &_pos, const Color3f &value) {
     if (!value.isValid()) {
         /* If this happens, go fix your code instead of removing this warning ;) */
@@ -0,0 +1,238 @@
+#include <nori/sampler.h>
+#include <nori/block.h>
+#include <nori/qmc.h>
+#include <nori/memory.h>
+#include <pcg32.h>
+#include <iostream>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Sampler that distributes the pixel errors as blue noise
+ *
+ * At low sample counts, the error of neighboring pixels is uncorrelated
+ * with the other samplers (white noise). This sampler correlates it so
+ * that it becomes blue noise, which looks less objectionable and is
+ * easier to remove for a denoiser, in the spirit of Heitz and Belcour's
+ * screen-space blue-noise samplers.
+ *
+ * All pixels use the same Owen-scrambled Sobol sequence for a given
+ * dimension (see \ref QMC), which is toroidally shifted by a per-pixel
+ * offset read from a blue-noise mask (Georgiev and Fajardo's "Blue-noise
+ * Dithered Sampling"). Neighboring pixels therefore receive very different
+ * shifts, while every pixel still uses a low-discrepancy point set.
+ * Each dimension reads the mask at a different offset and shuffles the
+ * sample index differently, which pads the dimensions against each
+ * other. The mask is generated once with Ulichney's void-and-cluster
+ * method instead of shipping optimized tables.
+ */
+class BlueNoise : public Sampler {
+public:
+    BlueNoise(const PropertyList &propList) {
+        m_sampleCount = (size_t) propList.getInteger("sampleCount", 1);
+        m_seed = (uint64_t) propList.getInteger("seed", 0);
+    }
+
+    virtual ~BlueNoise() { }
+
+    std::unique_ptr<Sampler> clone() const {
+        std::unique_ptr<BlueNoise> cloned(new BlueNoise());
+        cloned->m_sampleCount = m_sampleCount;
+        cloned->m_seed = m_seed;
+        cloned->m_pixel = m_pixel;
+        cloned->m_sampleIndex = m_sampleIndex;
+        cloned->m_dimension = m_dimension;
+        return std::move(cloned);
+    }
+
+    void prepare(const ImageBlock &block) {
+        setSampleIndex(block.getOffset(), 0);
+    }
+
+    void setSampleIndex(const Point2i &pixel, uint32_t sampleIndex) {
+        m_pixel = pixel;
+        m_sampleIndex = sampleIndex;
+        m_dimension = 0;
+    }
+
+    void generate() {
+        m_sampleIndex = 0;
+        m_dimension = 0;
+    }
+
+    void advance() {
+        m_sampleIndex++;
+        m_dimension = 0;
+    }
+
+    float next1D() {
+        uint32_t dim = m_dimension++;
+        float value = QMC::scrambledSobol1D(m_sampleIndex, dimensionSeed(dim));
+        return wrap(value + maskValue(2 * dim));
+    }
+
+    Point2f next2D() {
+        uint32_t dim = m_dimension++;
+        Point2f value = QMC::scrambledSobol2D(m_sampleIndex, dimensionSeed(dim));
+        return Point2f(
+            wrap(value.x() + maskValue(2 * dim)),
+            wrap(value.y() + maskValue(2 * dim + 1))
+        );
+    }
+
+    void serialize(std::ostream &stream) const {
+        int32_t pixel[2] = { m_pixel.x(), m_pixel.y() };
+        stream.write(reinterpret_cast<const char *>(&m_seed), sizeof(uint64_t));
+        stream.write(reinterpret_cast<const char *>(pixel), sizeof(pixel));
+        stream.write(reinterpret_cast<const char *>(&m_sampleIndex), sizeof(uint32_t));
+        stream.write(reinterpret_cast<const char *>(&m_dimension), sizeof(uint32_t));
+    }
+
+    void unserialize(std::istream &stream) {
+        int32_t pixel[2];
+        stream.read(reinterpret_cast<char *>(&m_seed), sizeof(uint64_t));
+        stream.read(reinterpret_cast<char *>(pixel), sizeof(pixel));
+        stream.read(reinterpret_cast<char *>(&m_sampleIndex), sizeof(uint32_t));
+        stream.read(reinterpret_cast<char *>(&m_dimension), sizeof(uint32_t));
+        if (!stream)
+            throw NoriException("BlueNoise::unserialize(): truncated sampler state!");
+        m_pixel = Point2i(pixel[0], pixel[1]);
+    }
+
+    size_t getMemoryUsage() const { return sizeof(BlueNoise); }
+
+    virtual std::string toString() const {
+        return tfm::format("BlueNoise[sampleCount=%i, seed=%i]", m_sampleCount, m_seed);
+    }
+protected:
+    BlueNoise() { }
+
+    /// Resolution of the (tileable) blue-noise mask
+    static const int MaskSize = 64;
+
+    /// Seed of the sequence of a dimension. It must not depend on the pixel
+    uint32_t dimensionSeed(uint32_t dim) const {
+        return QMC::hashCombine((uint32_t) QMC::mix64(m_seed), dim);
+    }
+
+    /// Read the mask for the k-th component, offset along the R2 sequence
+    float maskValue(uint32_t k) const {
+        double fx = 0.5 + (k + (uint32_t) m_seed) * 0.7548776662466927;
+        double fy = 0.5 + (k + (uint32_t) m_seed) * 0.5698402909980532;
+        int ox = (int) ((fx - std::floor(fx)) * MaskSize), oy = (int) ((fy - std::floor(fy)) * MaskSize);
+        int x = (m_pixel.x() + ox) & (MaskSize - 1), y = (m_pixel.y() + oy) & (MaskSize - 1);
+        return mask()[y * MaskSize + x];
+    }
+
+    static float wrap(float value) {
+        value = value >= 1.f ? value - 1.f : value;
+        return std::min(value, 0.99999994f);
+    }
+
+    /**
+     * \brief Blue-noise mask with values in <tt>(0, 1)</tt>
+     *
+     * Generated with void-and-cluster on a torus (Gaussian filter with
+     * sigma = 1.5): every pixel is ranked by the order in which it is
+     * inserted into an increasingly dense, evenly spread point set.
+     */
+    static const std::vector<float> &mask() {
+        static const std::vector<float> mask = generateMask();
+        return mask;
+    }
+
+    static std::vector<float> generateMask() {
+        const int N = MaskSize * MaskSize;
+        const float sigma = 1.5f;
+
+        /* Toroidal Gaussian energy of a point at the origin */
+        std::vector<float> kernel(N);
+        for (int y = 0; y < MaskSize; ++y) {
+            for (int x = 0; x < MaskSize; ++x) {
+                int dx = std::min(x, MaskSize - x), dy = std::min(y, MaskSize - y);
+                kernel[y * MaskSize + x] = std::exp(-(dx * dx + dy * dy) / (2 * sigma * sigma));
+            }
+        }
+
+        auto splat = [&](std::vector<float> &energy, int p, float sign) {
+            int px = p % MaskSize, py = p / MaskSize;
+            for (int y = 0; y < MaskSize; ++y) {
+                int ky = ((y - py) & (MaskSize - 1)) * MaskSize;
+                for (int x = 0; x < MaskSize; ++x)
+                    energy[y * MaskSize + x] += sign * kernel[ky + ((x - px) & (MaskSize - 1))];
+            }
+        };
+
+        /* Tightest cluster (value = 1) or largest void (value = 0) */
+        auto extremum = [&](const std::vector<uint8_t> &pattern, const std::vector<float> &energy,
+                            uint8_t value) {
+            int best = -1;
+            for (int i = 0; i < N; ++i) {
+                if (pattern[i] != value)
+                    continue;
+                if (best < 0 || (value ? energy[i] > energy[best] : energy[i] < energy[best]))
+                    best = i;
+            }
+            return best;
+        };
+
+        /* Initial pattern: random points, relaxed until they are evenly spread */
+        std::vector<uint8_t> pattern(N, 0);
+        std::vector<float> energy(N, 0.f);
+        pcg32 random;
+        int ones = 0;
+        while (ones < N / 10) {
+            int p = (int) random.nextUInt(N);
+            if (!pattern[p]) {
+                pattern[p] = 1;
+                splat(energy, p, 1.f);
+                ++ones;
+            }
+        }
+        for (int it = 0; it < N; ++it) {
+            int cluster = extremum(pattern, energy, 1);
+            pattern[cluster] = 0;
+            splat(energy, cluster, -1.f);
+            int largestVoid = extremum(pattern, energy, 0);
+            pattern[largestVoid] = 1;
+            splat(energy, largestVoid, 1.f);
+            if (largestVoid == cluster)
+                break;
+        }
+
+        /* Rank the initial points by removing tightest clusters first */
+        std::vector<int> rank(N);
+        std::vector<uint8_t> pattern1 = pattern;
+        std::vector<float> energy1 = energy;
+        for (int r = ones - 1; r >= 0; --r) {
+            int cluster = extremum(pattern1, energy1, 1);
+            pattern1[cluster] = 0;
+            splat(energy1, cluster, -1.f);
+            rank[cluster] = r;
+        }
+
+        /* Rank the remaining pixels by filling the largest voids */
+        for (int r = ones; r < N; ++r) {
+            int largestVoid = extremum(pattern, energy, 0);
+            pattern[largestVoid] = 1;
+            splat(energy, largestVoid, 1.f);
+            rank[largestVoid] = r;
+        }
+
+        std::vector<float> result(N);
+        for (int i = 0; i < N; ++i)
+            result[i] = (rank[i] + 0.5f) / N;
+
+        static MemoryRecord memory(EMemSamplers);
+        memory.set(N * sizeof(float));
+        return result;
+    }
+
+private:
+    Point2i m_pixel = Point2i(0, 0);
+    uint32_t m_sampleIndex = 0;
+    uint32_t m_dimension = 0;
+};
+
+NORI_REGISTER_CLASS(BlueNoise, "bluenoise");
+NORI_NAMESPACE_END
@@ -18,6 +18,8 @@
 
 #include <nori/bvh.h>
 #include <nori/timer.h>
+#include <nori/stats.h>
+#include <nori/trace.h>
 #include <tbb/tbb.h>
 #include <Eigen/Geometry>
 #include <atomic>
@@ -307,7 +309,7 @@ public:
 
 void BVH::addMesh(Mesh *mesh) {
     m_meshes.push_back(mesh);
-    m_meshOffset.push_back(m_meshOffset.back() + mesh->getTriangleCount());
+    m_meshOffset.push_back(m_meshOffset.back() + mesh->getPrimitiveCount());
     m_bbox.expandBy(mesh->getBoundingBox());
 }
 
@@ -319,6 +321,7 @@ void BVH::clear() {
     m_meshOffset.push_back(0u);
     m_nodes.clear();
     m_indices.clear();
+    m_memory.set(0);
     m_bbox.reset();
     m_nodes.shrink_to_fit();
     m_meshes.shrink_to_fit();
@@ -335,6 +338,7 @@ void BVH::build() {
         << size << " triangles) .. ";
     cout.flush();
     Timer timer;
+    NORI_TRACE_SCOPE("BVH::build", "load");
 
     /* Conservative estimate for the total number of nodes */
     m_nodes.resize(2*size);
@@ -379,6 +383,7 @@ void BVH::build() {
         << ")." << endl;
 
     m_nodes = std::move(compactified);
+    m_memory.set(sizeof(BVHNode) * m_nodes.size() + sizeof(uint32_t) * m_indices.size());
 }
 
 std::pair<float, uint32_t> BVH::statistics(uint32_t node_idx) const {
@@ -415,10 +420,12 @@ bool BVH::rayIntersect(const Ray3f &_ray, Intersection &its, bool shadowRay) con
         return false;
 
     bool foundIntersection = false;
-    uint32_t f = 0;
+    uint32_t f = 0, nodesVisited = 0, trianglesTested = 0;
+    NORI_STAT(shadowRay ? EStatShadowRays : EStatIntersectionRays);
 
     while (true) {
         const BVHNode &node = m_nodes[node_idx];
+        ++nodesVisited;
 
         if (!node.bbox.rayIntersect(ray)) {
             if (stack_idx == 0)
@@ -437,9 +444,13 @@ bool BVH::rayIntersect(const Ray3f &_ray, Intersection &its, bool shadowRay) con
                 const Mesh *mesh = m_meshes[findMesh(idx)];
 
                 float u, v, t;
+                ++trianglesTested;
                 if (mesh->rayIntersect(idx, ray, u, v, t)) {
-                    if (shadowRay)
+                    if (shadowRay) {
+                        NORI_STAT_ADD(EStatBVHNodes, nodesVisited);
+                        NORI_STAT_ADD(EStatTriangleTests, trianglesTested);
                         return true;
+                    }
                     foundIntersection = true;
                     ray.maxt = its.t = t;
                     its.uv = Point2f(u, v);
@@ -454,53 +465,89 @@ bool BVH::rayIntersect(const Ray3f &_ray, Intersection &its, bool shadowRay) con
         }
     }
 
+    NORI_STAT_ADD(EStatBVHNodes, nodesVisited);
+    NORI_STAT_ADD(EStatTriangleTests, trianglesTested);
+
     if (foundIntersection) {
-        /* Find the barycentric coordinates */
-        Vector3f bary;
-        bary << 1-its.uv.sum(), its.uv;
-
-        /* References to all relevant mesh buffers */
-        const Mesh *mesh   = its.mesh;
-        const MatrixXf &V  = mesh->getVertexPositions();
-        const MatrixXf &N  = mesh->getVertexNormals();
-        const MatrixXf &UV = mesh->getVertexTexCoords();
-        const MatrixXu &F  = mesh->getIndices();
-
-        /* Vertex indices of the triangle */
-        uint32_t idx0 = F(0, f), idx1 = F(1, f), idx2 = F(2, f);
-
-        Point3f p0 = V.col(idx0), p1 = V.col(idx1), p2 = V.col(idx2);
-
-        /* Compute the intersection positon accurately
-           using barycentric coordinates */
-        its.p = bary.x() * p0 + bary.y() * p1 + bary.z() * p2;
-
-        /* Compute proper texture coordinates if provided by the mesh */
-        if (UV.size() > 0)
-            its.uv = bary.x() * UV.col(idx0) +
-                bary.y() * UV.col(idx1) +
-                bary.z() * UV.col(idx2);
-
-        /* Compute the geometry frame */
-        its.geoFrame = Frame((p1-p0).cross(p2-p0).normalized());
-
-        if (N.size() > 0) {
-            /* Compute the shading frame. Note that for simplicity,
-               the current implementation doesn't attempt to provide
-               tangents that are continuous across the surface. That
-               means that this code will need to be modified to be able
-               use anisotropic BRDFs, which need tangent continuity */
-
-            its.shFrame = Frame(
-                (bary.x() * N.col(idx0) +
-                 bary.y() * N.col(idx1) +
-                 bary.z() * N.col(idx2)).normalized());
-        } else {
-            its.shFrame = its.geoFrame;
-        }
+        its.primIndex = f;
+        its.mesh->setHitInformation(f, ray, its);
     }
 
     return foundIntersection;
 }
 
+void BVH::occluded(const Ray3f *_rays, size_t count, bool *occluded) const {
+    const size_t BatchSize = OcclusionBatchSize;
+
+    for (size_t offset = 0; offset < count; offset += BatchSize) {
+        size_t size = std::min(BatchSize, count - offset);
+        Ray3f rays[BatchSize];
+        uint64_t alive = 0;
+
+        for (size_t i = 0; i < size; ++i) {
+            /* Use an adaptive ray epsilon */
+            rays[i] = _rays[offset + i];
+            if (rays[i].mint == Epsilon)
+                rays[i].mint = std::max(rays[i].mint, rays[i].mint * rays[i].o.array().abs().maxCoeff());
+            occluded[offset + i] = false;
+            if (!m_nodes.empty() && rays[i].maxt >= rays[i].mint)
+                alive |= (uint64_t) 1 << i;
+        }
+        NORI_STAT_ADD(EStatShadowRays, size);
+
+        /* Each stack entry remembers the rays that entered the parent node */
+        uint32_t node_idx = 0, stack_idx = 0, stack[64];
+        uint64_t mask = alive, maskStack[64];
+        uint32_t nodesVisited = 0, trianglesTested = 0;
+
+        while (alive != 0) {
+            const BVHNode &node = m_nodes[node_idx];
+            ++nodesVisited;
+
+            uint64_t active = 0, candidates = mask & alive;
+            for (size_t i = 0; i < size; ++i) {
+                uint64_t bit = (uint64_t) 1 << i;
+                if ((candidates & bit) && node.bbox.rayIntersect(rays[i]))
+                    active |= bit;
+            }
+
+            if (active != 0 && node.isInner()) {
+                stack[stack_idx] = node.inner.rightChild;
+                maskStack[stack_idx++] = active;
+                node_idx++;
+                mask = active;
+                assert(stack_idx<64);
+                continue;
+            }
+
+            if (active != 0) {
+                for (uint32_t k = node.start(), end = node.end(); k < end && (active & alive) != 0; ++k) {
+                    uint32_t idx = m_indices[k];
+                    const Mesh *mesh = m_meshes[findMesh(idx)];
+
+                    for (size_t i = 0; i < size; ++i) {
+                        uint64_t bit = (uint64_t) 1 << i;
+                        if (!(active & alive & bit))
+                            continue;
+                        float u, v, t;
+                        ++trianglesTested;
+                        if (mesh->rayIntersect(idx, rays[i], u, v, t)) {
+                            occluded[offset + i] = true;
+                            alive &= ~bit;
+                        }
+                    }
+                }
+            }
+
+            if (stack_idx == 0)
+                break;
+            node_idx = stack[--stack_idx];
+            mask = maskStack[stack_idx];
+        }
+
+        NORI_STAT_ADD(EStatBVHNodes, nodesVisited);
+        NORI_STAT_ADD(EStatTriangleTests, trianglesTested);
+    }
+}
+
 NORI_NAMESPACE_END
@@ -0,0 +1,225 @@
+#include <nori/checkpoint.h>
+#include <nori/sampler.h>
+#include <nori/timer.h>
+#include <nori/trace.h>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <typeinfo>
+
+NORI_NAMESPACE_BEGIN
+
+/* File identifier and format version of Nori checkpoints */
+static const char NORI_CHECKPOINT_MAGIC[8] = { 'N', 'O', 'R', 'I', 'C', 'K', 'P', 'T' };
+static const uint32_t NORI_CHECKPOINT_VERSION = 3;
+
+template <typename T> static void writeValue(std::ostream &os, const T &value) {
+    os.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <typename T> static T readValue(std::istream &is) {
+    T value;
+    is.read(reinterpret_cast<char *>(&value), sizeof(T));
+    if (!is)
+        throw NoriException("Checkpoint file is truncated!");
+    return value;
+}
+
+void RenderCheckpoint::captureBlock(const ImageBlock &block) {
+    m_size = block.getSize();
+    m_borderSize = block.getBorderSize();
+    m_data.resize(block.size() * 4);
+    const float *values = reinterpret_cast<const float *>(block.data());
+    std::copy(values, values + m_data.size(), m_data.begin());
+}
+
+static std::string describePartition(const RenderPartition &partition) {
+    return partition.isPartial() ? partition.getSuffix().substr(1) : std::string("whole frame");
+}
+
+void RenderCheckpoint::captureSettings(const Sampler *sampler, const RenderPartition &partition) {
+    m_sampleCount = (uint32_t) sampler->getSampleCount();
+    m_samplerType = samplerType(sampler);
+    m_seed = sampler->getSeed();
+    m_partition = partition;
+}
+
+/* Identifies the sampler class. The name is specific to the compiler, but
+   checkpoints are only resumed by the build that wrote them */
+std::string RenderCheckpoint::samplerType(const Sampler *sampler) {
+    return typeid(*sampler).name();
+}
+
+void RenderCheckpoint::restoreBlock(ImageBlock &block, const Sampler *sampler, const RenderPartition &partition) const {
+    uint32_t sampleCount = (uint32_t) sampler->getSampleCount();
+    if (samplerType(sampler) != m_samplerType)
+        throw NoriException("Checkpoint was created with a different sampler type!");
+    if (sampler->getSeed() != m_seed)
+        throw NoriException("Checkpoint was created with seed %i, but the render uses seed %i!",
+            m_seed, sampler->getSeed());
+    if (partition != m_partition)
+        throw NoriException("Checkpoint was created for the partition \"%s\", but the render "
+            "computes \"%s\"!", describePartition(m_partition), describePartition(partition));
+    if (sampleCount != m_sampleCount)
+        throw NoriException("Checkpoint was created with %i samples per pixel, "
+            "but the scene requests %i!", m_sampleCount, sampleCount);
+    if (block.getSize() != m_size || block.getBorderSize() != m_borderSize)
+        throw NoriException("Checkpoint image size (%s, border %i) does not match "
+            "the current rendering (%s, border %i)!", m_size.toString(), m_borderSize,
+            block.getSize().toString(), block.getBorderSize());
+    if ((size_t) block.size() * 4 != m_data.size())
+        throw NoriException("Checkpoint accumulation buffer has an invalid size!");
+    std::copy(m_data.begin(), m_data.end(), reinterpret_cast<float *>(block.data()));
+}
+
+std::string RenderCheckpoint::serializeSampler(const Sampler *sampler) {
+    std::ostringstream os(std::ios::binary);
+    sampler->serialize(os);
+    return os.str();
+}
+
+void RenderCheckpoint::unserializeSampler(Sampler *sampler, const std::string &state) {
+    std::istringstream is(state, std::ios::binary);
+    sampler->unserialize(is);
+}
+
+void RenderCheckpoint::save(const std::string &filename) const {
+    NORI_TRACE_SCOPE("RenderCheckpoint::save", "output");
+    std::string tempName = filename + ".tmp";
+    {
+        std::ofstream os(tempName, std::ios::binary | std::ios::trunc);
+        if (!os)
+            throw NoriException("Unable to open checkpoint file \"%s\" for writing!", tempName);
+
+        os.write(NORI_CHECKPOINT_MAGIC, sizeof(NORI_CHECKPOINT_MAGIC));
+        writeValue(os, NORI_CHECKPOINT_VERSION);
+        writeValue(os, (int32_t) m_size.x());
+        writeValue(os, (int32_t) m_size.y());
+        writeValue(os, (int32_t) m_borderSize);
+        writeValue(os, m_sampleCount);
+        writeValue(os, m_completedPasses);
+        writeValue(os, (uint32_t) m_samplerType.size());
+        os.write(m_samplerType.data(), m_samplerType.size());
+        writeValue(os, m_seed);
+        writeValue(os, (uint8_t) m_partition.region.isValid());
+        writeValue(os, (int32_t) m_partition.region.min.x());
+        writeValue(os, (int32_t) m_partition.region.min.y());
+        writeValue(os, (int32_t) m_partition.region.max.x());
+        writeValue(os, (int32_t) m_partition.region.max.y());
+        writeValue(os, (int32_t) m_partition.tileBegin);
+        writeValue(os, (int32_t) m_partition.tileEnd);
+        writeValue(os, (int32_t) m_partition.sampleBegin);
+        writeValue(os, (int32_t) m_partition.sampleEnd);
+        writeValue(os, (uint64_t) m_data.size());
+        os.write(reinterpret_cast<const char *>(m_data.data()), sizeof(float) * m_data.size());
+        writeValue(os, (uint32_t) m_samplers.size());
+        for (const std::string &state : m_samplers) {
+            writeValue(os, (uint32_t) state.size());
+            os.write(state.data(), state.size());
+        }
+
+        if (!os)
+            throw NoriException("Error while writing checkpoint file \"%s\"!", tempName);
+    }
+
+    /* Replace the previous checkpoint. POSIX rename() does so atomically, so
+       a crash leaves either the old or the new checkpoint. std::rename does
+       not overwrite on Windows, where the old file has to be removed first */
+#if defined(PLATFORM_WINDOWS)
+    std::remove(filename.c_str());
+#endif
+    if (std::rename(tempName.c_str(), filename.c_str()) != 0)
+        throw NoriException("Unable to rename \"%s\" to \"%s\"!", tempName, filename);
+}
+
+void RenderCheckpoint::load(const std::string &filename) {
+    std::ifstream is(filename, std::ios::binary);
+    if (!is)
+        throw NoriException("Unable to open checkpoint file \"%s\"!", filename);
+
+    char magic[sizeof(NORI_CHECKPOINT_MAGIC)];
+    is.read(magic, sizeof(magic));
+    if (!is || memcmp(magic, NORI_CHECKPOINT_MAGIC, sizeof(magic)) != 0)
+        throw NoriException("\"%s\" is not a Nori checkpoint file!", filename);
+    uint32_t version = readValue<uint32_t>(is);
+    if (version != NORI_CHECKPOINT_VERSION)
+        throw NoriException("Unsupported checkpoint version %i in \"%s\"!", version, filename);
+
+    m_size.x() = readValue<int32_t>(is);
+    m_size.y() = readValue<int32_t>(is);
+    m_borderSize = readValue<int32_t>(is);
+    m_sampleCount = readValue<uint32_t>(is);
+    m_completedPasses = readValue<uint32_t>(is);
+    uint32_t typeLength = readValue<uint32_t>(is);
+    if (typeLength > 1024)
+        throw NoriException("Checkpoint \"%s\" is corrupt!", filename);
+    m_samplerType.resize(typeLength);
+    is.read(&m_samplerType[0], typeLength);
+    m_seed = readValue<uint64_t>(is);
+    bool hasRegion = readValue<uint8_t>(is) != 0;
+    Point2i regionMin, regionMax;
+    regionMin.x() = readValue<int32_t>(is);
+    regionMin.y() = readValue<int32_t>(is);
+    regionMax.x() = readValue<int32_t>(is);
+    regionMax.y() = readValue<int32_t>(is);
+    m_partition = RenderPartition();
+    if (hasRegion)
+        m_partition.region = BoundingBox2i(regionMin, regionMax);
+    m_partition.tileBegin = readValue<int32_t>(is);
+    m_partition.tileEnd = readValue<int32_t>(is);
+    m_partition.sampleBegin = readValue<int32_t>(is);
+    m_partition.sampleEnd = readValue<int32_t>(is);
+
+    uint64_t dataSize = readValue<uint64_t>(is);
+    if (dataSize != (uint64_t) (m_size.x() + 2 * m_borderSize) * (m_size.y() + 2 * m_borderSize) * 4)
+        throw NoriException("Checkpoint \"%s\" is corrupt!", filename);
+    m_data.resize(dataSize);
+    is.read(reinterpret_cast<char *>(m_data.data()), sizeof(float) * dataSize);
+    if (!is)
+        throw NoriException("Checkpoint file is truncated!");
+
+    uint32_t samplerCount = readValue<uint32_t>(is);
+    m_samplers.resize(samplerCount);
+    for (uint32_t i = 0; i < samplerCount; ++i) {
+        uint32_t length = readValue<uint32_t>(is);
+        m_samplers[i].resize(length);
+        is.read(&m_samplers[i][0], length);
+        if (!is)
+            throw NoriException("Checkpoint file is truncated!");
+    }
+}
+
+std::string RenderCheckpoint::toString() const {
+    return tfm::format("RenderCheckpoint[size=%s, passes=%i/%i, samplers=%i, seed=%i%s]",
+        m_size.toString(), m_completedPasses, m_sampleCount, m_samplers.size(), m_seed,
+        m_partition.isPartial() ? ", partition=" + describePartition(m_partition) : std::string());
+}
+
+void CheckpointWriter::write(std::unique_ptr<RenderCheckpoint> checkpoint, const std::string &filename) {
+    wait();
+
+    /* The checkpoint owns a private copy of all data, so it can be
+       written out while rendering continues */
+    RenderCheckpoint *ckpt = checkpoint.release();
+    m_thread = std::thread([ckpt, filename] {
+        std::unique_ptr<RenderCheckpoint> owned(ckpt);
+        try {
+            Timer timer;
+            owned->save(filename);
+            cout << "Wrote checkpoint \"" << filename << "\" (" << owned->getCompletedPasses()
+                 << "/" << owned->getSampleCount() << " passes, took "
+                 << timer.elapsedString() << ")" << endl;
+        } catch (const std::exception &e) {
+            cerr << "Warning: could not write checkpoint: " << e.what() << endl;
+        }
+    });
+}
+
+void CheckpointWriter::wait() {
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+NORI_NAMESPACE_END
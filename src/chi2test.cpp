@@ -18,6 +18,11 @@
 
 #include <nori/bsdf.h>
 #include <nori/warp.h>
+#include <nori/sampler.h>
+#include <nori/dpdf.h>
+#include <nori/sample.h>
+#include <nori/mesh.h>
+#include <nori/emitter.h>
 #include <pcg32.h>
 #include <hypothesis.h>
 #include <fstream>
@@ -38,6 +43,25 @@ NORI_NAMESPACE_BEGIN
  * \brief Statistical test for validating that an importance sampling routine
  * (e.g. from a BSDF) produces a distribution that agrees with what the
  * implementation claims via its associated density function.
+ *
+ * Sample generators can be tested as well: their 2D samples must be
+ * uniformly distributed in every dimension (one test per dimension),
+ * otherwise renderings using them are biased.
+ *
+ * Area emitters are tested by adding their meshes: the directions that
+ * they sample from a few random reference points around the mesh must
+ * match \ref Emitter::pdf() (triangles are found by brute force, so
+ * the meshes should be small; analytic shapes work as well).
+ *
+ * Environment emitters are tested directly, without and with a random
+ * reference normal (which selects cosine-weighted sampling). Besides the
+ * distribution, the density reported by sampling must equal \ref
+ * Emitter::pdf() of the sampled direction.
+ *
+ * With <tt>distributions="true"</tt>, the sampling tables (\ref DiscretePDF,
+ * \ref Distribution1D and \ref Distribution2D) are tested on random data
+ * as well, both with alias tables and with CDF inversion, including that
+ * the densities reported by sampling match their \c pdf() functions.
  */
 class ChiSquareTest : public NoriObject {
 public:
@@ -66,6 +90,9 @@ public:
            how many tests will be executed per BSDF */
         m_testCount = propList.getInteger("testCount", 5);
 
+        /* Also test the discrete and tabulated distributions */
+        m_testDistributions = propList.getBoolean("distributions", false);
+
         m_phiResolution = 2 * m_cosThetaResolution;
 
         if (m_sampleCount < 0) // ~5K samples per bin
@@ -75,6 +102,12 @@ public:
     virtual ~ChiSquareTest() {
         for (auto bsdf : m_bsdfs)
             delete bsdf;
+        for (auto sampler : m_samplers)
+            delete sampler;
+        for (auto mesh : m_meshes)
+            delete mesh;
+        for (auto emitter : m_emitters)
+            delete emitter;
     }
 
     virtual void addChild(NoriObject *obj) {
@@ -83,6 +116,26 @@ public:
                 m_bsdfs.push_back(static_cast<BSDF *>(obj));
                 break;
 
+            case ESampler:
+                m_samplers.push_back(static_cast<Sampler *>(obj));
+                break;
+
+            case EMesh: {
+                    Mesh *mesh = static_cast<Mesh *>(obj);
+                    if (!mesh->isEmitter())
+                        throw NoriException("ChiSquareTest: meshes must have an area emitter!");
+                    m_meshes.push_back(mesh);
+                }
+                break;
+
+            case EEmitter: {
+                    Emitter *emitter = static_cast<Emitter *>(obj);
+                    if (emitter->getEmitterType() != EmitterType::EMITTER_ENVIRONMENT)
+                        throw NoriException("ChiSquareTest: only environment emitters can be added directly!");
+                    m_emitters.push_back(emitter);
+                }
+                break;
+
             default:
                 throw NoriException("ChiSquareTest::addChild(<%s>) is not supported!",
                     classTypeName(obj->getClassType()));
@@ -191,9 +244,323 @@ public:
             }
         }
 
+        /* Test the uniformity of each registered sampler */
+        for (auto sampler : m_samplers) {
+            int pixelSamples = (int) std::max(sampler->getSampleCount(), (size_t) 1);
+            for (int l = 0; l<m_testCount; ++l) {
+                cout << "------------------------------------------------------" << endl;
+                cout << "Testing dimension " << l << ": " << sampler->toString() << endl;
+                ++total;
+
+                cout << "Accumulating " << m_sampleCount << " samples into a " << m_cosThetaResolution
+                     << "x" << m_phiResolution << " contingency table .. ";
+                cout.flush();
+
+                /* Every group of pixelSamples samples is one pixel, and the
+                   samples of dimension l are drawn after skipping l dimensions */
+                memset(obsFrequencies.get(), 0, res*sizeof(double));
+                for (int i=0; i<m_sampleCount; ++i) {
+                    sampler->setSampleIndex(Point2i(i / pixelSamples, l), (uint32_t) (i % pixelSamples));
+                    for (int k=0; k<l; ++k)
+                        sampler->next2D();
+                    Point2f sample = sampler->next2D();
+
+                    int xBin = std::min(std::max(0, (int) std::floor(sample.x() * m_cosThetaResolution)),
+                        m_cosThetaResolution-1);
+                    int yBin = std::min(std::max(0, (int) std::floor(sample.y() * m_phiResolution)),
+                        m_phiResolution-1);
+                    obsFrequencies[xBin * m_phiResolution + yBin] += 1;
+                }
+                cout << "done." << endl;
+
+                for (int i=0; i<res; ++i)
+                    expFrequencies[i] = (double) m_sampleCount / res;
+
+                std::pair<bool, std::string> result =
+                    hypothesis::chi2_test(res, obsFrequencies.get(), expFrequencies.get(),
+                        m_sampleCount, m_minExpFrequency, m_significanceLevel, m_testCount * (int) m_samplers.size());
+
+                if (result.first)
+                    ++passed;
+
+                cout << result.second << endl;
+            }
+        }
+
+        /* Test the direct illumination sampling of each registered area emitter */
+        for (auto mesh : m_meshes) {
+            const Emitter *emitter = mesh->getEmitter();
+            const BoundingBox3f &bbox = mesh->getBoundingBox();
+            for (int l = 0; l<m_testCount; ++l) {
+                memset(obsFrequencies.get(), 0, res*sizeof(double));
+                memset(expFrequencies.get(), 0, res*sizeof(double));
+
+                cout << "------------------------------------------------------" << endl;
+                cout << "Testing: " << emitter->toString() << endl;
+                ++total;
+
+                /* Reference point somewhere around the mesh */
+                Point3f ref = bbox.getCenter();
+                for (int k = 0; k < 3; ++k)
+                    ref[k] += (2 * random.nextFloat() - 1) * std::max(bbox.getExtents()[k], 0.1f);
+
+                cout << "Accumulating " << m_sampleCount << " samples into a " << m_cosThetaResolution
+                     << "x" << m_phiResolution << " contingency table .. ";
+                cout.flush();
+
+                for (int i=0; i<m_sampleCount; ++i) {
+                    Point2f sample(random.nextFloat(), random.nextFloat());
+                    EmitterQueryRecord eRec(ref);
+                    eRec.pdf = 0.0f;
+                    emitter->sample(eRec, sample, random.nextFloat());
+
+                    /* Samples of the back side are zero-valued, but still count */
+                    if (!(eRec.pdf > 0.0f))
+                        continue;
+
+                    int cosThetaBin = std::min(std::max(0, (int) std::floor((eRec.wi.z()*0.5f+0.5f)
+                            * m_cosThetaResolution)), m_cosThetaResolution-1);
+
+                    float scaledPhi = std::atan2(eRec.wi.y(), eRec.wi.x()) * INV_TWOPI;
+                    if (scaledPhi < 0)
+                        scaledPhi += 1;
+
+                    int phiBin = std::min(std::max(0,
+                        (int) std::floor(scaledPhi * m_phiResolution)), m_phiResolution-1);
+                    obsFrequencies[cosThetaBin * m_phiResolution + phiBin] += 1;
+                }
+                cout << "done." << endl;
+
+                double *ptr = expFrequencies.get();
+                cout << "Integrating expected frequencies .. ";
+                cout.flush();
+                for (int i=0; i<m_cosThetaResolution; ++i) {
+                    double cosThetaStart = -1.0 + i     * 2.0 / m_cosThetaResolution;
+                    double cosThetaEnd   = -1.0 + (i+1) * 2.0 / m_cosThetaResolution;
+                    for (int j=0; j<m_phiResolution; ++j) {
+                        double phiStart = j     * 2*M_PI / m_phiResolution;
+                        double phiEnd   = (j+1) * 2*M_PI / m_phiResolution;
+
+                        auto integrand = [&](double cosTheta, double phi) -> double {
+                            double sinTheta = std::sqrt(1 - cosTheta * cosTheta);
+                            double sinPhi = std::sin(phi), cosPhi = std::cos(phi);
+
+                            Vector3f wi((float) (sinTheta * cosPhi),
+                                        (float) (sinTheta * sinPhi),
+                                        (float) cosTheta);
+
+                            Intersection its;
+                            if (!mesh->rayMeshIntersect(Ray3f(ref, wi), its))
+                                return 0.0;
+
+                            EmitterQueryRecord eRec(emitter, ref, its.p, its.shFrame.n, its.primIndex);
+                            return emitter->pdf(eRec);
+                        };
+
+                        double integral = hypothesis::adaptiveSimpson2D(
+                            integrand, cosThetaStart, phiStart, cosThetaEnd,
+                            phiEnd);
+
+                        *ptr++ = integral * m_sampleCount;
+                    }
+                }
+                cout << "done." << endl;
+
+                hypothesis::chi2_dump(m_cosThetaResolution, m_phiResolution, obsFrequencies.get(), expFrequencies.get(),
+                    tfm::format("chi2test_%i.m", total));
+
+                std::pair<bool, std::string> result =
+                    hypothesis::chi2_test(res, obsFrequencies.get(), expFrequencies.get(),
+                        m_sampleCount, m_minExpFrequency, m_significanceLevel, m_testCount * (int) m_meshes.size());
+
+                if (result.first)
+                    ++passed;
+
+                cout << result.second << endl;
+            }
+        }
+
+        /* Test the sampling of each registered environment emitter */
+        for (auto emitter : m_emitters) {
+            for (int l = 0; l<m_testCount; ++l) {
+                memset(obsFrequencies.get(), 0, res*sizeof(double));
+                memset(expFrequencies.get(), 0, res*sizeof(double));
+
+                cout << "------------------------------------------------------" << endl;
+                cout << "Testing: " << emitter->toString() << endl;
+                ++total;
+
+                /* The first test has no reference normal, the others a random one */
+                EmitterQueryRecord query(Point3f(0.0f, 0.0f, 0.0f));
+                if (l > 0)
+                    query.refNormal = Warp::squareToUniformSphere(Point2f(random.nextFloat(), random.nextFloat()));
+
+                cout << "Accumulating " << m_sampleCount << " samples into a " << m_cosThetaResolution
+                     << "x" << m_phiResolution << " contingency table .. ";
+                cout.flush();
+
+                int mismatches = 0;
+                for (int i=0; i<m_sampleCount; ++i) {
+                    Point2f sample(random.nextFloat(), random.nextFloat());
+                    EmitterQueryRecord eRec(query);
+                    eRec.pdf = 0.0f;
+                    emitter->sample(eRec, sample, random.nextFloat());
+                    if (!(eRec.pdf > 0.0f))
+                        continue;
+                    mismatches += eRec.pdf != emitter->pdf(eRec);
+
+                    int cosThetaBin = std::min(std::max(0, (int) std::floor((eRec.wi.z()*0.5f+0.5f)
+                            * m_cosThetaResolution)), m_cosThetaResolution-1);
+
+                    float scaledPhi = std::atan2(eRec.wi.y(), eRec.wi.x()) * INV_TWOPI;
+                    if (scaledPhi < 0)
+                        scaledPhi += 1;
+
+                    int phiBin = std::min(std::max(0,
+                        (int) std::floor(scaledPhi * m_phiResolution)), m_phiResolution-1);
+                    obsFrequencies[cosThetaBin * m_phiResolution + phiBin] += 1;
+                }
+                cout << "done." << endl;
+
+                double *ptr = expFrequencies.get();
+                cout << "Integrating expected frequencies .. ";
+                cout.flush();
+                for (int i=0; i<m_cosThetaResolution; ++i) {
+                    double cosThetaStart = -1.0 + i     * 2.0 / m_cosThetaResolution;
+                    double cosThetaEnd   = -1.0 + (i+1) * 2.0 / m_cosThetaResolution;
+                    for (int j=0; j<m_phiResolution; ++j) {
+                        double phiStart = j     * 2*M_PI / m_phiResolution;
+                        double phiEnd   = (j+1) * 2*M_PI / m_phiResolution;
+
+                        auto integrand = [&](double cosTheta, double phi) -> double {
+                            double sinTheta = std::sqrt(1 - cosTheta * cosTheta);
+                            double sinPhi = std::sin(phi), cosPhi = std::cos(phi);
+
+                            EmitterQueryRecord eRec(query);
+                            eRec.wi = Vector3f((float) (sinTheta * cosPhi),
+                                               (float) (sinTheta * sinPhi),
+                                               (float) cosTheta);
+                            return emitter->pdf(eRec);
+                        };
+
+                        double integral = hypothesis::adaptiveSimpson2D(
+                            integrand, cosThetaStart, phiStart, cosThetaEnd,
+                            phiEnd);
+
+                        *ptr++ = integral * m_sampleCount;
+                    }
+                }
+                cout << "done." << endl;
+
+                hypothesis::chi2_dump(m_cosThetaResolution, m_phiResolution, obsFrequencies.get(), expFrequencies.get(),
+                    tfm::format("chi2test_%i.m", total));
+
+                std::pair<bool, std::string> result =
+                    hypothesis::chi2_test(res, obsFrequencies.get(), expFrequencies.get(),
+                        m_sampleCount, m_minExpFrequency, m_significanceLevel, m_testCount * (int) m_emitters.size());
+
+                if (mismatches > 0) {
+                    result.first = false;
+                    result.second += tfm::format("\n%i sampled densities differ from pdf()", mismatches);
+                }
+                if (result.first)
+                    ++passed;
+
+                cout << result.second << endl;
+            }
+        }
+
+        if (m_testDistributions)
+            testDistributions(random, passed, total);
+
         cout << "Passed " << passed << "/" << total << " tests." << endl;
     }
 
+    /// Test the sampling tables on random data with a resolution of two entries per cell
+    void testDistributions(pcg32 &random, int &passed, int &total) {
+        int res = m_cosThetaResolution * m_phiResolution;
+        int nu = 2 * m_phiResolution, nv = 2 * m_cosThetaResolution;
+        std::unique_ptr<double[]> obsFrequencies(new double[res]);
+        std::unique_ptr<double[]> expFrequencies(new double[res]);
+
+        for (int l = 0; l < m_testCount; ++l) {
+            /* Random weights, some of which are zero */
+            std::vector<float> weights((size_t) nu * nv);
+            for (float &w : weights)
+                w = random.nextFloat() < 0.2f ? 0.f : random.nextFloat() * random.nextFloat();
+
+            /* Every table is tested with an alias table and with CDF inversion */
+            for (int type = 0; type < 6; ++type) {
+                const char *names[] = { "DiscretePDF", "Distribution1D", "Distribution2D" };
+                bool invertCdf = type % 2 == 1;
+                cout << "------------------------------------------------------" << endl;
+                cout << "Testing: " << names[type / 2] << (invertCdf ? ", CDF inversion" : ", alias table")
+                     << " (" << l << ")" << endl;
+                ++total;
+
+                memset(obsFrequencies.get(), 0, res*sizeof(double));
+                memset(expFrequencies.get(), 0, res*sizeof(double));
+                int mismatches = 0;
+
+                if (type / 2 == 0) {
+                    /* One entry per cell */
+                    DiscretePDF dpdf(res);
+                    for (int i = 0; i < res; ++i)
+                        dpdf.append(weights[i]);
+                    dpdf.normalize(!invertCdf);
+                    for (int i = 0; i < m_sampleCount; ++i) {
+                        float pdf;
+                        size_t index = dpdf.sample(random.nextFloat(), pdf);
+                        mismatches += pdf != dpdf[index];
+                        obsFrequencies[index] += 1;
+                    }
+                    for (int i = 0; i < res; ++i)
+                        expFrequencies[i] = dpdf[i] * m_sampleCount;
+                } else if (type / 2 == 1) {
+                    /* Two segments per cell */
+                    Distribution1D distr(weights.data(), 2 * res, invertCdf);
+                    for (int i = 0; i < m_sampleCount; ++i) {
+                        float pdf;
+                        int offset;
+                        float x = distr.sample_continuous(random.nextFloat(), &pdf, &offset);
+                        mismatches += pdf != distr.pdf(offset) * distr.count();
+                        obsFrequencies[std::min((int) (x * res), res - 1)] += 1;
+                    }
+                    for (int i = 0; i < 2 * res; ++i)
+                        expFrequencies[i / 2] += distr.pdf(i) * m_sampleCount;
+                } else {
+                    /* 2x2 texels per cell */
+                    Distribution2D distr(weights.data(), nu, nv, invertCdf);
+                    for (int i = 0; i < m_sampleCount; ++i) {
+                        float pdf;
+                        Point2f p = distr.sample_continuous(Point2f(random.nextFloat(), random.nextFloat()), &pdf);
+                        mismatches += pdf != distr.pdf(p);
+                        int x = std::min((int) (p.x() * m_phiResolution), m_phiResolution - 1);
+                        int y = std::min((int) (p.y() * m_cosThetaResolution), m_cosThetaResolution - 1);
+                        obsFrequencies[y * m_phiResolution + x] += 1;
+                    }
+                    for (int v = 0; v < nv; ++v)
+                        for (int u = 0; u < nu; ++u)
+                            expFrequencies[(v / 2) * m_phiResolution + u / 2] +=
+                                distr.pdf(Point2f((u + 0.5f) / nu, (v + 0.5f) / nv)) / (nu * nv) * m_sampleCount;
+                }
+
+                std::pair<bool, std::string> result =
+                    hypothesis::chi2_test(res, obsFrequencies.get(), expFrequencies.get(),
+                        m_sampleCount, m_minExpFrequency, m_significanceLevel, m_testCount * 6);
+
+                if (mismatches > 0) {
+                    result.first = false;
+                    result.second += tfm::format("\n%i sampled densities differ from pdf()", mismatches);
+                }
+                if (result.first)
+                    ++passed;
+
+                cout << result.second << endl;
+            }
+        }
+    }
+
     virtual std::string toString() const {
         return tfm::format("ChiSquareTest[\n"
             "  thetaResolution = %i,\n"
@@ -201,14 +568,16 @@ public:
             "  minExpFrequency = %i,\n"
             "  sampleCount = %i,\n"
             "  testCount = %i,\n"
-            "  significanceLevel = %f\n"
+            "  significanceLevel = %f,\n"
+            "  distributions = %s\n"
             "]",
             m_cosThetaResolution,
             m_phiResolution,
             m_minExpFrequency,
             m_sampleCount,
             m_testCount,
-            m_significanceLevel
+            m_significanceLevel,
+            m_testDistributions ? "true" : "false"
         );
     }
 
@@ -220,7 +589,11 @@ private:
     int m_sampleCount;
     int m_testCount;
     float m_significanceLevel;
+    bool m_testDistributions;
     std::vector<BSDF *> m_bsdfs;
+    std::vector<Sampler *> m_samplers;
+    std::vector<Mesh *> m_meshes;
+    std::vector<Emitter *> m_emitters;
 };
 
 NORI_REGISTER_CLASS(ChiSquareTest, "chi2test");
@@ -0,0 +1,183 @@
+#include <nori/sampler.h>
+#include <nori/block.h>
+#include <nori/qmc.h>
+#include <pcg32.h>
+#include <iostream>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Correlated multi-jittered sampler
+ *
+ * Stratified sampler following Kensler's "Correlated Multi-Jittered
+ * Sampling" (Pixar technical memo 13-01). The pixel samples of each of
+ * the first \c dimensions \ref next1D() / \ref next2D() calls form a
+ * jittered pattern that is stratified in 2D and in both 1D projections
+ * (N-rooks). Every pixel and dimension uses its own pattern, and the
+ * sample order is randomly permuted, which pads the dimensions against
+ * each other. Deeper dimensions fall back to independent random numbers.
+ *
+ * The patterns are evaluated in closed form with Kensler's hash-based
+ * permutations, so there are no per-pixel sample arrays: the renderer
+ * visits every pixel once per sample, and an array of all pixel samples
+ * would be filled for a single entry. Sample indices beyond the sample
+ * count start a new, independent pattern.
+ */
+class CorrelatedMultiJittered : public Sampler {
+public:
+    CorrelatedMultiJittered(const PropertyList &propList) {
+        m_sampleCount = (size_t) propList.getInteger("sampleCount", 1);
+        m_seed = (uint64_t) propList.getInteger("seed", 0);
+
+        /* Number of stratified dimensions, the remaining ones are random */
+        m_maxDimension = (uint32_t) propList.getInteger("dimensions", 8);
+    }
+
+    virtual ~CorrelatedMultiJittered() { }
+
+    std::unique_ptr<Sampler> clone() const {
+        std::unique_ptr<CorrelatedMultiJittered> cloned(new CorrelatedMultiJittered());
+        cloned->m_sampleCount = m_sampleCount;
+        cloned->m_seed = m_seed;
+        cloned->m_maxDimension = m_maxDimension;
+        cloned->m_pixelSeed = m_pixelSeed;
+        cloned->m_sampleIndex = m_sampleIndex;
+        cloned->m_dimension = m_dimension;
+        cloned->m_random = m_random;
+        return std::move(cloned);
+    }
+
+    void prepare(const ImageBlock &block) {
+        setSampleIndex(block.getOffset(), 0);
+    }
+
+    void setSampleIndex(const Point2i &pixel, uint32_t sampleIndex) {
+        uint64_t pixelIndex = ((uint64_t) (uint32_t) pixel.y() << 32) | (uint32_t) pixel.x();
+        m_pixelSeed = QMC::mix64(pixelIndex ^ QMC::mix64(m_seed));
+        m_sampleIndex = sampleIndex;
+        reset();
+    }
+
+    void generate() {
+        m_sampleIndex = 0;
+        reset();
+    }
+
+    void advance() {
+        m_sampleIndex++;
+        reset();
+    }
+
+    float next1D() {
+        if (m_dimension >= m_maxDimension)
+            return m_random.nextFloat();
+        uint32_t N = (uint32_t) std::max(m_sampleCount, (size_t) 1), p = pattern();
+        uint32_t s = permute(m_sampleIndex % N, N, p * 0x68bc21ebu);
+        return std::min((s + randomFloat(s, p * 0x967a889bu)) / N, OneMinusEpsilon);
+    }
+
+    Point2f next2D() {
+        if (m_dimension >= m_maxDimension)
+            return Point2f(m_random.nextFloat(), m_random.nextFloat());
+        uint32_t N = (uint32_t) std::max(m_sampleCount, (size_t) 1), p = pattern();
+
+        /* Grid of m x n cells (m * n >= N) */
+        uint32_t m = (uint32_t) std::max(std::sqrt((float) N), 1.f), n = (N + m - 1) / m;
+        uint32_t s = permute(m_sampleIndex % N, N, p * 0x51633e2du);
+        uint32_t sx = permute(s % m, m, p * 0xa511e9b3u);
+        uint32_t sy = permute(s / m, n, p * 0x63d83595u);
+        float jx = randomFloat(s, p * 0xa399d265u);
+        float jy = randomFloat(s, p * 0x711ad6a5u);
+        return Point2f(
+            std::min((s % m + (sy + jx) / n) / m, OneMinusEpsilon),
+            std::min((s / m + (sx + jy) / m) / n, OneMinusEpsilon)
+        );
+    }
+
+    void serialize(std::ostream &stream) const {
+        stream.write(reinterpret_cast<const char *>(&m_seed), sizeof(uint64_t));
+        stream.write(reinterpret_cast<const char *>(&m_pixelSeed), sizeof(uint64_t));
+        stream.write(reinterpret_cast<const char *>(&m_sampleIndex), sizeof(uint32_t));
+        stream.write(reinterpret_cast<const char *>(&m_dimension), sizeof(uint32_t));
+        stream.write(reinterpret_cast<const char *>(&m_random.state), sizeof(uint64_t));
+        stream.write(reinterpret_cast<const char *>(&m_random.inc), sizeof(uint64_t));
+    }
+
+    void unserialize(std::istream &stream) {
+        stream.read(reinterpret_cast<char *>(&m_seed), sizeof(uint64_t));
+        stream.read(reinterpret_cast<char *>(&m_pixelSeed), sizeof(uint64_t));
+        stream.read(reinterpret_cast<char *>(&m_sampleIndex), sizeof(uint32_t));
+        stream.read(reinterpret_cast<char *>(&m_dimension), sizeof(uint32_t));
+        stream.read(reinterpret_cast<char *>(&m_random.state), sizeof(uint64_t));
+        stream.read(reinterpret_cast<char *>(&m_random.inc), sizeof(uint64_t));
+        if (!stream)
+            throw NoriException("CorrelatedMultiJittered::unserialize(): truncated sampler state!");
+    }
+
+    size_t getMemoryUsage() const { return sizeof(CorrelatedMultiJittered); }
+
+    virtual std::string toString() const {
+        return tfm::format("CorrelatedMultiJittered[sampleCount=%i, seed=%i, dimensions=%i]",
+                           m_sampleCount, m_seed, m_maxDimension);
+    }
+protected:
+    CorrelatedMultiJittered() { }
+
+    /// Start a new pixel sample: the padding dimensions get a fresh random stream
+    void reset() {
+        m_dimension = 0;
+        m_random.seed(QMC::mix64(m_pixelSeed ^ QMC::mix64(m_sampleIndex)), m_pixelSeed);
+    }
+
+    /// Pattern seed of the current dimension (and consume the dimension)
+    uint32_t pattern() {
+        uint32_t round = m_sampleIndex / (uint32_t) std::max(m_sampleCount, (size_t) 1);
+        return (uint32_t) QMC::mix64(m_pixelSeed ^ ((uint64_t) round << 32) ^ m_dimension++);
+    }
+
+    /// Kensler's permutation of <tt>{0, .., l-1}</tt> selected by \c p
+    static uint32_t permute(uint32_t i, uint32_t l, uint32_t p) {
+        if (l <= 1)
+            return 0;
+        uint32_t w = l - 1;
+        w |= w >> 1; w |= w >> 2; w |= w >> 4; w |= w >> 8; w |= w >> 16;
+        do {
+            i ^= p; i *= 0xe170893du;
+            i ^= p >> 16;
+            i ^= (i & w) >> 4;
+            i ^= p >> 8; i *= 0x0929eb3fu;
+            i ^= p >> 23;
+            i ^= (i & w) >> 1; i *= 1 | p >> 27;
+            i *= 0x6935fa69u;
+            i ^= (i & w) >> 11; i *= 0x74dcb303u;
+            i ^= (i & w) >> 2; i *= 0x9e501cc3u;
+            i ^= (i & w) >> 2; i *= 0xc860a3dfu;
+            i &= w;
+            i ^= i >> 5;
+        } while (i >= l);
+        return (i + p) % l;
+    }
+
+    /// Kensler's hash of \c i to a float in <tt>[0, 1)</tt>
+    static float randomFloat(uint32_t i, uint32_t p) {
+        i ^= p;
+        i ^= i >> 17; i ^= i >> 10; i *= 0xb36534e5u;
+        i ^= i >> 12; i ^= i >> 21; i *= 0x93fc4795u;
+        i ^= 0xdf6e307fu; i ^= i >> 17; i *= 1 | p >> 18;
+        return i * (1.0f / 4294967808.0f);
+    }
+
+    static constexpr float OneMinusEpsilon = 0.99999994f;
+
+private:
+    uint32_t m_maxDimension = 8;
+    uint64_t m_pixelSeed = 0;
+    uint32_t m_sampleIndex = 0;
+    uint32_t m_dimension = 0;
+    pcg32 m_random;
+};
+
+constexpr float CorrelatedMultiJittered::OneMinusEpsilon;
+
+NORI_REGISTER_CLASS(CorrelatedMultiJittered, "cmj");
+NORI_NAMESPACE_END
@@ -2,6 +2,7 @@
 #include <nori/integrator.h>
 #include <nori/scene.h>
 #include <nori/sampler.h>
+#include <nori/stats.h>
 
 NORI_NAMESPACE_BEGIN
 
@@ -30,6 +31,7 @@ public:
 			eRec.n = its.geoFrame.n;
 			
 			// Get the incoming radiance and create shadow ray.
+			NORI_STAT(EStatEmitterSamples);
 			Color3f Li = e->sample(eRec, sampler->next2D(), sampler->next1D());
 			const Ray3f shadow_ray(its.p, eRec.wi, Epsilon, (1.0f - Epsilon) * eRec.dist);
 			Intersection s_isect;
@@ -37,6 +39,7 @@ public:
 			{
 				// If unoccluded to the light source, compute the lighting term and add contributions.
 				BSDFQueryRecord bRec(its.toLocal(-ray.d), its.toLocal(eRec.wi), ESolidAngle);
+				NORI_STAT(EStatBSDFEvals);
 				Ld += bsdf->eval(bRec) * Li * std::max(its.geoFrame.n.dot(eRec.wi), 0.0f);
 			}
 		}
@@ -0,0 +1,123 @@
+#include <nori/mesh.h>
+#include <nori/bsdf.h>
+#include <nori/emitter.h>
+#include <nori/warp.h>
+#include <nori/lightsampler.h>
+#include <Eigen/Geometry>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Analytic disk
+ *
+ * The unit disk in the XY plane, facing +Z, placed by the \c toWorld
+ * transform (which can turn it into any ellipse). There is no closed form
+ * for sampling the solid angle of a disk, so it is sampled uniformly by
+ * area, with the exact density converted to solid angle.
+ */
+class Disk : public Mesh {
+public:
+    Disk(const PropertyList &propList) {
+        Transform trafo = propList.getTransform("toWorld", Transform());
+        m_center = trafo * Point3f(0.0f, 0.0f, 0.0f);
+        m_du = trafo * Vector3f(1.0f, 0.0f, 0.0f);
+        m_dv = trafo * Vector3f(0.0f, 1.0f, 0.0f);
+        m_normal = (trafo * Normal3f(0.0f, 0.0f, 1.0f)).normalized();
+
+        /* Dual basis, to find the coordinates of points in the plane */
+        float det = m_du.cross(m_dv).dot(m_normal);
+        if (det == 0.0f)
+            throw NoriException("Disk: the toWorld transform is degenerate!");
+        m_dualU = m_dv.cross(m_normal) / det;
+        m_dualV = m_normal.cross(m_du) / det;
+
+        m_name = "disk";
+
+        /* The extent of the ellipse along each axis */
+        Vector3f extents;
+        for (int i = 0; i < 3; ++i)
+            extents[i] = std::sqrt(m_du[i] * m_du[i] + m_dv[i] * m_dv[i]);
+        m_bbox = BoundingBox3f(m_center - extents, m_center + extents);
+    }
+
+    uint32_t getPrimitiveCount() const { return 1; }
+
+    float surfaceArea(uint32_t index) const { return M_PI * m_du.cross(m_dv).norm(); }
+
+    BoundingBox3f getBoundingBox(uint32_t index) const { return m_bbox; }
+
+    Point3f getCentroid(uint32_t index) const { return m_center; }
+
+    DirectionCone getNormalCone() const { return DirectionCone(m_normal); }
+
+    bool rayIntersect(uint32_t index, const Ray3f &ray, float &u, float &v, float &t) const {
+        float denom = m_normal.dot(ray.d);
+        if (denom == 0.0f)
+            return false;
+        t = m_normal.dot(m_center - ray.o) / denom;
+        if (!(t >= ray.mint && t <= ray.maxt))
+            return false;
+
+        Vector3f d = ray(t) - m_center;
+        u = d.dot(m_dualU);
+        v = d.dot(m_dualV);
+        return u * u + v * v <= 1.0f;
+    }
+
+    void setHitInformation(uint32_t index, const Ray3f &ray, Intersection &its) const {
+        /* On entry, uv holds the coordinates in the unit disk */
+        its.p = m_center + its.uv.x() * m_du + its.uv.y() * m_dv;
+
+        float phi = std::atan2(its.uv.y(), its.uv.x());
+        if (phi < 0)
+            phi += 2 * M_PI;
+        its.uv = Point2f(std::sqrt(its.uv.squaredNorm()), phi * INV_TWOPI);
+        its.geoFrame = its.shFrame = Frame(m_normal);
+    }
+
+    void samplePosition(const Point2f &sample, Point3f &p, Normal3f &n, float optional_u) const {
+        Point2f d = Warp::squareToUniformDisk(sample);
+        p = m_center + d.x() * m_du + d.y() * m_dv;
+        n = m_normal;
+    }
+
+    bool sampleSolidAngle(const Point3f &ref, const Point2f &sample, float optional_u,
+                          Point3f &p, Normal3f &n, uint32_t &index) const {
+        index = 0;
+        samplePosition(sample, p, n, optional_u);
+        return true;
+    }
+
+    float pdfSolidAngle(const Point3f &ref, const Point3f &p, const Normal3f &n, uint32_t index) const {
+        Vector3f wi = p - ref;
+        float dist2 = wi.squaredNorm();
+        float costheta_here = fabsf(n.dot(wi)) / std::sqrt(dist2);
+        return dist2 / (costheta_here * surfaceArea(0));
+    }
+
+    std::string toString() const {
+        return tfm::format(
+            "Disk[\n"
+            "  center = %s,\n"
+            "  du = %s,\n"
+            "  dv = %s,\n"
+            "  bsdf = %s,\n"
+            "  emitter = %s\n"
+            "]",
+            m_center.toString(),
+            m_du.toString(),
+            m_dv.toString(),
+            m_bsdf ? indent(m_bsdf->toString()) : std::string("null"),
+            m_emitter ? indent(m_emitter->toString()) : std::string("null")
+        );
+    }
+
+private:
+    Point3f m_center;
+    Vector3f m_du, m_dv;
+    Vector3f m_dualU, m_dualV;
+    Normal3f m_normal;
+};
+
+NORI_REGISTER_CLASS(Disk, "disk");
+NORI_NAMESPACE_END
@@ -2,12 +2,36 @@
 #include <nori/bitmap.h>
 #include <nori/frame.h>
 #include <nori/sample.h>
+#include <nori/warp.h>
+#include <nori/memory.h>
+#include <filesystem/resolver.h>
+#include <tbb/tbb.h>
+#include <Eigen/Geometry>
 #include <cmath>
 
 NORI_NAMESPACE_BEGIN
 
 /**
 	This class implements an environment light that is a far sphere from the center of the scene
+
+	At activation, the latitude-longitude image is resampled into an equal-area octahedral map over
+	world space directions (see Warp::squareToEqualAreaSphere()), which bakes in the toWorld transform.
+	eval() is then a polynomial mapping of the direction and one bilinear fetch, and as every pixel of
+	the map covers the same solid angle, densities on the map turn into solid angle densities by a
+	constant factor. The map has "resolution" x "resolution" pixels, by default enough to keep the
+	pixel density of the image at its equator.
+
+	Directions are sampled proportionally to the luminance of the map, filtered like eval(). With
+	sampling="cosine" (the default), shading points that pass a normal (EmitterQueryRecord::refNormal)
+	are sampled with a quadtree over the same weights instead: the traversal multiplies the luminance
+	of each node by a bound of the cosine to the normal over the directions of the node, so that
+	directions below the surface are never sampled and the rest roughly follow the product of
+	luminance and cosine. The density is the product of the choices along the path to a pixel, which
+	pdf() retraces.
+
+	The luminance distribution samples with alias tables, which are fast but scramble the
+	stratification of Sobol, CMJ or blue-noise samples. With invertCDF="true", it inverts the CDFs
+	instead, which keeps the stratification at the cost of a binary search per dimension.
 */
 
 class EnvironmentLight : public Emitter
@@ -16,11 +40,20 @@ public:
 
 	EnvironmentLight(const PropertyList& prop)
 	{
-		m_tex_filename = prop.getString("filename");
+		m_tex_filename = getFileResolver()->resolve(prop.getString("filename")).str();
 		m_localToWorld = prop.getTransform("toWorld", Transform());
 		m_worldToLocal = m_localToWorld.getInverseMatrix();
-		m_texture = Texture(m_tex_filename);		
+		m_resolution = prop.getInteger("resolution", 0);
+		if (m_resolution < 0)
+			throw NoriException("EnvironmentLight: the resolution must not be negative");
 		m_type = EmitterType::EMITTER_ENVIRONMENT;
+
+		std::string sampling = prop.getString("sampling", "cosine");
+		if (sampling == "cosine")
+			m_cosineSampling = true;
+		else if (sampling != "luminance")
+			throw NoriException("EnvironmentLight: unknown sampling strategy \"%s\" (expected luminance or cosine)", sampling);
+		m_invertCdf = prop.getBoolean("invertCDF", false);
 	}
 
 	~EnvironmentLight()
@@ -28,98 +61,404 @@ public:
 
 	}
 
-	// Setup the discrete pdfs so that it can be sampled
+	// Resample the image into the octahedral map and setup the discrete pdfs so that it can be sampled
 	virtual void activate()
 	{
-		Color3f *data = m_texture.data();
-		// Compute luminance of each pixel
-		float* m_luminance = new float[m_texture.get_width() * m_texture.get_height()];
+		Texture texture(m_tex_filename);
+		m_imageWidth = texture.get_width();
+		m_imageHeight = texture.get_height();
+		if (m_resolution == 0)
+			m_resolution = std::max(1, (int) std::ceil(std::sqrt(2.0 * m_imageWidth * m_imageHeight / M_PI)));
+		int n = m_resolution;
 
-		for (int y = 0; y < m_texture.get_height(); y++)
+		// Average a grid of bilinear lookups of the image over each pixel of the map
+		const int Supersampling = 4;
+		m_radiance.resize((size_t) n * n);
+		tbb::parallel_for(tbb::blocked_range<int>(0, n), [&](const tbb::blocked_range<int> &range)
 		{
-			float sineTheta = sinf(M_PI * (y + 0.5f) / m_texture.get_height());
-			for (int x = 0; x < m_texture.get_width(); x++)
+			for (int y = range.begin(); y != range.end(); y++)
+				for (int x = 0; x < n; x++)
+				{
+					Color3f sum(0.0f);
+					for (int sy = 0; sy < Supersampling; sy++)
+						for (int sx = 0; sx < Supersampling; sx++)
+						{
+							Point2f uv((x + (sx + 0.5f) / Supersampling) / n, (y + (sy + 0.5f) / Supersampling) / n);
+							Vector3f local_dir = m_worldToLocal * Warp::squareToEqualAreaSphere(uv);
+							sum += lookupImage(texture, local_dir.normalized());
+						}
+					m_radiance[x + (size_t) y * n] = sum / (float) (Supersampling * Supersampling);
+				}
+		});
+		m_radianceMemory.set(sizeof(Color3f) * m_radiance.size());
+
+		// Luminance of each pixel, averaged over the bilinear reconstruction of eval() within the pixel
+		// (a tent filter), so that no direction with radiance has a zero density
+		static const float filter[3] = { 0.125f, 0.75f, 0.125f };
+		std::vector<float> luminance((size_t) n * n);
+		for (int y = 0; y < n; y++)
+			for (int x = 0; x < n; x++)
 			{
-				int index = x + y * m_texture.get_width();
-				float lum = data[index].getLuminance();
-				m_luminance[index] = lum * sineTheta;
+				float lum = 0.0f;
+				for (int dy = -1; dy <= 1; dy++)
+					for (int dx = -1; dx <= 1; dx++)
+						lum += filter[dy + 1] * filter[dx + 1] * pixel(x + dx, y + dy).getLuminance();
+				luminance[x + (size_t) y * n] = std::max(0.0f, lum);
 			}
-		}
 
-		m_pdf = std::unique_ptr<Distribution2D>(new Distribution2D(m_luminance, m_texture.get_width(), m_texture.get_height()));		
-		delete[] m_luminance;
+		m_pdf = std::unique_ptr<Distribution2D>(new Distribution2D(luminance.data(), n, n, m_invertCdf));
+		if (m_cosineSampling)
+			buildHierarchy(luminance.data());
 	}
 
 	// Methods that have to be implemented for all types of emitters.
 	Color3f sample(EmitterQueryRecord &lRec, const Point2f &sample, float optional_u) const
 	{
 		float pdf;
-		Point2f sampled_pt = m_pdf->sample_continuous(sample, &pdf);
-
-		float theta = sampled_pt.y() * M_PI;
-		float phi = sampled_pt.x() * 2.0f * M_PI;
-		float sin_theta = sin(theta);
-		float cos_theta = cos(theta);
-		float sin_phi = sin(phi);
-		float cos_phi = cos(phi);
-		
+		Point2f uv;
+		bool hierarchy = useHierarchy(lRec);
+		if (hierarchy)
+			uv = sampleHierarchy(sample, refNormal(lRec), pdf);
+		else
+			uv = m_pdf->sample_continuous(sample, &pdf);
+
 		lRec.emitter = this;
 		lRec.dist = INFINITY;
-		lRec.p = Vector3f(sampled_pt.x(), sampled_pt.y(), 0.0f);
-		lRec.wi = m_localToWorld * Vector3f(sin_theta * cos_phi, sin_theta * sin_phi, cos_theta);			// probably need to transform
-		lRec.pdf = pdf / (2.0f * M_PI * M_PI * sin_theta);
+		lRec.wi = Warp::squareToEqualAreaSphere(uv);
+
+		// pdf() and eval() map the direction back to the map, which is off by up to ~1e-4 pixels near the
+		// center of the octahedron. Use the pixel that they find, so that the densities always agree
+		Point2f uvBack = Warp::equalAreaSphereToSquare(lRec.wi);
+		if (pixelIndex(uvBack.x()) != pixelIndex(uv.x()) || pixelIndex(uvBack.y()) != pixelIndex(uv.y()))
+		{
+			uv = uvBack;
+			pdf = hierarchy ? pdfHierarchy(uv, refNormal(lRec)) : m_pdf->pdf(uv);
+		}
+		lRec.p = Vector3f(uv.x(), uv.y(), 0.0f);
+		lRec.pdf = pdf * INV_FOURPI;
 
 		if (lRec.pdf == 0.0f)
 			return 0.0f;
 		else
-			return m_texture.getval(sampled_pt.x(), sampled_pt.y()) / lRec.pdf;
+			return lookup(uv) / lRec.pdf;
 	}
 
 	float pdf(const EmitterQueryRecord &lRec) const
 	{
-		Vector3f world_dir = lRec.wi;
-		Vector3f local_dir = m_worldToLocal * world_dir;
-
-		float theta = Frame::spherical_theta(local_dir);
-		float phi = Frame::spherical_phi(local_dir);
-		float sin_theta = sinf(theta);
-		if (sin_theta == 0.0f) 
-			return 0.0f;
-		else
-			return m_pdf->pdf(Point2f(phi * INV_TWOPI, theta * INV_PI)) / (2.0f * M_PI * M_PI * sin_theta);
+		Point2f uv = Warp::equalAreaSphereToSquare(lRec.wi);
+		if (useHierarchy(lRec))
+			return pdfHierarchy(uv, refNormal(lRec)) * INV_FOURPI;
+		return m_pdf->pdf(uv) * INV_FOURPI;
 	}
 
 	Color3f eval(const EmitterQueryRecord &lRec) const
 	{
+		return lookup(Warp::equalAreaSphereToSquare(lRec.wi));
+	}
+
+	std::string toString() const
+	{
+		return tfm::format("Environment Light : \n File : %s \n Dimensions : [%d,%d] \n Resolution : %d \n Sampling : %s \n Invert CDF : %s",
+			m_tex_filename, m_imageWidth, m_imageHeight, m_resolution, m_cosineSampling ? "cosine" : "luminance",
+			m_invertCdf ? "true" : "false");
+	}
+
+private:
+	/// Cone that contains the directions of a quadtree node
+	struct NodeCone
+	{
+		Vector3f axis;
+		float cosAngle, sinAngle;
+	};
 
-		Vector3f world_dir = lRec.wi;
-		Vector3f local_dir = m_worldToLocal * world_dir;
+	struct Level
+	{
+		int width, height;
+		std::vector<float> weights;		///< Sums of the pixel weights of the nodes
+		std::vector<NodeCone> cones;	///< Empty for the pixels, which use the cones of their parents
+	};
 
-		// compute theta and phi
-		float theta = acos(clamp(Frame::cosTheta(local_dir), -1.0f, 1.0f));
+	// Bilinear lookup of the latitude-longitude image in a direction of its local frame
+	static Color3f lookupImage(const Texture &texture, const Vector3f &local_dir)
+	{
+		int width = texture.get_width(), height = texture.get_height();
+		float theta = acosf(clamp(Frame::cosTheta(local_dir), -1.0f, 1.0f));
 		float phi = atan2f(local_dir.x(), local_dir.y());
+		float fx = (M_PI + phi) * INV_TWOPI * width - 0.5f;
+		float fy = theta * INV_PI * height - 0.5f;
 
-		// compute the corresponding pixel coords
-		// we assume height ranges from 0 -> pi/2
-		// we assume width ranges from 0 - 2pi
-		float s = (M_PI + phi) * INV_TWOPI;
-		float t = theta * INV_PI;
+		int x = (int) floorf(fx), y = (int) floorf(fy);
+		float s = fx - x, t = fy - y;
+		auto at = [&](int px, int py) -> Color3f
+		{
+			px = ((px % width) + width) % width;
+			py = clamp(py, 0, height - 1);
+			return texture(py, px);
+		};
+		return (1.0f - t) * ((1.0f - s) * at(x, y) + s * at(x + 1, y)) +
+			t * ((1.0f - s) * at(x, y + 1) + s * at(x + 1, y + 1));
+	}
 
-		return m_texture.getval(s, t);
+	// Pixel of the map, up to one pixel outside of it: the map continues across each edge mirrored about its midpoint
+	const Color3f &pixel(int x, int y) const
+	{
+		int n = m_resolution;
+		if (x < 0)
+		{
+			x = -x - 1;
+			y = n - 1 - y;
+		}
+		else if (x >= n)
+		{
+			x = 2 * n - 1 - x;
+			y = n - 1 - y;
+		}
+		if (y < 0)
+		{
+			x = n - 1 - x;
+			y = -y - 1;
+		}
+		else if (y >= n)
+		{
+			x = n - 1 - x;
+			y = 2 * n - 1 - y;
+		}
+		return m_radiance[x + (size_t) y * n];
 	}
 
-	std::string toString() const
+	// Bilinear lookup of the map
+	Color3f lookup(const Point2f &uv) const
 	{
-		return tfm::format("Environment Light : \n File : %s \n Dimensions : [%d,%d]", m_tex_filename, m_texture.get_width(), m_texture.get_height());
+		float fx = uv.x() * m_resolution - 0.5f, fy = uv.y() * m_resolution - 0.5f;
+		int x = (int) floorf(fx), y = (int) floorf(fy);
+		float s = fx - x, t = fy - y;
+		return (1.0f - t) * ((1.0f - s) * pixel(x, y) + s * pixel(x + 1, y)) +
+			t * ((1.0f - s) * pixel(x, y + 1) + s * pixel(x + 1, y + 1));
+	}
+
+	bool useHierarchy(const EmitterQueryRecord &lRec) const
+	{
+		return m_cosineSampling && !lRec.refNormal.isZero();
+	}
+
+	static Vector3f refNormal(const EmitterQueryRecord &lRec)
+	{
+		return Vector3f(lRec.refNormal).normalized();
+	}
+
+	static float angleBetween(const Vector3f &a, const Vector3f &b)
+	{
+		return atan2f(a.cross(b).norm(), a.dot(b));
+	}
+
+	/**
+	 * Cone that contains the directions of the region [u0, u1] x [v0, v1] of the map: its angle is the
+	 * largest angle between the direction of the center and a grid of points in the region, plus the
+	 * largest diagonal of the grid cells, which bounds how far the directions in between get from
+	 * the points.
+	 */
+	static NodeCone boundRegion(float u0, float u1, float v0, float v1)
+	{
+		const int Steps = 4;
+		Vector3f grid[Steps + 1][Steps + 1];
+		for (int j = 0; j <= Steps; j++)
+			for (int i = 0; i <= Steps; i++)
+				grid[j][i] = Warp::squareToEqualAreaSphere(Point2f(u0 + (u1 - u0) * i / Steps, v0 + (v1 - v0) * j / Steps));
+
+		NodeCone cone;
+		cone.axis = Warp::squareToEqualAreaSphere(Point2f(0.5f * (u0 + u1), 0.5f * (v0 + v1)));
+		float angle = 0.0f, margin = 0.0f;
+		for (int j = 0; j <= Steps; j++)
+			for (int i = 0; i <= Steps; i++)
+			{
+				angle = std::max(angle, angleBetween(cone.axis, grid[j][i]));
+				if (i < Steps && j < Steps)
+					margin = std::max(margin, std::max(angleBetween(grid[j][i], grid[j + 1][i + 1]),
+						angleBetween(grid[j][i + 1], grid[j + 1][i])));
+			}
+
+		angle += margin;
+		cone.cosAngle = angle < M_PI ? cosf(angle) : -1.0f;
+		cone.sinAngle = angle < M_PI ? sinf(angle) : 0.0f;
+		return cone;
+	}
+
+	// Largest cosine between 'n' and the directions of a cone, without trigonometric functions
+	static float cosineBound(const NodeCone &cone, const Vector3f &n)
+	{
+		float cosTheta = n.dot(cone.axis);
+		if (cosTheta >= cone.cosAngle)
+			return 1.0f;
+		// cos(theta - angle) for the angle theta between 'n' and the axis
+		float sinTheta = std::sqrt(std::max(0.0f, 1.0f - cosTheta * cosTheta));
+		return std::max(0.0f, cosTheta * cone.cosAngle + sinTheta * cone.sinAngle);
+	}
+
+	// Build a quadtree over the pixel weights, each level halves the resolution (rounding up) until a single node is left
+	void buildHierarchy(const float *weights)
+	{
+		int n = m_resolution, size = n;
+		m_levels.clear();
+		size_t bytes = 0;
+		while (true)
+		{
+			Level level;
+			level.width = level.height = size;
+			level.weights.resize((size_t) size * size);
+			if (m_levels.empty())
+				std::copy(weights, weights + level.weights.size(), level.weights.begin());
+			else
+			{
+				const Level &finer = m_levels.back();
+				for (int y = 0; y < size; y++)
+					for (int x = 0; x < size; x++)
+					{
+						float sum = 0.0f;
+						for (int dy = 0; dy < 2; dy++)
+							for (int dx = 0; dx < 2; dx++)
+							{
+								int cx = 2 * x + dx, cy = 2 * y + dy;
+								if (cx < finer.width && cy < finer.height)
+									sum += finer.weights[cx + cy * finer.width];
+							}
+						level.weights[x + y * size] = sum;
+					}
+
+				// Regions of the map covered by the nodes, measured in pixels
+				int span = 1 << m_levels.size();
+				level.cones.resize((size_t) size * size);
+				tbb::parallel_for(tbb::blocked_range<int>(0, size), [&](const tbb::blocked_range<int> &range)
+				{
+					for (int y = range.begin(); y != range.end(); y++)
+						for (int x = 0; x < size; x++)
+							level.cones[x + y * size] = boundRegion(
+								(float) std::min(x * span, n) / n, (float) std::min((x + 1) * span, n) / n,
+								(float) std::min(y * span, n) / n, (float) std::min((y + 1) * span, n) / n);
+				});
+			}
+
+			bytes += level.weights.size() * sizeof(float) + level.cones.size() * sizeof(NodeCone);
+			m_levels.push_back(std::move(level));
+			if (size == 1)
+				break;
+			size = (size + 1) / 2;
+		}
+		m_hierarchyMemory.set(bytes);
+	}
+
+	/**
+	 * Weights of the (up to) four children of node (x, y) of a level, indexed by [dy][dx]. Each is
+	 * the sum of the pixel weights times the largest cosine between 'n' and the directions of the
+	 * child, or of the node itself for pixels.
+	 */
+	void childWeights(int level, int x, int y, const Vector3f &n, float w[2][2]) const
+	{
+		const Level &children = m_levels[level - 1];
+		float parentBound = level == 1 ? cosineBound(m_levels[level].cones[x + y * m_levels[level].width], n) : 0.0f;
+		for (int dy = 0; dy < 2; dy++)
+			for (int dx = 0; dx < 2; dx++)
+			{
+				int cx = 2 * x + dx, cy = 2 * y + dy;
+				w[dy][dx] = 0.0f;
+				if (cx >= children.width || cy >= children.height)
+					continue;
+				float weight = children.weights[cx + cy * children.width];
+				if (weight == 0.0f)
+					continue;
+				w[dy][dx] = weight * (level == 1 ? parentBound : cosineBound(children.cones[cx + cy * children.width], n));
+			}
+	}
+
+	// Choose a pixel by descending the quadtree, and a uniform position within it (which pdfHierarchy()
+	// maps back to the same pixel). Returns the density with respect to the unit square in 'pdf'
+	Point2f sampleHierarchy(Point2f sample, const Vector3f &n, float &pdf) const
+	{
+		int x = 0, y = 0;
+		float prob = 1.0f;
+		for (int level = (int) m_levels.size() - 1; level > 0; level--)
+		{
+			float w[2][2];
+			childWeights(level, x, y, n, w);
+			float column0 = w[0][0] + w[1][0], column1 = w[0][1] + w[1][1];
+			float total = column0 + column1;
+			if (total <= 0.0f)
+			{
+				pdf = 0.0f;
+				return Point2f(0.5f, 0.5f);
+			}
+
+			// Choose the column with the first dimension, the row within it with the second
+			int dx = reuseSample(sample.x(), column0 / total);
+			float column = dx ? column1 : column0;
+			int dy = reuseSample(sample.y(), w[0][dx] / column);
+
+			prob *= w[dy][dx] / total;
+			x = 2 * x + dx;
+			y = 2 * y + dy;
+		}
+
+		pdf = prob * m_resolution * m_resolution;
+		return Point2f(cellCoordinate(x, sample.x(), m_resolution), cellCoordinate(y, sample.y(), m_resolution));
+	}
+
+	// Row or column of the map that contains the coordinate 'u'
+	int pixelIndex(float u) const
+	{
+		return clamp((int) (u * m_resolution), 0, m_resolution - 1);
+	}
+
+	// Density of sampleHierarchy() with respect to the unit square
+	float pdfHierarchy(const Point2f &uv, const Vector3f &n) const
+	{
+		int px = pixelIndex(uv.x()), py = pixelIndex(uv.y());
+
+		float prob = 1.0f;
+		for (int level = (int) m_levels.size() - 1; level > 0; level--)
+		{
+			int x = px >> level, y = py >> level;
+			int dx = (px >> (level - 1)) & 1, dy = (py >> (level - 1)) & 1;
+			float w[2][2];
+			childWeights(level, x, y, n, w);
+			// Same sums as in sampleHierarchy(), so that the densities agree exactly
+			float total = (w[0][0] + w[1][0]) + (w[0][1] + w[1][1]);
+			if (total <= 0.0f)
+				return 0.0f;
+			prob *= w[dy][dx] / total;
+		}
+		return prob * m_resolution * m_resolution;
+	}
+
+	// Choose between two options with probability 'p' for the first, and rescale 'u' to [0, 1)
+	static int reuseSample(float &u, float p)
+	{
+		int choice;
+		if (u < p)
+		{
+			u = u / p;
+			choice = 0;
+		}
+		else
+		{
+			u = (u - p) / (1.0f - p);
+			choice = 1;
+		}
+		u = std::min(u, 0.99999994f);
+		return choice;
 	}
 
-private:
-	Texture m_texture;
 	Transform m_localToWorld;
 	Transform m_worldToLocal;
 	std::string m_tex_filename;
+	int m_imageWidth = 0, m_imageHeight = 0;
+	int m_resolution;
+	std::vector<Color3f> m_radiance;
+	MemoryRecord m_radianceMemory { EMemTextures };
 	std::unique_ptr<Distribution2D> m_pdf;
+	bool m_cosineSampling = false;
+	bool m_invertCdf = false;
+	std::vector<Level> m_levels;
+	MemoryRecord m_hierarchyMemory { EMemDistributions };
 };
 
 NORI_REGISTER_CLASS(EnvironmentLight, "environment");
-NORI_NAMESPACE_END
\ No newline at end of file
+NORI_NAMESPACE_END
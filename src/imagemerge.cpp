@@ -0,0 +1,59 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob, Romain Prévost
+
+    Nori is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Nori is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <nori/block.h>
+#include <nori/bitmap.h>
+#include <filesystem/path.h>
+
+/**
+ * Merges the raw weighted accumulation buffers written by several
+ * (partial) render processes into the final image:
+ *
+ *     imagemerge output.exr part1.raw.exr part2.raw.exr ...
+ *
+ * Colors and filter weights of all parts are summed before the
+ * result is normalized, so the parts may overlap arbitrarily.
+ */
+int main(int argc, char **argv) {
+    using namespace nori;
+
+    if (argc < 3) {
+        cerr << "Syntax: " << argv[0] << " output.exr part1.raw.exr [part2.raw.exr ..]" << endl;
+        return -1;
+    }
+
+    try {
+        std::string outputName = argv[1];
+        if (filesystem::path(outputName).extension() != "exr")
+            throw NoriException("Unknown output file \"%s\", expected an "
+                "extension of type .exr", outputName);
+
+        ImageBlock block(Vector2i(0, 0), nullptr);
+        for (int i = 2; i < argc; ++i) {
+            cout << "Merging \"" << argv[i] << "\"" << endl;
+            block.addRaw(argv[i]);
+        }
+
+        std::unique_ptr<Bitmap> bitmap(block.toBitmap());
+        bitmap->save(outputName);
+    } catch (const std::exception &e) {
+        cerr << "Fatal error: " << e.what() << endl;
+        return -1;
+    }
+    return 0;
+}
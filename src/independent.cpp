@@ -18,7 +18,9 @@
 
 #include <nori/sampler.h>
 #include <nori/block.h>
+#include <nori/qmc.h>
 #include <pcg32.h>
+#include <iostream>
 
 NORI_NAMESPACE_BEGIN
 
@@ -34,6 +36,7 @@ class Independent : public Sampler {
 public:
     Independent(const PropertyList &propList) {
         m_sampleCount = (size_t) propList.getInteger("sampleCount", 1);
+        m_seed = (uint64_t) propList.getInteger("seed", 0);
     }
 
     virtual ~Independent() { }
@@ -41,17 +44,25 @@ public:
     std::unique_ptr<Sampler> clone() const {
         std::unique_ptr<Independent> cloned(new Independent());
         cloned->m_sampleCount = m_sampleCount;
+        cloned->m_seed = m_seed;
         cloned->m_random = m_random;
         return std::move(cloned);
     }
 
     void prepare(const ImageBlock &block) {
         m_random.seed(
-            block.getOffset().x(),
+            block.getOffset().x() ^ QMC::mix64(m_seed),
             block.getOffset().y()
         );
     }
 
+    void setSampleIndex(const Point2i &pixel, uint32_t sampleIndex) {
+        /* Every pixel gets its own PCG stream, and the sample index
+           selects a well-mixed starting state within that stream */
+        uint64_t pixelIndex = ((uint64_t) (uint32_t) pixel.y() << 32) | (uint32_t) pixel.x();
+        m_random.seed(QMC::mix64(pixelIndex ^ QMC::mix64(sampleIndex ^ QMC::mix64(m_seed))), pixelIndex);
+    }
+
     void generate() { /* No-op for this sampler */ }
     void advance()  { /* No-op for this sampler */ }
 
@@ -66,8 +77,36 @@ public:
         );
     }
 
+    void next1DArray(float *values, size_t count) {
+        for (size_t i = 0; i < count; ++i)
+            values[i] = m_random.nextFloat();
+    }
+
+    void next2DArray(Point2f *values, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            float x = m_random.nextFloat();
+            values[i] = Point2f(x, m_random.nextFloat());
+        }
+    }
+
+    void serialize(std::ostream &stream) const {
+        stream.write(reinterpret_cast<const char *>(&m_random.state), sizeof(uint64_t));
+        stream.write(reinterpret_cast<const char *>(&m_random.inc), sizeof(uint64_t));
+        stream.write(reinterpret_cast<const char *>(&m_seed), sizeof(uint64_t));
+    }
+
+    void unserialize(std::istream &stream) {
+        stream.read(reinterpret_cast<char *>(&m_random.state), sizeof(uint64_t));
+        stream.read(reinterpret_cast<char *>(&m_random.inc), sizeof(uint64_t));
+        stream.read(reinterpret_cast<char *>(&m_seed), sizeof(uint64_t));
+        if (!stream)
+            throw NoriException("Independent::unserialize(): truncated sampler state!");
+    }
+
+    size_t getMemoryUsage() const { return sizeof(Independent); }
+
     virtual std::string toString() const {
-        return tfm::format("Independent[sampleCount=%i]", m_sampleCount);
+        return tfm::format("Independent[sampleCount=%i, seed=%i]", m_sampleCount, m_seed);
     }
 protected:
     Independent() { }
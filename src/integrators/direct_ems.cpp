@@ -2,6 +2,7 @@
 #include <nori/integrator.h>
 #include <nori/scene.h>
 #include <nori/sampler.h>
+#include <nori/stats.h>
 #include <fstream>
 
 NORI_NAMESPACE_BEGIN
@@ -48,11 +49,13 @@ public:
 			// Construct an Emitter query record
 			EmitterQueryRecord eRec;
 			eRec.ref = its.p;
+			eRec.refNormal = bsdf->getLightSamplingNormal(its.shFrame.n, -ray.d);
 			
 			// Get the incoming radiance and create shadow ray.
 			// Assume Li has the pdf included in it.
 			//std::ofstream park_sampled_pts("park_sampled.csv");
 
+			NORI_STAT(EStatEmitterSamples);
 			Color3f Li = e->sample(eRec, sampler->next2D(), sampler->next1D());
 
 			/*
@@ -68,6 +71,7 @@ public:
 			bRec.p = its.p;
 			bRec.uv = its.uv;
 
+			NORI_STAT(EStatBSDFEvals);
 			Color3f evalTerm = bsdf->eval(bRec) * Li * fabsf(its.shFrame.n.dot(eRec.wi));
 			
 			if (!evalTerm.isZero() && evalTerm.isValid())
@@ -2,6 +2,7 @@
 #include <nori/integrator.h>
 #include <nori/scene.h>
 #include <nori/sampler.h>
+#include <nori/stats.h>
 
 NORI_NAMESPACE_BEGIN
 
@@ -47,6 +48,7 @@ public:
 		bRec.p = its.p;
 		bRec.uv = its.uv;
 		
+		NORI_STAT(EStatBSDFSamples);
 		Color3f f = bsdf->sample(bRec, sampler->next2D(), sampler->next1D());
 		const Ray3f shadow_ray(its.p, its.toWorld(bRec.wo), Epsilon, INFINITY);
 		Intersection s_isect;
@@ -2,6 +2,7 @@
 #include <nori/integrator.h>
 #include <nori/scene.h>
 #include <nori/sampler.h>
+#include <nori/stats.h>
 
 NORI_NAMESPACE_BEGIN
 
@@ -54,6 +55,7 @@ public:
 			bRec.p = its.p;
 			bRec.uv = its.uv;
 			
+			NORI_STAT(EStatBSDFSamples);
 			Color3f f = bsdf->sample(bRec, sampler->next2D(), sampler->next1D());
 			float bpdf = bsdf->pdf(bRec);
 			const Ray3f shadow_ray(its.p, its.toWorld(bRec.wo), Epsilon, INFINITY);
@@ -70,6 +72,7 @@ public:
 					eRec.wi = its.toWorld(bRec.wo);
 					eRec.n = s_isect.geoFrame.n;
 					eRec.p = s_isect.p;
+					eRec.primIndex = s_isect.primIndex;
 					eRec.dist = (eRec.p - eRec.ref).norm();
 
 					// Get the radiance along the intersected direction
@@ -97,6 +100,7 @@ public:
 					EmitterQueryRecord eRec;
 					eRec.wi = shadow_ray.d;
 					eRec.ref = shadow_ray.o;
+					eRec.refNormal = bsdf->getLightSamplingNormal(its.shFrame.n, -ray.d);
 					eRec.emitter = bgEmitter;
 
 					Color3f Li = bgEmitter->eval(eRec);
@@ -121,9 +125,11 @@ public:
 				// Construct an Emitter query record
 				EmitterQueryRecord eRec;
 				eRec.ref = its.p;
+				eRec.refNormal = bsdf->getLightSamplingNormal(its.shFrame.n, -ray.d);
 
 				// Get the incoming radiance and create shadow ray.
 				// Assume Li has the pdf included in it.
+				NORI_STAT(EStatEmitterSamples);
 				Color3f Li = e->sample(eRec, sampler->next2D(), sampler->next1D());
 				float lpdf = 1.0f; 
 				float bpdf = 0.0f;
@@ -137,6 +143,7 @@ public:
 					bRec.p = its.p;
 					bRec.uv = its.uv;
 
+					NORI_STAT(EStatBSDFEvals);
 					Color3f evalTerm = bsdf->eval(bRec) * Li * fmaxf(its.shFrame.n.dot(eRec.wi), 0.0f);
 									
 					// compute MIS term
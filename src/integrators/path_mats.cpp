@@ -2,6 +2,7 @@
 #include <nori/integrator.h>
 #include <nori/scene.h>
 #include <nori/sampler.h>
+#include <nori/stats.h>
 
 NORI_NAMESPACE_BEGIN
 
@@ -53,6 +54,7 @@ public:
 			BSDFQueryRecord bRec(isect.toLocal(-traced_ray.d));
 			bRec.uv = isect.uv;
 
+			NORI_STAT(EStatBSDFSamples);
 			Color3f f = bsdf->sample(bRec, sampler->next2D(), sampler->next1D());
 			if (!f.isValid())
 			{
@@ -2,6 +2,7 @@
 #include <nori/integrator.h>
 #include <nori/scene.h>
 #include <nori/sampler.h>
+#include <nori/stats.h>
 
 NORI_NAMESPACE_BEGIN
 
@@ -30,107 +31,161 @@ public:
 
 	~PathIntegratorMis() {}
 
-	// Estimate Direct Lighting using MIS
-	// return appropriately weighted terms.
-	Color3f LiDirect(const Scene* scene, Sampler* sampler, const Ray3f& ray, const Intersection& isect) const
+	// Sample components of one path vertex. They are drawn with one next1DArray() and
+	// one next2DArray() call, so every bounce consumes the same sample dimensions.
+	struct VertexSamples
 	{
-		Color3f L_ems(0.0f), L_mats(0.0f);		
+		float lightSelection, emitter1D, bsdf1D, roulette;
+		Point2f emitter2D, bsdf2D;
+
+		VertexSamples(Sampler* sampler)
+		{
+			float u1D[4];
+			Point2f u2D[2];
+			sampler->next1DArray(u1D, 4);
+			sampler->next2DArray(u2D, 2);
+			lightSelection = u1D[0];
+			emitter1D = u1D[1];
+			bsdf1D = u1D[2];
+			roulette = u1D[3];
+			emitter2D = u2D[0];
+			bsdf2D = u2D[1];
+		}
+	};
+
+	// Estimate Direct Lighting by emitter sampling, weighted with MIS.
+	// The BSDF-sampling half of MIS is supplied by the continuation ray in Li(),
+	// which weights the emission that it hits with emissionWeight().
+	Color3f LiDirect(const Scene* scene, Sampler* sampler, const Ray3f& ray, const Intersection& isect,
+		const VertexSamples& u) const
+	{
+		if (m_strategy == DirectSamplingStrategy::SAMPLE_ALL_LIGHTS)
+			return LiDirectAllLights(scene, sampler, ray, isect);
+
 		const BSDF* bsdf = isect.mesh->getBSDF();
 
+		// A delta BSDF can never connect to a light sample
+		if (bsdf->isDelta())
+			return Color3f(0.0f);
+
 		// Choose a light
-		float pdf = 1.0f / scene->getLights().size();
-		const Emitter* random_emitter = scene->getRandomEmitter(sampler->next1D());
+		float pdf;
+		const Emitter* random_emitter = scene->getLightSampler()->sample(isect.p, isect.shFrame.n, u.lightSelection, pdf);
+		if (!random_emitter)
+			return Color3f(0.0f);
+
+		EmitterQueryRecord eRec;
+		eRec.ref = isect.p;
+		eRec.refNormal = bsdf->getLightSamplingNormal(isect.shFrame.n, -ray.d);
+
+		NORI_STAT(EStatEmitterSamples);
+		Color3f Li = random_emitter->sample(eRec, u.emitter2D, u.emitter1D);
+		if (eRec.pdf == 0.0f)
+			return Color3f(0.0f);
+
+		BSDFQueryRecord bRec(isect.toLocal(-ray.d), isect.toLocal(eRec.wi), ESolidAngle);
+		bRec.uv = isect.uv;
+		NORI_STAT(EStatBSDFEvals);
+		Color3f L_ems = bsdf->eval(bRec) * Li * fabsf(isect.shFrame.n.dot(eRec.wi));
+
+		// The BSDF has no way of generating a direction that would hit a delta light.
+		// Otherwise, MIS against the continuation ray, which could hit any light
+		// (including the light selection probability in the light density)
+		if (!random_emitter->isDelta())
+		{
+			float pdf_e = pdf * eRec.pdf;
+			L_ems *= pdf_e / (bsdf->pdf(bRec) + pdf_e);
+		}
+
+		// Compute shadow ray only when needed
+		if (!L_ems.isValid() || L_ems.isZero())
+			return Color3f(0.0f);
+		if (scene->rayIntersect(Ray3f(isect.p, eRec.wi, Epsilon, (1.0f - Epsilon) * eRec.dist)))
+			return Color3f(0.0f);
+
+		// Divide by the pdf of choosing the random light
+		return L_ems / pdf;
+	}
 
-		// Emitter Sampling
-		// Perform only if not a delta bsdf		
-		if(!bsdf->isDelta())
+	// Estimate Direct Lighting with one MIS-weighted emitter sample per light.
+	// The shadow rays of the emitter samples are tested in batched queries of up to
+	// BVH::OcclusionBatchSize rays, which are kept on the stack.
+	Color3f LiDirectAllLights(const Scene* scene, Sampler* sampler, const Ray3f& ray, const Intersection& isect) const
+	{
+		Color3f L(0.0f);
+		const BSDF* bsdf = isect.mesh->getBSDF();
+		const std::vector<Emitter*>& lights = scene->getLights();
+
+		// Perform only if not a delta bsdf
+		if (bsdf->isDelta())
+			return L;
+
+		Normal3f refNormal = bsdf->getLightSamplingNormal(isect.shFrame.n, -ray.d);
+		const size_t BatchSize = BVH::OcclusionBatchSize;
+		Ray3f shadowRays[BatchSize];
+		Color3f contributions[BatchSize];
+		bool occluded[BatchSize];
+		size_t count = 0;
+
+		auto flush = [&]() {
+			scene->occluded(shadowRays, count, occluded);
+			for (size_t i = 0; i < count; ++i)
+			{
+				if (!occluded[i])
+					L += contributions[i];
+			}
+			count = 0;
+		};
+
+		for (const Emitter* light : lights)
 		{
 			EmitterQueryRecord eRec;
-			float pdf_e, pdf_m;
 			eRec.ref = isect.p;
+			eRec.refNormal = refNormal;
+
+			NORI_STAT(EStatEmitterSamples);
+			Color3f Li = light->sample(eRec, sampler->next2D(), sampler->next1D());
+			float pdf_e = eRec.pdf;
+			if (Li.isZero() || pdf_e == 0.0f)
+				continue;
 
-			Color3f Li = random_emitter->sample(eRec, sampler->next2D(), sampler->next1D());
-			pdf_e = eRec.pdf;
-			
 			BSDFQueryRecord bRec(isect.toLocal(-ray.d), isect.toLocal(eRec.wi), ESolidAngle);
 			bRec.uv = isect.uv;
-			Color3f f = bsdf->eval(bRec);
-			pdf_m = bsdf->pdf(bRec);
-			if (pdf_e != 0.0f)
-			{
-				float mis = pdf_e / (pdf_m + pdf_e);
-
-				// Compute lighting
-				L_ems = f * Li * fabsf(isect.shFrame.n.dot(eRec.wi));
+			NORI_STAT(EStatBSDFEvals);
+			Color3f L_ems = bsdf->eval(bRec) * Li * fabsf(isect.shFrame.n.dot(eRec.wi));
 
-				// Compute shadow ray only when 
-				if (L_ems.isValid() && !L_ems.isZero())
-				{
-					// Trace a shadow ray only now
-					float V = scene->rayIntersect(Ray3f(isect.p, eRec.wi, Epsilon, (1.0f - Epsilon) * eRec.dist)) ? 0.0f : 1.0f;
-					L_ems *= V;
-				}
-				else
-					L_ems = Color3f(0.0f);
-
-
-				if (!random_emitter->isDelta())
-				{
-					// The BSDF has no way of generating a direction that would hit this light
-					// Hence multiply by MIS value only when 
-					L_ems *= mis;
-				}				
-			}			
-		}
-				
-		// BSDF sampling
-		// If the chosen light was a delta light, we can't expect the BSDF to sample a direction that will hit the light
-		if (!random_emitter->isDelta())
-		{
-			BSDFQueryRecord bRec(isect.toLocal(-ray.d));
-			bRec.uv = isect.uv;
-			Color3f f = bsdf->sample(bRec, sampler->next2D(), sampler->next1D());
-			float pdf_m = bRec.pdf;
+			// The BSDF has no way of generating a direction that would hit a delta light
+			if (!light->isDelta())
+				L_ems *= pdf_e / (bsdf->pdf(bRec) + pdf_e);
 
-			if (!f.isZero() && pdf_m != 0.0f && !isnan(pdf_m))
+			if (L_ems.isValid() && !L_ems.isZero())
 			{
-				Intersection light_isect;
-				if (scene->rayIntersect(Ray3f(isect.p, isect.toWorld(bRec.wo), Epsilon, INFINITY), light_isect))
-				{
-					// check if a light soruce
-					if (light_isect.mesh->isEmitter() && light_isect.mesh->getEmitter() == random_emitter)
-					{
-						const Emitter* light = light_isect.mesh->getEmitter();
-
-						EmitterQueryRecord eRec;
-						eRec.ref = isect.p;
-						eRec.wi = isect.toWorld(bRec.wo);
-						eRec.n = light_isect.shFrame.n;
-						eRec.emitter = light;
-						eRec.p = light_isect.p;
-						eRec.dist = light_isect.t;
-
-						Color3f Li = light->eval(eRec);
-						float mis = 1.0f;
-
-						// If the BSDF was delta, the light could have never generated this reverse direction
-						if (!bsdf->isDelta())
-						{
-							float pdf_e = light->pdf(eRec);
-							mis = pdf_m / (pdf_m + pdf_e);
-						}
-
-						L_mats = (f * Li * fabsf(Frame::cosTheta(bRec.wo)));
-						L_mats *= mis;
-					}
-				}
+				shadowRays[count] = Ray3f(isect.p, eRec.wi, Epsilon, (1.0f - Epsilon) * eRec.dist);
+				contributions[count] = L_ems;
+				if (++count == BatchSize)
+					flush();
 			}
 		}
-		
-		// Divide by the pdf of choosing the random light
-		return (L_ems + L_mats) / pdf;
+
+		if (count > 0)
+			flush();
+
+		return L;
 	}
 
+	// MIS weight of emission that was found by BSDF sampling the ray 'eRec.ref' -> 'eRec.p'.
+	// 'pdf_m' is the BSDF density of the ray, 'n' the shading normal at its origin.
+	float emissionWeight(const Scene* scene, const Emitter* light, const EmitterQueryRecord& eRec,
+		const Normal3f& n, float pdf_m) const
+	{
+		if (light->isDelta() || isnan(pdf_m))
+			return 1.0f;
+
+		float pdf_e = light->pdf(eRec);
+		if (m_strategy == DirectSamplingStrategy::SAMPLE_ONE_LIGHT)
+			pdf_e *= scene->getLightSampler()->pdf(eRec.ref, n, light);
+		return pdf_m / (pdf_m + pdf_e);
+	}
 
 	Color3f Li(const Scene *scene, Sampler *sampler, const Ray3f &ray) const
 	{
@@ -140,70 +195,82 @@ public:
 		Color3f throughput(1.0f);
 		int depth = 0;
 		Ray3f traced_ray = ray;
-		bool wasLastBounceSpecular = false;
 
-		while (depth < m_maxDepth || m_maxDepth == -1)
+		// Emission is weighted with MIS unless it was found by the camera ray or a specular bounce,
+		// which emitter sampling could not have generated
+		bool wasLastBounceSpecular = true;
+		float lastPdf = 0.0f;
+		Normal3f lastNormal(0.0f), lastRefNormal(0.0f);
+
+		while (true)
 		{
 			// Check if ray misses the scene
 			if (!scene->rayIntersect(traced_ray, isect))
 			{
-				L += throughput * scene->getBackground(traced_ray);
-				break;
-			}
-
-			// Check if direct emitter intersection
-			// return this only if direct hit or previous hit was from a specular surface
-			// because we couldnt have sampled it using a light sampling strategy.
-			if (isect.mesh->isEmitter() && (depth == 0))
-			{
-				//if (depth == 0 || wasLastBounceSpecular)
+				Color3f Le = scene->getBackground(traced_ray);
+				const Emitter* background = scene->getBackgroundEmitter();
+				if (!Le.isZero() && !wasLastBounceSpecular && background)
 				{
 					EmitterQueryRecord eRec;
 					eRec.ref = traced_ray.o;
 					eRec.wi = traced_ray.d;
-					eRec.n = isect.shFrame.n;
-					L += throughput * isect.mesh->getEmitter()->eval(eRec);
+					eRec.dist = INFINITY;
+					eRec.emitter = background;
+					eRec.refNormal = lastRefNormal;
+					Le *= emissionWeight(scene, background, eRec, lastNormal, lastPdf);
 				}
-				//else break;
+				L += throughput * Le;
+				break;
+			}
 
-				// Assume for now we dont bounce off the light sources.				
+			// Emitter hit by the continuation ray: this is the BSDF-sampling half of MIS
+			if (isect.mesh->isEmitter())
+			{
+				const Emitter* light = isect.mesh->getEmitter();
+				EmitterQueryRecord eRec(light, traced_ray.o, isect.p, isect.shFrame.n, isect.primIndex);
+				Color3f Le = light->eval(eRec);
+				if (!Le.isZero() && !wasLastBounceSpecular)
+					Le *= emissionWeight(scene, light, eRec, lastNormal, lastPdf);
+				L += throughput * Le;
 			}
-			
 
-			const BSDF* bsdf = isect.mesh->getBSDF();			
+			// The emission of the last vertex has been accounted for
+			if (depth >= m_maxDepth && m_maxDepth != -1)
+				break;
+
+			const BSDF* bsdf = isect.mesh->getBSDF();
 
 			// NEE
-			Color3f Li = LiDirect(scene, sampler, traced_ray, isect);
-			Color3f debug = throughput * Li;
-			L += throughput * Li;
-						
-			// Sample a reflection ray
+			VertexSamples u(sampler);
+			L += throughput * LiDirect(scene, sampler, traced_ray, isect, u);
+
+			// Sample a reflection ray, which also continues the path
 			BSDFQueryRecord bRec(isect.toLocal(-traced_ray.d));
-			Color3f f = bsdf->sample(bRec, sampler->next2D());
+			bRec.uv = isect.uv;
+			NORI_STAT(EStatBSDFSamples);
+			Color3f f = bsdf->sample(bRec, u.bsdf2D, u.bsdf1D);
 			Vector3f reflected_dir = isect.toWorld(bRec.wo);
 
 			throughput *= f * fabsf(Frame::cosTheta(bRec.wo));
 
 			// Check if specular bounce
 			wasLastBounceSpecular = bsdf->isDelta();
+			lastPdf = bRec.pdf;
+			lastNormal = isect.shFrame.n;
+			lastRefNormal = bsdf->getLightSamplingNormal(isect.shFrame.n, -traced_ray.d);
 
 			// Check if we've reached a zero throughput. No point in proceeding further.
-			if (throughput.isZero())
+			if (throughput.isZero() || !throughput.isValid())
 				break;
 
 			// Check for russian roulette
 			if (depth > m_rrStart)
 			{
-				float rrprob = throughput.getLuminance();
-				if (sampler->next1D() > rrprob)
+				float rrprob = std::min(throughput.getLuminance(), 1.0f);
+				if (u.roulette > rrprob)
 					break;
 				else throughput /= rrprob;
 			}
-			else if (depth > m_maxDepth && m_maxDepth != -1)
-			{
-				// forcibly terminate
-				break;
-			}
 
 			// Propogate
 			traced_ray = Ray3f(isect.p, reflected_dir, Epsilon, INFINITY);
@@ -215,7 +282,8 @@ public:
 
 	std::string toString() const
 	{
-		return tfm::format("PathIntegratorMis[\nrrStart = %d\n]", m_rrStart);
+		return tfm::format("PathIntegratorMis[\nrrStart = %d\nstrategy = %s\n]", m_rrStart,
+			m_strategy == DirectSamplingStrategy::SAMPLE_ALL_LIGHTS ? "sample_all_lights" : "sample_one_light");
 	}
 
 private:
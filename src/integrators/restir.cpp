@@ -0,0 +1,410 @@
+#include <nori/bsdf.h>
+#include <nori/camera.h>
+#include <nori/integrator.h>
+#include <nori/scene.h>
+#include <nori/sampler.h>
+#include <nori/memory.h>
+#include <nori/stats.h>
+#include <nori/warp.h>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Direct illumination with reservoir-based spatiotemporal importance resampling
+ *
+ * Implements ReSTIR DI (Bitterli et al., "Spatiotemporal reservoir resampling
+ * for real-time ray tracing with dynamic direct lighting", 2020). For each
+ * camera ray, many cheap light candidates are drawn from the scene's light
+ * sampler and \ref Emitter::sample(), and one of them is chosen by weighted
+ * reservoir sampling proportionally to its unshadowed contribution. The
+ * reservoir is then combined with the reservoir of the same pixel in the
+ * previous pass (temporal reuse) and with those of a few random neighbors
+ * within \c spatialRadius pixels (spatial reuse). Only the finally selected
+ * light sample is traced as a shadow ray.
+ *
+ * Reused reservoirs are normalized with the unbiased 1/Z weights of the
+ * paper: the candidate counts of all reservoirs whose surface could have
+ * produced the selected sample (i.e. whose unshadowed target function is
+ * nonzero for it) are summed. Since the target function does not include
+ * visibility, no extra shadow rays are needed for this and the estimate
+ * of each pass remains unbiased. Neighbors are only reused if their normal
+ * and depth are similar, and the history length is capped to
+ * \c maxHistory times the candidate count.
+ *
+ * Reservoirs are kept in a double-buffered per-pixel array: pass \c k
+ * writes to one buffer and reads the reservoirs of pass <tt>k-1</tt> from
+ * the other, which the renderer has completely written before the pass.
+ * Without pixel information (\ref Li()), only the initial candidates of
+ * the current ray are used.
+ */
+class ReSTIRIntegrator : public Integrator
+{
+public:
+	ReSTIRIntegrator(const PropertyList& prop)
+	{
+		m_candidates = prop.getInteger("candidates", 32);
+		m_spatialSamples = prop.getInteger("spatialSamples", 3);
+		m_spatialRadius = prop.getFloat("spatialRadius", 20.0f);
+		m_temporal = prop.getBoolean("temporal", true);
+		m_maxHistory = prop.getInteger("maxHistory", 20);
+
+		if (m_candidates < 1)
+			throw NoriException("ReSTIRIntegrator: 'candidates' must be positive!");
+		if (m_spatialSamples < 0 || m_spatialSamples > MaxSpatialSamples || m_maxHistory < 1)
+			throw NoriException("ReSTIRIntegrator: invalid reuse settings ('spatialSamples' must be in [0, %i])!",
+				(int) MaxSpatialSamples);
+	}
+
+	void beginRender(const std::vector<const Camera *> &cameras)
+	{
+		size_t bytes = 0;
+		m_views.clear();
+		m_views.resize(cameras.size());
+		for (size_t i = 0; i < cameras.size(); ++i)
+		{
+			ViewState &view = m_views[i];
+			view.size = cameras[i]->getOutputSize();
+			for (int k = 0; k < 2; ++k)
+				view.pixels[k].assign((size_t) view.size.x() * view.size.y(), PixelState());
+			bytes += 2 * view.pixels[0].size() * sizeof(PixelState);
+		}
+		m_memory.set(bytes);
+	}
+
+	Color3f Li(const Scene *scene, Sampler *sampler, const Ray3f &ray) const
+	{
+		return shade(scene, sampler, ray, nullptr);
+	}
+
+	Color3f LiPixel(const Scene *scene, Sampler *sampler, const Ray3f &ray, const PixelQuery &query) const
+	{
+		if (query.view >= m_views.size())
+			return shade(scene, sampler, ray, nullptr);
+		return shade(scene, sampler, ray, &query);
+	}
+
+	std::string toString() const
+	{
+		return tfm::format("ReSTIRIntegrator[candidates=%i, spatialSamples=%i, spatialRadius=%f, temporal=%s, maxHistory=%i]",
+			m_candidates, m_spatialSamples, m_spatialRadius, m_temporal ? "true" : "false", m_maxHistory);
+	}
+
+private:
+	/// Upper bound of \c spatialSamples, which sizes the neighbor arrays of \ref reuse()
+	static const int MaxSpatialSamples = 16;
+
+	enum ELightKind { EDelta, EArea, EDirection };
+
+	/// A light sample that can be evaluated from any shading point
+	struct LightSample
+	{
+		const Emitter *emitter = nullptr;
+		ELightKind kind = EDelta;
+		/// Position and normal on area lights
+		Point3f p;
+		Normal3f n;
+		/// Direction towards lights at infinity
+		Vector3f wi;
+	};
+
+	/// Shading point of a reservoir, needed to evaluate the target function there
+	struct Surface
+	{
+		Point3f p;
+		Frame frame;
+		Vector3f wo;
+		Point2f uv;
+		const BSDF *bsdf = nullptr;
+		float depth = 0.0f;
+	};
+
+	struct Reservoir
+	{
+		LightSample y;
+		float wSum = 0.0f;
+		float M = 0.0f;
+		/// Unbiased contribution weight of y
+		float W = 0.0f;
+
+		/// Stream the sample y with weight w and candidate count m into the reservoir
+		bool update(const LightSample &sample, float w, float m, float u)
+		{
+			wSum += w;
+			M += m;
+			if (w > 0.0f && u * wSum < w)
+			{
+				y = sample;
+				return true;
+			}
+			return false;
+		}
+	};
+
+	struct PixelState
+	{
+		Surface surface;
+		Reservoir reservoir;
+		/// Pass that wrote this state
+		uint32_t pass = 0;
+		bool valid = false;
+	};
+
+	struct ViewState
+	{
+		Vector2i size = Vector2i(0, 0);
+		std::vector<PixelState> pixels[2];
+	};
+
+	Color3f shade(const Scene *scene, Sampler *sampler, const Ray3f &ray, const PixelQuery *query) const
+	{
+		Intersection its;
+		if (!scene->rayIntersect(ray, its))
+			return scene->getBackground(ray);
+
+		Color3f L(0.0f);
+		if (its.mesh->isEmitter())
+		{
+			const Emitter *e = its.mesh->getEmitter();
+			EmitterQueryRecord eRec(e, ray.o, its.p, its.shFrame.n);
+			L += e->eval(eRec);
+		}
+
+		Surface x;
+		x.p = its.p;
+		x.frame = its.shFrame;
+		x.wo = -ray.d;
+		x.uv = its.uv;
+		x.bsdf = its.mesh->getBSDF();
+		x.depth = its.t;
+
+		PixelState *state = nullptr;
+		if (query)
+		{
+			const ViewState &view = m_views[query->view];
+			size_t index = (size_t) query->pixel.y() * view.size.x() + query->pixel.x();
+			/* Writing through the const method is safe: the renderer assigns
+			   each pixel of a pass to exactly one thread, so this slot of the
+			   write buffer has a single writer, and no thread reads the write
+			   buffer before the pass is complete */
+			state = &m_views[query->view].pixels[query->pass & 1][index];
+			state->valid = false;
+		}
+		// Delta BSDFs can not be connected to light samples
+		if (x.bsdf->isDelta())
+			return L;
+
+		/* Resample the initial candidates */
+		const LightSampler *lightSampler = scene->getLightSampler();
+		Reservoir r;
+		for (int i = 0; i < m_candidates; ++i)
+		{
+			// Light selection, emitter and resampling components in one call
+			float u1D[3];
+			sampler->next1DArray(u1D, 3);
+			Point2f u = sampler->next2D();
+			float u1 = u1D[1], uResample = u1D[2];
+
+			float selectionPdf;
+			const Emitter *e = lightSampler->sample(x.p, x.frame.n, u1D[0], selectionPdf);
+			if (!e || selectionPdf == 0.0f)
+			{
+				r.M += 1.0f;
+				continue;
+			}
+
+			EmitterQueryRecord eRec(x.p);
+			eRec.refNormal = x.bsdf->getLightSamplingNormal(x.frame.n, x.wo);
+			NORI_STAT(EStatEmitterSamples);
+			Color3f value = e->sample(eRec, u, u1);
+
+			// The ratio of target and source density, in which the measure conversion cancels
+			float w = 0.0f;
+			if (!value.isZero() && value.isValid())
+			{
+				w = Color3f(bsdfCos(x, eRec.wi) * value).getLuminance() / selectionPdf;
+				if (!std::isfinite(w) || w < 0.0f)
+					w = 0.0f;
+			}
+			r.update(makeSample(e, eRec), w, 1.0f, uResample);
+		}
+		float targetPdf = r.wSum > 0.0f ? contribution(x, r.y).getLuminance() : 0.0f;
+		r.W = targetPdf > 0.0f ? r.wSum / (r.M * targetPdf) : 0.0f;
+
+		/* Spatiotemporal reuse of the reservoirs of the previous pass */
+		if (query && query->pass > 0)
+			r = reuse(sampler, x, r, *query);
+
+		if (state)
+		{
+			state->surface = x;
+			state->reservoir = r;
+			state->pass = query->pass;
+			state->valid = true;
+		}
+
+		/* Trace a single shadow ray towards the selected sample */
+		if (r.W > 0.0f)
+		{
+			Vector3f wi;
+			float dist;
+			Color3f f = contribution(x, r.y, &wi, &dist);
+			if (!f.isZero() && f.isValid() &&
+				!scene->rayIntersect(Ray3f(x.p, wi, Epsilon, (1.0f - Epsilon) * dist)))
+				L += f * r.W;
+		}
+
+		return L;
+	}
+
+	Reservoir reuse(Sampler *sampler, const Surface &x, const Reservoir &current, const PixelQuery &query) const
+	{
+		const ViewState &view = m_views[query.view];
+		const std::vector<PixelState> &previous = view.pixels[(query.pass - 1) & 1];
+		float maxM = (float) (m_maxHistory * m_candidates);
+
+		auto lookup = [&](const Point2i &pixel) -> const PixelState * {
+			if (pixel.x() < 0 || pixel.y() < 0 || pixel.x() >= view.size.x() || pixel.y() >= view.size.y())
+				return nullptr;
+			const PixelState &state = previous[(size_t) pixel.y() * view.size.x() + pixel.x()];
+			if (!state.valid || state.pass + 1 != query.pass)
+				return nullptr;
+			return &state;
+		};
+
+		/* At most the temporal and all spatial neighbors */
+		const PixelState *neighbors[1 + MaxSpatialSamples];
+		float counts[1 + MaxSpatialSamples];
+		size_t neighborCount = 0;
+		if (m_temporal)
+		{
+			if (const PixelState *state = lookup(query.pixel))
+				neighbors[neighborCount++] = state;
+		}
+		for (int i = 0; i < m_spatialSamples; ++i)
+		{
+			Point2f offset = Warp::squareToUniformDisk(sampler->next2D()) * m_spatialRadius;
+			Point2i pixel(query.pixel.x() + (int) std::round(offset.x()), query.pixel.y() + (int) std::round(offset.y()));
+			if (pixel == query.pixel)
+				continue;
+			const PixelState *state = lookup(pixel);
+			if (state && isSimilar(x, state->surface))
+				neighbors[neighborCount++] = state;
+		}
+
+		/* Combine the reservoirs, reweighting their samples for this shading point */
+		Reservoir s;
+		s.update(current.y, current.wSum, current.M, sampler->next1D());
+		for (size_t i = 0; i < neighborCount; ++i)
+		{
+			const Reservoir &ri = neighbors[i]->reservoir;
+			counts[i] = std::min(ri.M, maxM);
+			float w = ri.W > 0.0f ? contribution(x, ri.y).getLuminance() * ri.W * counts[i] : 0.0f;
+			s.update(ri.y, std::isfinite(w) ? w : 0.0f, counts[i], sampler->next1D());
+		}
+
+		float targetPdf = s.wSum > 0.0f ? contribution(x, s.y).getLuminance() : 0.0f;
+		if (targetPdf <= 0.0f)
+		{
+			s.W = 0.0f;
+			return s;
+		}
+
+		/* Unbiased normalization: count the reservoirs that could have produced y */
+		float Z = current.M;
+		for (size_t i = 0; i < neighborCount; ++i)
+		{
+			if (contribution(neighbors[i]->surface, s.y).getLuminance() > 0.0f)
+				Z += counts[i];
+		}
+		s.W = s.wSum / (Z * targetPdf);
+		return s;
+	}
+
+	/// Geometric similarity test for spatial reuse
+	bool isSimilar(const Surface &a, const Surface &b) const
+	{
+		return a.frame.n.dot(b.frame.n) > 0.9f && std::abs(a.depth - b.depth) < 0.1f * a.depth;
+	}
+
+	LightSample makeSample(const Emitter *e, const EmitterQueryRecord &eRec) const
+	{
+		LightSample y;
+		y.emitter = e;
+		if (e->isDelta())
+			y.kind = EDelta;
+		else if (e->getEmitterType() == EmitterType::EMITTER_AREA)
+			y.kind = EArea;
+		else
+			y.kind = EDirection;
+		y.p = eRec.p;
+		y.n = eRec.n;
+		y.wi = eRec.wi;
+		return y;
+	}
+
+	/// BSDF value times the cosine at the shading point
+	Color3f bsdfCos(const Surface &x, const Vector3f &wi) const
+	{
+		BSDFQueryRecord bRec(x.frame.toLocal(x.wo), x.frame.toLocal(wi), ESolidAngle);
+		bRec.p = x.p;
+		bRec.uv = x.uv;
+		NORI_STAT(EStatBSDFEvals);
+		return x.bsdf->eval(bRec) * fabsf(x.frame.n.dot(wi));
+	}
+
+	/**
+	 * \brief Unshadowed contribution of a light sample to a shading point
+	 *
+	 * This is the integrand in the measure of the light sample (area for
+	 * area lights, solid angle for lights at infinity, counting for point
+	 * lights), so that samples can be shared between shading points.
+	 * Its luminance is the target function of the resampling.
+	 */
+	Color3f contribution(const Surface &x, const LightSample &y, Vector3f *wiOut = nullptr, float *distOut = nullptr) const
+	{
+		if (!y.emitter || !x.bsdf || x.bsdf->isDelta())
+			return Color3f(0.0f);
+
+		EmitterQueryRecord eRec(x.p);
+		Color3f Le;
+		switch (y.kind)
+		{
+		case EDelta:
+			// Point lights are deterministic, the returned value includes the falloff
+			Le = y.emitter->sample(eRec, Point2f(0.5f, 0.5f), 0.5f);
+			break;
+		case EArea:
+			eRec = EmitterQueryRecord(y.emitter, x.p, y.p, y.n);
+			if (eRec.dist <= 0.0f)
+				return Color3f(0.0f);
+			Le = y.emitter->eval(eRec) * (fabsf(y.n.dot(eRec.wi)) / (eRec.dist * eRec.dist));
+			break;
+		default:
+			eRec.wi = y.wi;
+			eRec.dist = INFINITY;
+			Le = y.emitter->eval(eRec);
+			break;
+		}
+		if (wiOut)
+			*wiOut = eRec.wi;
+		if (distOut)
+			*distOut = eRec.dist;
+		if (Le.isZero())
+			return Color3f(0.0f);
+		return bsdfCos(x, eRec.wi) * Le;
+	}
+
+	int m_candidates;
+	int m_spatialSamples;
+	float m_spatialRadius;
+	bool m_temporal;
+	int m_maxHistory;
+
+	/* Per-pixel reservoirs. Written by LiPixel(), where every thread only
+	   writes the pixels that it renders in the current pass */
+	mutable std::vector<ViewState> m_views;
+	MemoryRecord m_memory { EMemIntegrator };
+};
+
+NORI_REGISTER_CLASS(ReSTIRIntegrator, "restir");
+NORI_NAMESPACE_END
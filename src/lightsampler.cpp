@@ -0,0 +1,414 @@
+#include <nori/lightsampler.h>
+#include <nori/dpdf.h>
+#include <nori/trace.h>
+#include <Eigen/Geometry>
+#include <algorithm>
+
+NORI_NAMESPACE_BEGIN
+
+namespace {
+    const float OneMinusEpsilon = 0.99999994f;
+
+    float safeSqrt(float value) { return std::sqrt(std::max(value, 0.f)); }
+
+    /// cos(max(0, a - b)) given the sines and cosines of a and b
+    float cosSubClamped(float sinA, float cosA, float sinB, float cosB) {
+        return cosA > cosB ? 1.f : cosA * cosB + sinA * sinB;
+    }
+
+    /// sin(max(0, a - b)) given the sines and cosines of a and b
+    float sinSubClamped(float sinA, float cosA, float sinB, float cosB) {
+        return cosA > cosB ? 0.f : sinA * cosB - cosA * sinB;
+    }
+
+    /// Rotate \c v by \c angle around the (normalized) axis \c axis
+    Vector3f rotate(const Vector3f &v, const Vector3f &axis, float angle) {
+        float sinAngle = std::sin(angle), cosAngle = std::cos(angle);
+        return v * cosAngle + axis.cross(v) * sinAngle + axis * axis.dot(v) * (1 - cosAngle);
+    }
+
+    /// Merge the bounds of two sets of lights
+    LightBounds merge(const LightBounds &a, const LightBounds &b) {
+        if (a.power == 0)
+            return b;
+        if (b.power == 0)
+            return a;
+        DirectionCone cone = DirectionCone::merge(DirectionCone(a.axis, a.cosThetaO),
+                                                  DirectionCone(b.axis, b.cosThetaO));
+        LightBounds result;
+        result.bbox = BoundingBox3f::merge(a.bbox, b.bbox);
+        result.axis = cone.axis;
+        result.cosThetaO = cone.cosTheta;
+        result.cosThetaE = std::min(a.cosThetaE, b.cosThetaE);
+        result.power = a.power + b.power;
+        result.twoSided = a.twoSided || b.twoSided;
+        return result;
+    }
+
+    /**
+     * Estimate of the light that a set of lights contributes to a shading
+     * point: power over squared distance, times conservative bounds of the
+     * cosines at the light and at the receiver (PBRT v4, Section 12.6.3)
+     */
+    float importance(const LightBounds &bounds, const Point3f &p, const Normal3f &n) {
+        Point3f center = bounds.bbox.getCenter();
+        float radius = 0.5f * bounds.bbox.getExtents().norm();
+        float dist2 = std::max((p - center).squaredNorm(), radius);
+
+        /* Angle between the cone axis and the direction to the shading point */
+        Vector3f wi = (p - center).normalized();
+        float cosThetaW = bounds.axis.dot(wi);
+        if (bounds.twoSided)
+            cosThetaW = std::abs(cosThetaW);
+        if (!std::isfinite(cosThetaW))
+            cosThetaW = 1.f;
+        float sinThetaW = safeSqrt(1 - cosThetaW * cosThetaW);
+
+        /* Angle subtended by the bounding sphere of the lights */
+        float cosThetaB = -1.f;
+        if ((p - center).squaredNorm() > radius * radius)
+            cosThetaB = safeSqrt(1 - radius * radius / (p - center).squaredNorm());
+        float sinThetaB = safeSqrt(1 - cosThetaB * cosThetaB);
+
+        /* Smallest angle between the emission and the shading point */
+        float sinThetaO = safeSqrt(1 - bounds.cosThetaO * bounds.cosThetaO);
+        float cosThetaX = cosSubClamped(sinThetaW, cosThetaW, sinThetaO, bounds.cosThetaO);
+        float sinThetaX = sinSubClamped(sinThetaW, cosThetaW, sinThetaO, bounds.cosThetaO);
+        float cosThetaP = cosSubClamped(sinThetaX, cosThetaX, sinThetaB, cosThetaB);
+        if (cosThetaP <= bounds.cosThetaE)
+            return 0.f;
+
+        float result = bounds.power * cosThetaP / dist2;
+
+        /* Smallest angle between the receiver normal and the lights */
+        if (!n.isZero()) {
+            float cosThetaI = std::abs(wi.dot(n));
+            float sinThetaI = safeSqrt(1 - cosThetaI * cosThetaI);
+            result *= cosSubClamped(sinThetaI, cosThetaI, sinThetaB, cosThetaB);
+        }
+        return std::max(result, 0.f);
+    }
+
+    /// Emitters with finite bounds and nonzero power, and the others
+    void classify(const std::vector<Emitter *> &emitters, std::vector<std::pair<const Emitter *, LightBounds>> &bounded,
+                  std::vector<const Emitter *> &infinite) {
+        for (const Emitter *emitter : emitters) {
+            LightBounds bounds;
+            if (!emitter->getLightBounds(bounds))
+                infinite.push_back(emitter);
+            else if (bounds.power > 0)
+                bounded.emplace_back(emitter, bounds);
+        }
+    }
+}
+
+DirectionCone DirectionCone::merge(const DirectionCone &a, const DirectionCone &b) {
+    if (a.isEmpty())
+        return b;
+    if (b.isEmpty())
+        return a;
+
+    /* Does one cone already contain the other one? */
+    float thetaA = std::acos(clamp(a.cosTheta, -1.f, 1.f)), thetaB = std::acos(clamp(b.cosTheta, -1.f, 1.f));
+    float thetaD = std::acos(clamp(a.axis.dot(b.axis), -1.f, 1.f));
+    if (std::min(thetaD + thetaB, (float) M_PI) <= thetaA)
+        return a;
+    if (std::min(thetaD + thetaA, (float) M_PI) <= thetaB)
+        return b;
+
+    /* Otherwise, rotate the axis of a towards b */
+    float thetaO = (thetaA + thetaD + thetaB) / 2;
+    if (thetaO >= M_PI)
+        return entireSphere();
+    Vector3f rotationAxis = a.axis.cross(b.axis);
+    if (rotationAxis.squaredNorm() == 0)
+        return entireSphere();
+    return DirectionCone(rotate(a.axis, rotationAxis.normalized(), thetaO - thetaA).normalized(),
+                         std::cos(thetaO));
+}
+
+/// Chooses every emitter with the same probability
+class UniformLightSampler : public LightSampler {
+public:
+    UniformLightSampler(const std::vector<Emitter *> &emitters) : m_emitters(emitters.begin(), emitters.end()) { }
+
+    const Emitter *sample(const Point3f &, const Normal3f &, float sample, float &pdf) const {
+        if (m_emitters.empty())
+            return nullptr;
+        size_t index = std::min((size_t) (sample * m_emitters.size()), m_emitters.size() - 1);
+        pdf = 1.f / m_emitters.size();
+        return m_emitters[index];
+    }
+
+    float pdf(const Point3f &, const Normal3f &, const Emitter *) const {
+        return m_emitters.empty() ? 0.f : 1.f / m_emitters.size();
+    }
+
+    std::string toString() const {
+        return tfm::format("UniformLightSampler[emitters=%i]", m_emitters.size());
+    }
+
+private:
+    std::vector<const Emitter *> m_emitters;
+};
+
+/// Chooses emitters proportionally to their power
+class PowerLightSampler : public LightSampler {
+public:
+    PowerLightSampler(const std::vector<Emitter *> &emitters) {
+        std::vector<std::pair<const Emitter *, LightBounds>> bounded;
+        classify(emitters, bounded, m_infinite);
+        for (auto &entry : bounded) {
+            m_index[entry.first] = m_emitters.size();
+            m_emitters.push_back(entry.first);
+            m_pdf.append(entry.second.power);
+        }
+        m_pdf.normalize();
+        m_infiniteProbability = m_infinite.empty() ? 0.f : m_infinite.size() / (float) (m_infinite.size() + (m_emitters.empty() ? 0 : 1));
+        m_memory.set(m_pdf.size() * (sizeof(float) + sizeof(const Emitter *)));
+    }
+
+    const Emitter *sample(const Point3f &, const Normal3f &, float sample, float &pdf) const {
+        if (sample < m_infiniteProbability) {
+            size_t index = std::min((size_t) (sample / m_infiniteProbability * m_infinite.size()), m_infinite.size() - 1);
+            pdf = m_infiniteProbability / m_infinite.size();
+            return m_infinite[index];
+        }
+        if (m_emitters.empty())
+            return nullptr;
+        sample = std::min((sample - m_infiniteProbability) / (1 - m_infiniteProbability), OneMinusEpsilon);
+        size_t index = m_pdf.sample(sample, pdf);
+        pdf *= 1 - m_infiniteProbability;
+        return m_emitters[index];
+    }
+
+    float pdf(const Point3f &, const Normal3f &, const Emitter *emitter) const {
+        auto it = m_index.find(emitter);
+        if (it != m_index.end())
+            return m_pdf[it->second] * (1 - m_infiniteProbability);
+        if (std::find(m_infinite.begin(), m_infinite.end(), emitter) != m_infinite.end())
+            return m_infiniteProbability / m_infinite.size();
+        return 0.f;
+    }
+
+    std::string toString() const {
+        return tfm::format("PowerLightSampler[emitters=%i, infinite=%i]", m_emitters.size(), m_infinite.size());
+    }
+
+private:
+    std::vector<const Emitter *> m_emitters, m_infinite;
+    std::unordered_map<const Emitter *, size_t> m_index;
+    DiscretePDF m_pdf;
+    float m_infiniteProbability;
+    MemoryRecord m_memory { EMemDistributions };
+};
+
+/// Light BVH over the bounds, orientation and power of the emitters
+class BVHLightSampler : public LightSampler {
+public:
+    BVHLightSampler(const std::vector<Emitter *> &emitters) {
+        NORI_TRACE_SCOPE("LightBVH::build", "load");
+        std::vector<std::pair<const Emitter *, LightBounds>> bounded;
+        classify(emitters, bounded, m_infinite);
+        if (!bounded.empty())
+            build(bounded, 0, bounded.size(), 0, 0);
+        m_infiniteProbability = m_infinite.empty() ? 0.f : m_infinite.size() / (float) (m_infinite.size() + (m_nodes.empty() ? 0 : 1));
+        m_memory.set(m_nodes.size() * sizeof(Node) + m_trails.size() * (sizeof(const Emitter *) + sizeof(uint64_t)));
+    }
+
+    const Emitter *sample(const Point3f &ref, const Normal3f &n, float sample, float &pdf) const {
+        if (sample < m_infiniteProbability) {
+            size_t index = std::min((size_t) (sample / m_infiniteProbability * m_infinite.size()), m_infinite.size() - 1);
+            pdf = m_infiniteProbability / m_infinite.size();
+            return m_infinite[index];
+        }
+        if (m_nodes.empty())
+            return nullptr;
+        sample = std::min((sample - m_infiniteProbability) / (1 - m_infiniteProbability), OneMinusEpsilon);
+        pdf = 1 - m_infiniteProbability;
+
+        uint32_t index = 0;
+        if (importance(m_nodes[0].bounds, ref, n) == 0)
+            return nullptr;
+        while (!m_nodes[index].isLeaf) {
+            /* Descend into a child proportionally to its importance */
+            uint32_t left = index + 1, right = m_nodes[index].child;
+            float importanceLeft = importance(m_nodes[left].bounds, ref, n);
+            float importanceRight = importance(m_nodes[right].bounds, ref, n);
+            if (importanceLeft == 0 && importanceRight == 0)
+                return nullptr;
+            float pLeft = importanceLeft / (importanceLeft + importanceRight);
+            if (sample < pLeft) {
+                sample = std::min(sample / pLeft, OneMinusEpsilon);
+                pdf *= pLeft;
+                index = left;
+            } else {
+                sample = std::min((sample - pLeft) / (1 - pLeft), OneMinusEpsilon);
+                pdf *= 1 - pLeft;
+                index = right;
+            }
+        }
+        return m_nodes[index].emitter;
+    }
+
+    float pdf(const Point3f &ref, const Normal3f &n, const Emitter *emitter) const {
+        auto it = m_trails.find(emitter);
+        if (it == m_trails.end()) {
+            if (std::find(m_infinite.begin(), m_infinite.end(), emitter) != m_infinite.end())
+                return m_infiniteProbability / m_infinite.size();
+            return 0.f;
+        }
+
+        /* Follow the path to the emitter's leaf (bit i: right child at depth i) */
+        float pdf = 1 - m_infiniteProbability;
+        uint64_t trail = it->second;
+        uint32_t index = 0;
+        if (importance(m_nodes[0].bounds, ref, n) == 0)
+            return 0.f;
+        while (!m_nodes[index].isLeaf) {
+            uint32_t left = index + 1, right = m_nodes[index].child;
+            float importanceLeft = importance(m_nodes[left].bounds, ref, n);
+            float importanceRight = importance(m_nodes[right].bounds, ref, n);
+            if (importanceLeft == 0 && importanceRight == 0)
+                return 0.f;
+            float pLeft = importanceLeft / (importanceLeft + importanceRight);
+            if (trail & 1) {
+                pdf *= 1 - pLeft;
+                index = right;
+            } else {
+                pdf *= pLeft;
+                index = left;
+            }
+            trail >>= 1;
+        }
+        return pdf;
+    }
+
+    std::string toString() const {
+        return tfm::format("BVHLightSampler[emitters=%i, infinite=%i, nodes=%i]",
+                           m_trails.size(), m_infinite.size(), m_nodes.size());
+    }
+
+private:
+    struct Node {
+        LightBounds bounds;
+        bool isLeaf;
+        uint32_t child;            ///< Index of the right child (the left one follows its parent)
+        const Emitter *emitter;    ///< Emitter of a leaf
+    };
+
+    /* Cost of a node in the surface area orientation heuristic */
+    static float cost(const LightBounds &bounds, const BoundingBox3f &parentBox, int axis) {
+        float thetaO = std::acos(clamp(bounds.cosThetaO, -1.f, 1.f));
+        float thetaE = std::acos(clamp(bounds.cosThetaE, -1.f, 1.f));
+        float thetaW = std::min(thetaO + thetaE, (float) M_PI);
+        float sinThetaO = safeSqrt(1 - bounds.cosThetaO * bounds.cosThetaO);
+        float orientation = 2 * M_PI * (1 - bounds.cosThetaO) + M_PI / 2 *
+            (2 * thetaW * sinThetaO - std::cos(thetaO - 2 * thetaW) - 2 * thetaO * sinThetaO + bounds.cosThetaO);
+        Vector3f extents = parentBox.getExtents();
+        float regularization = extents[axis] > 0 ? extents.maxCoeff() / extents[axis] : 1.f;
+        return bounds.power * orientation * regularization * bounds.bbox.getSurfaceArea();
+    }
+
+    /// Build the subtree of lights [begin, end) and return the index of its root
+    uint32_t build(std::vector<std::pair<const Emitter *, LightBounds>> &lights, size_t begin, size_t end,
+                   uint64_t trail, int depth) {
+        uint32_t index = (uint32_t) m_nodes.size();
+        m_nodes.emplace_back();
+
+        if (end - begin == 1) {
+            m_nodes[index].bounds = lights[begin].second;
+            m_nodes[index].isLeaf = true;
+            m_nodes[index].emitter = lights[begin].first;
+            m_trails[lights[begin].first] = trail;
+            return index;
+        }
+
+        LightBounds bounds;
+        BoundingBox3f centroids;
+        for (size_t i = begin; i < end; ++i) {
+            bounds = merge(bounds, lights[i].second);
+            centroids.expandBy(lights[i].second.bbox.getCenter());
+        }
+
+        /* Evaluate the split cost on a fixed number of buckets per axis */
+        const int BucketCount = 12;
+        float bestCost = std::numeric_limits<float>::infinity();
+        int bestAxis = -1, bestBucket = -1;
+        for (int axis = 0; axis < 3 && depth < 32; ++axis) {
+            float extent = centroids.max[axis] - centroids.min[axis];
+            if (extent <= 0)
+                continue;
+            LightBounds buckets[BucketCount];
+            for (size_t i = begin; i < end; ++i) {
+                float offset = (lights[i].second.bbox.getCenter()[axis] - centroids.min[axis]) / extent;
+                int b = std::min((int) (offset * BucketCount), BucketCount - 1);
+                buckets[b] = merge(buckets[b], lights[i].second);
+            }
+            for (int split = 0; split < BucketCount - 1; ++split) {
+                LightBounds below, above;
+                for (int b = 0; b <= split; ++b)
+                    below = merge(below, buckets[b]);
+                for (int b = split + 1; b < BucketCount; ++b)
+                    above = merge(above, buckets[b]);
+                float c = (below.power > 0 ? cost(below, bounds.bbox, axis) : 0.f) +
+                          (above.power > 0 ? cost(above, bounds.bbox, axis) : 0.f);
+                if (c > 0 && c < bestCost) {
+                    bestCost = c;
+                    bestAxis = axis;
+                    bestBucket = split;
+                }
+            }
+        }
+
+        size_t middle;
+        if (bestAxis >= 0) {
+            float extent = centroids.max[bestAxis] - centroids.min[bestAxis];
+            auto it = std::partition(lights.begin() + begin, lights.begin() + end,
+                [&](const std::pair<const Emitter *, LightBounds> &light) {
+                    float offset = (light.second.bbox.getCenter()[bestAxis] - centroids.min[bestAxis]) / extent;
+                    return std::min((int) (offset * BucketCount), BucketCount - 1) <= bestBucket;
+                });
+            middle = it - lights.begin();
+        } else {
+            middle = begin;
+        }
+        if (middle == begin || middle == end) {
+            /* Degenerate split (or a very deep tree): split in the middle */
+            middle = (begin + end) / 2;
+            int axis = centroids.getLargestAxis();
+            std::nth_element(lights.begin() + begin, lights.begin() + middle, lights.begin() + end,
+                [axis](const std::pair<const Emitter *, LightBounds> &a,
+                       const std::pair<const Emitter *, LightBounds> &b) {
+                    return a.second.bbox.getCenter()[axis] < b.second.bbox.getCenter()[axis];
+                });
+        }
+
+        if (depth >= 64)
+            throw NoriException("BVHLightSampler: the light BVH is too deep!");
+        build(lights, begin, middle, trail, depth + 1);
+        uint32_t right = build(lights, middle, end, trail | ((uint64_t) 1 << depth), depth + 1);
+        m_nodes[index].bounds = bounds;
+        m_nodes[index].isLeaf = false;
+        m_nodes[index].child = right;
+        return index;
+    }
+
+    std::vector<Node> m_nodes;
+    std::vector<const Emitter *> m_infinite;
+    std::unordered_map<const Emitter *, uint64_t> m_trails;
+    float m_infiniteProbability;
+    MemoryRecord m_memory { EMemDistributions };
+};
+
+std::unique_ptr<LightSampler> LightSampler::create(const std::string &type, const std::vector<Emitter *> &emitters) {
+    if (type == "uniform")
+        return std::unique_ptr<LightSampler>(new UniformLightSampler(emitters));
+    else if (type == "power")
+        return std::unique_ptr<LightSampler>(new PowerLightSampler(emitters));
+    else if (type == "bvh")
+        return std::unique_ptr<LightSampler>(new BVHLightSampler(emitters));
+    throw NoriException("Unknown light sampler \"%s\" (expected uniform, power or bvh)", type);
+}
+
+NORI_NAMESPACE_END
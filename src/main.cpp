@@ -20,11 +20,103 @@
 #include <nori/gui.h>
 #include <nori/optionsparser.h>
 #include <nori/render.h>
+#include <nori/server.h>
+#include <nori/regression.h>
+#include <nori/trace.h>
+#include <nori/memory.h>
 #include <filesystem/path.h>
+#include <fstream>
+#include <cstdlib>
+#include <cstring>
 using namespace nori;
 
+// Exit codes
+enum ExitCode { EXIT_OK = 0, EXIT_FAILURE_RENDER = 1, EXIT_FAILURE_USAGE = 2 };
+
+// Command line options
+enum OptionIndex {
+	UNKNOWN, HELP, SILENT, FILE_, THREADS, OUTPUT, SPP, RESOLUTION, SEED, PROGRESS,
+	CHECKPOINT, RESUME, REGION, TILES, SAMPLES, RAW, SERVER, JOBS, SOCKET, STATS, AOVS, TRACE, MEMORY_BUDGET,
+	REGRESS, UPDATE, REPORT
+};
+
+// Argument checks for the option parser
+struct Arg : public option::Arg
+{
+	static option::ArgStatus Required(const option::Option& option, bool msg)
+	{
+		if (option.arg != 0)
+			return option::ARG_OK;
+		if (msg)
+			cerr << "Error: option '" << std::string(option.name, option.namelen) << "' requires an argument" << endl;
+		return option::ARG_ILLEGAL;
+	}
+
+	static option::ArgStatus Numeric(const option::Option& option, bool msg)
+	{
+		char* endptr = 0;
+		if (option.arg != 0 && strtod(option.arg, &endptr) >= 0 && endptr != option.arg && *endptr == 0)
+			return option::ARG_OK;
+		if (msg)
+			cerr << "Error: option '" << std::string(option.name, option.namelen) << "' requires a non-negative number" << endl;
+		return option::ARG_ILLEGAL;
+	}
+
+	static option::ArgStatus Integer(const option::Option& option, bool msg)
+	{
+		if (option.arg != 0 && *option.arg != 0 && strspn(option.arg, "0123456789") == strlen(option.arg))
+			return option::ARG_OK;
+		if (msg)
+			cerr << "Error: option '" << std::string(option.name, option.namelen) << "' requires a non-negative integer" << endl;
+		return option::ARG_ILLEGAL;
+	}
+};
+
+const option::Descriptor usage[] = {
+	{ UNKNOWN,    0, "",  "",           Arg::None,     "Usage: nori [options] [scene.xml | image.exr]\n\n"
+	                                                   "Opens the scene or image in the GUI unless --silent or --server is given.\n\nOptions:" },
+	{ HELP,       0, "h", "help",       Arg::None,     "  -h, --help  \tPrint usage and exit." },
+	{ SILENT,     0, "s", "silent",     Arg::None,     "  -s, --silent  \tRender without the GUI." },
+	{ FILE_,      0, "f", "file",       Arg::Required, "  -f, --file <scene>  \tScene to render (same as the positional argument)." },
+	{ THREADS,    0, "t", "threads",    Arg::Integer,  "  -t, --threads <n>  \tNumber of rendering threads (default: one per core)." },
+	{ OUTPUT,     0, "o", "output",     Arg::Required, "  -o, --output <file>  \tOutput image (default: next to the scene file)." },
+	{ SPP,        0, "",  "spp",        Arg::Integer,  "  --spp <n>  \tOverride the number of samples per pixel." },
+	{ RESOLUTION, 0, "r", "resolution", Arg::Required, "  -r, --resolution <w>,<h>  \tOverride the image resolution." },
+	{ SEED,       0, "",  "seed",       Arg::Integer,  "  --seed <n>  \tSeed of the sample generator." },
+	{ PROGRESS,   0, "p", "progress",   Arg::Numeric,  "  -p, --progress <sec>  \tProgress report interval in seconds (default: 1, 0 disables)." },
+	{ STATS,      0, "",  "stats",      Arg::Required, "  --stats <file>  \tWrite the render statistics as JSON." },
+	{ AOVS,       0, "",  "aovs",       Arg::None,     "  --aovs  \tAdd per-pixel cost channels (time, BVH nodes, ...) to the output." },
+	{ TRACE,      0, "",  "trace",      Arg::Required, "  --trace <file>  \tWrite a Chrome trace (chrome://tracing) of the load and render phases." },
+	{ REGRESS,    0, "",  "regress",    Arg::Required, "  --regress <suite>  \tRun a render regression suite (see RegressionSuite)." },
+	{ UPDATE,     0, "",  "update",     Arg::None,     "  --update  \tRecord new regression baselines (and missing references)." },
+	{ REPORT,     0, "",  "report",     Arg::Required, "  --report <file>  \tWrite the regression results as JSON." },
+	{ MEMORY_BUDGET, 0, "", "memory-budget", Arg::Numeric, "  --memory-budget <MiB>  \tFail as soon as the renderer needs more memory." },
+	{ CHECKPOINT, 0, "",  "checkpoint", Arg::Numeric,  "  --checkpoint <sec>  \tPeriodically save a checkpoint (scene[_partition].ckpt)." },
+	{ RESUME,     0, "",  "resume",     Arg::Required, "  --resume <file>  \tContinue the rendering stored in a checkpoint." },
+	{ REGION,     0, "",  "region",     Arg::Required, "  --region <x>,<y>,<w>,<h>  \tOnly render the given pixel region." },
+	{ TILES,      0, "",  "tiles",      Arg::Required, "  --tiles <begin>,<end>  \tOnly render the blocks with ids in [begin, end)." },
+	{ SAMPLES,    0, "",  "samples",    Arg::Required, "  --samples <begin>,<end>  \tOnly render the sample indices in [begin, end)." },
+	{ RAW,        0, "",  "raw",        Arg::Required, "  --raw <file>  \tWrite the raw weighted accumulation buffer (merge with imagemerge)." },
+	{ SERVER,     0, "",  "server",     Arg::None,     "  --server  \tKeep the scene loaded and render jobs (see RenderServer)." },
+	{ JOBS,       0, "",  "jobs",       Arg::Required, "  --jobs <file>  \tRead server jobs from a file ('-' for stdin, the default)." },
+	{ SOCKET,     0, "",  "socket",     Arg::Required, "  --socket <path>  \tRead server jobs from a UNIX domain socket." },
+	{ 0, 0, 0, 0, 0, 0 }
+};
+
+// Parse a comma-separated list of exactly 'count' integers
+static std::vector<int> parseIntList(const std::string& str, size_t count)
+{
+	std::vector<std::string> tokens = tokenize(str, ",");
+	if (tokens.size() != count)
+		throw NoriException("Expected %i comma-separated integers, got \"%s\"", count, str);
+	std::vector<int> result;
+	for (auto& token : tokens)
+		result.push_back(toInt(token));
+	return result;
+}
+
 // Launch the gui and render the scene
-int gui_render(int argc, char** argv)
+int gui_render(const std::string& filename)
 {
 	try {
 		nanogui::init();
@@ -34,8 +126,7 @@ int gui_render(int argc, char** argv)
 		NoriScreen *screen = new NoriScreen(block);
 
 		// if file is passed as argument, handle it
-		if (argc == 2) {
-			std::string filename = argv[1];
+		if (!filename.empty()) {
 			filesystem::path path(filename);
 
 			if (path.extension() == "xml") {
@@ -58,64 +149,238 @@ int gui_render(int argc, char** argv)
 	}
 	catch (const std::exception &e) {
 		cerr << "Fatal error: " << e.what() << endl;
-		return -1;
+		return EXIT_FAILURE_RENDER;
 	}
-	return 0;
+	return EXIT_OK;
 }
 
 // Don't create a gui
-// Just render it silently
-int silent_render(std::string& filename)
+// Just render it silently and report the progress
+int silent_render(const std::string& filename, option::Option* options)
 {
+	// Malformed lists are usage errors, parse them before anything is loaded
+	std::vector<int> resolution, region, tiles, samples;
 	try
 	{
-		ImageBlock block(Vector2i(720, 720), nullptr);
+		if (options[RESOLUTION])
+			resolution = parseIntList(options[RESOLUTION].last()->arg, 2);
+		if (options[REGION])
+			region = parseIntList(options[REGION].last()->arg, 4);
+		if (options[TILES])
+			tiles = parseIntList(options[TILES].last()->arg, 2);
+		if (options[SAMPLES])
+			samples = parseIntList(options[SAMPLES].last()->arg, 2);
+	}
+	catch (const std::exception& e)
+	{
+		cerr << "Error: " << e.what() << endl;
+		return EXIT_FAILURE_USAGE;
+	}
 
-		// Just ask render thread to render it
+	try
+	{
+		ImageBlock block(Vector2i(720, 720), nullptr);
 		RenderThread m_thread(block);
-		m_thread.renderScene(filename);
-		while (m_thread.isBusy())
+
+		if (options[THREADS])
+			m_thread.setThreadCount(toInt(options[THREADS].last()->arg));
+		if (options[OUTPUT])
+			m_thread.setOutputName(options[OUTPUT].last()->arg);
+		if (options[SPP])
+			m_thread.setSampleCount(toInt(options[SPP].last()->arg));
+		if (options[RESOLUTION])
+			m_thread.setResolution(Vector2i(resolution[0], resolution[1]));
+		if (options[SEED])
+			m_thread.setSeed(strtoull(options[SEED].last()->arg, nullptr, 10));
+		if (options[CHECKPOINT])
+			m_thread.setCheckpointInterval(toFloat(options[CHECKPOINT].last()->arg));
+		if (options[RESUME])
+			m_thread.setResumeFile(options[RESUME].last()->arg);
+		if (options[RAW])
+			m_thread.setRawOutput(options[RAW].last()->arg);
+		if (options[STATS])
+			m_thread.setStatsFile(options[STATS].last()->arg);
+		if (options[AOVS])
+			m_thread.setCostAOVs(true);
+
+		RenderPartition partition;
+		if (options[REGION])
+			partition.region = BoundingBox2i(Point2i(region[0], region[1]),
+				Point2i(region[0] + region[2] - 1, region[1] + region[3] - 1));
+		if (options[TILES])
 		{
-			std::cout << "\rProgress : " << m_thread.getProgress();
+			partition.tileBegin = tiles[0];
+			partition.tileEnd = tiles[1];
 		}
+		if (options[SAMPLES])
+		{
+			partition.sampleBegin = samples[0];
+			partition.sampleEnd = samples[1];
+		}
+		m_thread.setPartition(partition);
+
+		float progressInterval = options[PROGRESS] ? toFloat(options[PROGRESS].last()->arg) : 1.f;
+		if (progressInterval > 0)
+		{
+			m_thread.setProgressCallback([](const RenderProgress& p)
+			{
+				cout << tfm::format("\rProgress: %5.1f%%, %.2f Msamples/s, elapsed %s, ETA %s    ",
+					100.f * p.progress, p.samplesPerSecond * 1e-6,
+					timeString(p.elapsed), timeString(p.remaining));
+				if (p.progress >= 1.f)
+					cout << endl;
+				cout.flush();
+			}, progressInterval);
+		}
+
+		// Render and wait for it to finish
+		m_thread.renderScene(filename);
+		m_thread.wait();
+		if (!m_thread.getError().empty())
+			return EXIT_FAILURE_RENDER;
 	}
 	catch (const std::exception& e)
 	{
 		cerr << "Fatal Error : " << e.what() << endl;
-		return -1;
+		return EXIT_FAILURE_RENDER;
 	}
 
-	return 0;
+	return EXIT_OK;
 }
 
-
-int main(int argc, char **argv) {
-
-	// for now, check if a -s flag is present
-	// if so, call silent code;
-	// NOTE: CRAPPY.!!! TOO MANY BUGS POSSIBLE.!!
-	bool silent = false;
-	std::string filename;
-	for (int i = 0; i < argc; i++)
+// Keep the scene resident and render jobs from a job file, stdin or a socket
+int server_render(const std::string& filename, option::Option* options)
+{
+	try
 	{
-		if (std::string(argv[i]) == "-s")
+		RenderServer server(filename);
+		int failures;
+		std::string jobFile = options[JOBS] ? options[JOBS].last()->arg : "-";
+		if (options[SOCKET])
 		{
-			silent = true;
+			failures = server.serveSocket(options[SOCKET].last()->arg);
 		}
-		if (std::string(argv[i]) == "-f")
+		else if (jobFile == "-")
 		{
-			filename = std::string(argv[i + 1]);
+			failures = server.serve(std::cin, std::cout);
 		}
+		else
+		{
+			std::ifstream jobs(jobFile);
+			if (!jobs)
+				throw NoriException("Unable to open job file \"%s\"", jobFile);
+			failures = server.serve(jobs, std::cout);
+		}
+		return failures == 0 ? EXIT_OK : EXIT_FAILURE_RENDER;
 	}
+	catch (const std::exception& e)
+	{
+		cerr << "Fatal Error : " << e.what() << endl;
+		return EXIT_FAILURE_RENDER;
+	}
+}
+
+// Render the cases of a regression suite and compare them against their baselines
+int regression_render(option::Option* options)
+{
+	try
+	{
+		RegressionSuite suite(options[REGRESS].last()->arg);
+		int failures = suite.run(options[UPDATE] != nullptr);
+		if (options[REPORT])
+		{
+			std::ofstream report(options[REPORT].last()->arg);
+			report << suite.toJSON();
+			if (!report)
+				throw NoriException("Unable to write \"%s\"", options[REPORT].last()->arg);
+		}
+		return failures == 0 ? EXIT_OK : EXIT_FAILURE_RENDER;
+	}
+	catch (const std::exception& e)
+	{
+		cerr << "Fatal Error : " << e.what() << endl;
+		return EXIT_FAILURE_RENDER;
+	}
+}
+
+int main(int argc, char **argv) {
+	// Skip the program name
+	argc -= (argc > 0);
+	argv += (argc > 0);
+
+	option::Stats stats(usage, argc, argv);
+	std::vector<option::Option> options(stats.options_max), buffer(stats.buffer_max);
+	option::Parser parse(usage, argc, argv, options.data(), buffer.data());
+
+	if (parse.error())
+		return EXIT_FAILURE_USAGE;
+
+	if (options[HELP])
+	{
+		option::printUsage(std::cout, usage);
+		return EXIT_OK;
+	}
+
+	for (option::Option* opt = options[UNKNOWN]; opt; opt = opt->next())
+	{
+		cerr << "Error: unknown option '" << opt->name << "'" << endl;
+		return EXIT_FAILURE_USAGE;
+	}
+
+	std::string filename;
+	if (options[FILE_])
+		filename = options[FILE_].last()->arg;
+	else if (parse.nonOptionsCount() > 0)
+		filename = parse.nonOption(0);
+
+	if ((options[SILENT] || options[SERVER]) && filename.empty())
+	{
+		cerr << "Error: no scene file was specified" << endl;
+		option::printUsage(std::cerr, usage);
+		return EXIT_FAILURE_USAGE;
+	}
+
+	if (options[MEMORY_BUDGET])
+		MemoryAccounting::setBudget((size_t) (toFloat(options[MEMORY_BUDGET].last()->arg) * 1024 * 1024));
 
-    // call appropriate function
+	if (options[TRACE])
+	{
+		Trace::enable();
+		Trace::setThreadName("main");
+	}
+
+	// call appropriate function
 	// and return the correct code
-	if (silent)
+	try
 	{
-		silent_render(filename);
+		int result;
+		if (options[REGRESS])
+			result = regression_render(options.data());
+		else if (options[SERVER])
+			result = server_render(filename, options.data());
+		else if (options[SILENT])
+			result = silent_render(filename, options.data());
+		else
+			result = gui_render(filename);
+
+		if (options[TRACE])
+		{
+			try
+			{
+				Trace::save(options[TRACE].last()->arg);
+			}
+			catch (const std::exception& e)
+			{
+				cerr << "Error: " << e.what() << endl;
+				result = EXIT_FAILURE_RENDER;
+			}
+		}
+		return result;
 	}
-	else
+	catch (const std::exception& e)
 	{
-		gui_render(argc, argv);
+		// Invalid option values (e.g. malformed lists)
+		cerr << "Error: " << e.what() << endl;
+		return EXIT_FAILURE_USAGE;
 	}
 }
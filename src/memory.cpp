@@ -0,0 +1,122 @@
+#include <nori/memory.h>
+#include <tbb/mutex.h>
+
+NORI_NAMESPACE_BEGIN
+
+/* Allocations are rare (scene loading, image blocks), so a single lock suffices */
+namespace {
+    struct Accounts {
+        tbb::mutex mutex;
+        size_t usage[EMemCategoryCount] = { };
+        size_t peakUsage[EMemCategoryCount] = { };
+        size_t total = 0, peak = 0, budget = 0;
+    };
+
+    Accounts &accounts() {
+        static Accounts *accounts = new Accounts(); /* Never destroyed: records may be released late */
+        return *accounts;
+    }
+
+    std::string breakdown(const size_t *usage, size_t total) {
+        std::string result;
+        for (int i = 0; i < EMemCategoryCount; ++i) {
+            if (usage[i] == 0)
+                continue;
+            result += tfm::format("  %-14s %10s (%4.1f%%)\n",
+                MemoryAccounting::categoryName((EMemCategory) i), memString(usage[i]),
+                total > 0 ? usage[i] * 100.0 / total : 0.0);
+        }
+        result += tfm::format("  %-14s %10s", "total", memString(total));
+        return result;
+    }
+}
+
+void MemoryAccounting::allocate(EMemCategory category, size_t bytes) {
+    Accounts &acc = accounts();
+    tbb::mutex::scoped_lock lock(acc.mutex);
+
+    if (acc.budget > 0 && acc.total + bytes > acc.budget) {
+        std::string usage = breakdown(acc.usage, acc.total);
+        lock.release();
+        throw NoriException("Memory budget of %s exceeded: %s needs another %s, "
+            "but %s are already in use:\n%s", memString(acc.budget), categoryName(category),
+            memString(bytes), memString(acc.total), usage);
+    }
+
+    acc.usage[category] += bytes;
+    acc.total += bytes;
+    if (acc.total > acc.peak) {
+        acc.peak = acc.total;
+        for (int i = 0; i < EMemCategoryCount; ++i)
+            acc.peakUsage[i] = acc.usage[i];
+    }
+}
+
+void MemoryAccounting::release(EMemCategory category, size_t bytes) {
+    Accounts &acc = accounts();
+    tbb::mutex::scoped_lock lock(acc.mutex);
+    bytes = std::min(bytes, acc.usage[category]);
+    acc.usage[category] -= bytes;
+    acc.total -= bytes;
+}
+
+void MemoryAccounting::setBudget(size_t bytes) {
+    Accounts &acc = accounts();
+    tbb::mutex::scoped_lock lock(acc.mutex);
+    acc.budget = bytes;
+}
+
+size_t MemoryAccounting::getUsage(EMemCategory category) {
+    Accounts &acc = accounts();
+    tbb::mutex::scoped_lock lock(acc.mutex);
+    return acc.usage[category];
+}
+
+size_t MemoryAccounting::getTotalUsage() {
+    Accounts &acc = accounts();
+    tbb::mutex::scoped_lock lock(acc.mutex);
+    return acc.total;
+}
+
+size_t MemoryAccounting::getPeakUsage() {
+    Accounts &acc = accounts();
+    tbb::mutex::scoped_lock lock(acc.mutex);
+    return acc.peak;
+}
+
+void MemoryAccounting::resetPeak() {
+    Accounts &acc = accounts();
+    tbb::mutex::scoped_lock lock(acc.mutex);
+    acc.peak = acc.total;
+    for (int i = 0; i < EMemCategoryCount; ++i)
+        acc.peakUsage[i] = acc.usage[i];
+}
+
+std::string MemoryAccounting::report(bool peak) {
+    Accounts &acc = accounts();
+    tbb::mutex::scoped_lock lock(acc.mutex);
+    std::string result = peak ? "Peak memory usage:\n" : "Memory usage:\n";
+    if (peak)
+        result += breakdown(acc.peakUsage, acc.peak);
+    else
+        result += breakdown(acc.usage, acc.total);
+    if (acc.budget > 0)
+        result += tfm::format(" (budget: %s)", memString(acc.budget));
+    return result;
+}
+
+const char *MemoryAccounting::categoryName(EMemCategory category) {
+    switch (category) {
+        case EMemMeshes:        return "meshes";
+        case EMemBVH:           return "bvh";
+        case EMemTextures:      return "textures";
+        case EMemDistributions: return "distributions";
+        case EMemPhotonMap:     return "photon map";
+        case EMemImageBlocks:   return "image blocks";
+        case EMemSamplers:      return "samplers";
+        case EMemIntegrator:    return "integrator";
+        default:                return "unknown";
+    }
+}
+
+NORI_NAMESPACE_END
@@ -21,6 +21,8 @@
 #include <nori/bsdf.h>
 #include <nori/emitter.h>
 #include <nori/warp.h>
+#include <nori/trace.h>
+#include <nori/lightsampler.h>
 #include <Eigen/Geometry>
 
 NORI_NAMESPACE_BEGIN
@@ -35,6 +37,12 @@ Mesh::~Mesh() {
 }
 
 void Mesh::activate() {
+    NORI_TRACE_SCOPE("Mesh::activate", "load");
+
+    m_memory.set(sizeof(uint32_t) * m_F.size() +
+                 sizeof(float) * (m_V.size() + m_N.size() + m_UV.size()));
+    m_pdfMemory.set(sizeof(float) * (getPrimitiveCount() + 1));
+
     if (!m_bsdf) {
         /* If no material was assigned, instantiate a diffuse BRDF */
         m_bsdf = static_cast<BSDF *>(
@@ -42,7 +50,7 @@ void Mesh::activate() {
     }
 
 	// create the pdf
-	for (uint32_t i = 0; i < getTriangleCount(); i++)
+	for (uint32_t i = 0; i < getPrimitiveCount(); i++)
 	{
 		float _area = surfaceArea(i);
 		m_pdfs.append(_area);
@@ -54,26 +62,95 @@ void Mesh::activate() {
 void Mesh::samplePosition(const Point2f &sample, Point3f &p, Normal3f &n, float optional_u) const
 {
 	auto id = m_pdfs.sample(optional_u);
-	uint32_t i0 = m_F(0, id), i1 = m_F(1, id), i2 = m_F(2, id);
 
 	// barycentric sampling of triangle.
 	float u1 = sqrtf(sample.x());
 	float u = 1.0f - u1;
 	float v = sample.y() * u1;
 
+	evalPosition((uint32_t) id, Point2f(u, v), p, n);
+}
+
+uint32_t Mesh::sampleTriangle(float sample, float &pdf) const
+{
+	return (uint32_t) m_pdfs.sample(sample, pdf);
+}
+
+void Mesh::evalPosition(uint32_t index, const Point2f &bary, Point3f &p, Normal3f &n) const
+{
+	uint32_t i0 = m_F(0, index), i1 = m_F(1, index), i2 = m_F(2, index);
+	float u = bary.x(), v = bary.y();
+
 	const Point3f p0 = m_V.col(i0), p1 = m_V.col(i1), p2 = m_V.col(i2);
 	if (m_N.size() != 0)
 	{
 		const Normal3f n0 = m_N.col(i0), n1 = m_N.col(i1), n2 = m_N.col(i2);
-		n = (1.0f - u - v) * n0 + u * n1 + v * n2;
+		n = ((1.0f - u - v) * n0 + u * n1 + v * n2).normalized();
 	}
 	else
 	{
 		n = (p1 - p0).cross(p2 - p0).normalized();
-	}			
+	}
 
 	p = (1.0f - u - v) * p0 + u * p1 + v * p2;
-	
+}
+
+bool Mesh::sampleSolidAngle(const Point3f &ref, const Point2f &sample, float optional_u,
+                            Point3f &p, Normal3f &n, uint32_t &index) const
+{
+	float trianglePdf;
+	index = sampleTriangle(optional_u, trianglePdf);
+
+	Vector3f a, b, c;
+	float omega = triangleSolidAngle(index, ref, a, b, c);
+	Point2f bary;
+	if (omega < MinSampledSolidAngle)
+	{
+		// barycentric sampling of the triangle, as in samplePosition()
+		float u1 = sqrtf(sample.x());
+		bary = Point2f(1.0f - u1, sample.y() * u1);
+	}
+	else
+	{
+		// Find the point of the triangle in the sampled direction
+		Vector3f wi = Warp::squareToSphericalTriangle(sample, a, b, c);
+		float t;
+		if (!rayIntersect(index, Ray3f(ref, wi, 0.0f, INFINITY), bary.x(), bary.y(), t))
+			return false;
+	}
+	evalPosition(index, bary, p, n);
+	return true;
+}
+
+float Mesh::pdfSolidAngle(const Point3f &ref, const Point3f &p, const Normal3f &n, uint32_t index) const
+{
+	if (index >= getTriangleCount())
+		throw NoriException("Mesh::pdfSolidAngle(): invalid triangle index %i of mesh \"%s\"", index, m_name);
+
+	Vector3f a, b, c;
+	float omega = triangleSolidAngle(index, ref, a, b, c);
+	if (omega >= MinSampledSolidAngle)
+		return m_pdfs[index] / omega;
+
+	// Same conversion from area to solid angle as for area sampling
+	Vector3f wi = p - ref;
+	float dist2 = wi.squaredNorm();
+	float costheta_here = fabsf(n.dot(wi)) / std::sqrt(dist2);
+	return m_pdfs[index] / surfaceArea(index) * dist2 / costheta_here;
+}
+
+float Mesh::triangleSolidAngle(uint32_t index, const Point3f &ref, Vector3f &a, Vector3f &b, Vector3f &c) const
+{
+	a = Point3f(m_V.col(m_F(0, index))) - ref;
+	b = Point3f(m_V.col(m_F(1, index))) - ref;
+	c = Point3f(m_V.col(m_F(2, index))) - ref;
+	float la = a.norm(), lb = b.norm(), lc = c.norm();
+	if (la == 0.0f || lb == 0.0f || lc == 0.0f)
+		return 0.0f;
+	a /= la;
+	b /= lb;
+	c /= lc;
+	return Warp::sphericalTriangleArea(a, b, c);
 }
 
 float Mesh::surfaceArea(uint32_t index) const {
@@ -123,13 +200,51 @@ bool Mesh::rayIntersect(uint32_t index, const Ray3f &ray, float &u, float &v, fl
     return t >= ray.mint && t <= ray.maxt;
 }
 
+void Mesh::setHitInformation(uint32_t index, const Ray3f &ray, Intersection &its) const {
+    /* Find the barycentric coordinates */
+    Vector3f bary;
+    bary << 1-its.uv.sum(), its.uv;
+
+    /* Vertex indices of the triangle */
+    uint32_t idx0 = m_F(0, index), idx1 = m_F(1, index), idx2 = m_F(2, index);
+
+    Point3f p0 = m_V.col(idx0), p1 = m_V.col(idx1), p2 = m_V.col(idx2);
+
+    /* Compute the intersection positon accurately
+       using barycentric coordinates */
+    its.p = bary.x() * p0 + bary.y() * p1 + bary.z() * p2;
+
+    /* Compute proper texture coordinates if provided by the mesh */
+    if (m_UV.size() > 0)
+        its.uv = bary.x() * m_UV.col(idx0) +
+            bary.y() * m_UV.col(idx1) +
+            bary.z() * m_UV.col(idx2);
+
+    /* Compute the geometry frame */
+    its.geoFrame = Frame((p1-p0).cross(p2-p0).normalized());
+
+    if (m_N.size() > 0) {
+        /* Compute the shading frame. Note that for simplicity,
+           the current implementation doesn't attempt to provide
+           tangents that are continuous across the surface. That
+           means that this code will need to be modified to be able
+           use anisotropic BRDFs, which need tangent continuity */
+
+        its.shFrame = Frame(
+            (bary.x() * m_N.col(idx0) +
+             bary.y() * m_N.col(idx1) +
+             bary.z() * m_N.col(idx2)).normalized());
+    } else {
+        its.shFrame = its.geoFrame;
+    }
+}
+
 bool Mesh::rayMeshIntersect(const Ray3f& ray, Intersection& isect) const
 {
 	float u, v, t;
 	float min_t = INFINITY, min_u = 0.0f, min_v = 0.0f;
-	int min_id = -1;
-	bool intersected = false;
-	for (auto i = 0; i < getTriangleCount(); i++)
+	uint32_t min_id = (uint32_t) -1;
+	for (uint32_t i = 0; i < getPrimitiveCount(); i++)
 	{
 		if (rayIntersect(i, ray, u, v, t))
 		{
@@ -139,33 +254,25 @@ bool Mesh::rayMeshIntersect(const Ray3f& ray, Intersection& isect) const
 				min_t = t;
 				min_u = u;
 				min_v = v;
-				intersected = true;
 			}
 		}
 	}
 
-	if (min_id != -1)
-	{
-		isect.p = ray(min_t);
-		isect.t = min_t;
-		isect.mesh = this;
-
-		// compose the normal for a frame
-		uint32_t i0 = m_F(0, min_id), i1 = m_F(1, min_id), i2 = m_F(2, min_id);
-		const Point3f p0 = m_V.col(i0), p1 = m_V.col(i1), p2 = m_V.col(i2);
-		Normal3f surface_normal = (p1 - p0).cross(p2 - p0).normalized();
-		isect.geoFrame = Frame(surface_normal);
-		isect.shFrame = isect.geoFrame;
-		isect.uv = Vector2f(min_u, min_v);
-	}
+	if (min_id == (uint32_t) -1)
+		return false;
 
-	return intersected;
+	isect.t = min_t;
+	isect.uv = Point2f(min_u, min_v);
+	isect.mesh = this;
+	isect.primIndex = min_id;
+	setHitInformation(min_id, ray, isect);
+	return true;
 }
 
 bool Mesh::rayMeshIntersectP(const Ray3f& ray) const
 {
 	float u, v, t;
-	for (auto i = 0; i < getTriangleCount(); i++)
+	for (uint32_t i = 0; i < getPrimitiveCount(); i++)
 	{
 		if (rayIntersect(i, ray, u, v, t))
 			return true;
@@ -187,6 +294,24 @@ Point3f Mesh::getCentroid(uint32_t index) const {
          m_V.col(m_F(2, index)));
 }
 
+DirectionCone Mesh::getNormalCone() const {
+    DirectionCone cone;
+    if (m_N.size() != 0) {
+        for (int i = 0; i < m_N.cols(); ++i)
+            cone = DirectionCone::merge(cone, DirectionCone(Vector3f(m_N.col(i)).normalized()));
+    } else {
+        for (int i = 0; i < m_F.cols(); ++i) {
+            const Point3f p0 = m_V.col(m_F(0, i)), p1 = m_V.col(m_F(1, i)), p2 = m_V.col(m_F(2, i));
+            Vector3f n = (p1 - p0).cross(p2 - p0);
+            if (n.squaredNorm() > 0)
+                cone = DirectionCone::merge(cone, DirectionCone(n.normalized()));
+        }
+    }
+    if (cone.isEmpty())
+        cone = DirectionCone::entireSphere();
+    return cone;
+}
+
 void Mesh::addChild(NoriObject *obj) {
     switch (obj->getClassType()) {
         case EBSDF:
@@ -18,6 +18,7 @@
 
 #include <nori/mesh.h>
 #include <nori/timer.h>
+#include <nori/trace.h>
 #include <filesystem/resolver.h>
 #include <unordered_map>
 #include <fstream>
@@ -43,6 +44,7 @@ public:
         cout << "Loading \"" << filename << "\" .. ";
         cout.flush();
         Timer timer;
+        NORI_TRACE_SCOPE("WavefrontOBJ", "load");
 
         std::vector<Vector3f>   positions;
         std::vector<Vector2f>   texcoords;
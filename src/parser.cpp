@@ -18,6 +18,7 @@
 
 #include <nori/parser.h>
 #include <nori/proplist.h>
+#include <nori/trace.h>
 #include <Eigen/Geometry>
 #include <pugixml.hpp>
 #include <fstream>
@@ -26,6 +27,8 @@
 NORI_NAMESPACE_BEGIN
 
 NoriObject *loadFromXML(const std::string &filename) {
+    NORI_TRACE_SCOPE("loadFromXML", "load");
+
     /* Load the XML file using 'pugi' (a tiny self-contained XML parser implemented in C++) */
     pugi::xml_document doc;
     pugi::xml_parse_result result = doc.load_file(filename.c_str());
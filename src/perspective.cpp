@@ -31,7 +31,10 @@ NORI_NAMESPACE_BEGIN
  */
 class PerspectiveCamera : public Camera {
 public:
-    PerspectiveCamera(const PropertyList &propList) {
+    PerspectiveCamera(const PropertyList &propList) : m_props(propList) {
+        /* Optional name of the view (required for scenes with several cameras) */
+        m_name = propList.getString("name", "");
+
         /* Width and height in pixels. Default: 720p */
         m_outputSize.x() = propList.getInteger("width", 1280);
         m_outputSize.y() = propList.getInteger("height", 720);
@@ -136,6 +139,16 @@ public:
 		return Color3f(1.0f);
     }
 
+    Camera *cloneWithOverrides(const PropertyList &overrides) const {
+        PropertyList propList(m_props);
+        propList.merge(overrides);
+
+        PerspectiveCamera *camera = new PerspectiveCamera(propList);
+        camera->m_rfilter = m_rfilter;
+        camera->activate();
+        return camera;
+    }
+
     virtual void addChild(NoriObject *obj) {
         switch (obj->getClassType()) {
             case EReconstructionFilter:
@@ -154,12 +167,14 @@ public:
     virtual std::string toString() const {
         return tfm::format(
             "PerspectiveCamera[\n"
+            "  name = \"%s\",\n"
             "  cameraToWorld = %s,\n"
             "  outputSize = %s,\n"
             "  fov = %f,\n"
             "  clip = [%f, %f],\n"
             "  rfilter = %s\n"
             "]",
+            m_name,
             indent(m_cameraToWorld.toString(), 18),
             m_outputSize.toString(),
             m_fov,
@@ -169,6 +184,7 @@ public:
         );
     }
 private:
+    PropertyList m_props; ///< Construction parameters (for \ref cloneWithOverrides())
     Vector2f m_invOutputSize;
     Transform m_sampleToCamera;
     Transform m_cameraToWorld;
@@ -22,6 +22,9 @@
 #include <nori/bsdf.h>
 #include <nori/scene.h>
 #include <nori/photon.h>
+#include <nori/stats.h>
+#include <nori/trace.h>
+#include <nori/memory.h>
 
 NORI_NAMESPACE_BEGIN
 
@@ -39,6 +42,10 @@ public:
     }
 
     virtual void preprocess(const Scene *scene) {
+        /* Account for the photon map before allocating it, so that a memory
+           budget fails before the photons are traced */
+        m_photonMemory.set(sizeof(Photon) * (size_t) m_photonCount);
+
         cout << "Gathering " << m_photonCount << " photons .. ";
         cout.flush();
 
@@ -77,6 +84,7 @@ public:
 	 */
 
 	// put your code to trace photons here
+		TraceScope traceScope("tracePhotons", "preprocess");
 		int stored_photons = 0;
 		int emitted_photons = 0;
 		int n_lights = scene->getLights().size();
@@ -123,6 +131,7 @@ public:
 
 						// Now sample next direction
 						BSDFQueryRecord bRec(isect.toLocal(-photon_ray.d));
+						NORI_STAT(EStatBSDFSamples);
 						Color3f f = bsdf->sample(bRec, sampler->next2D());
 						Vector3f reflected_dir = isect.toWorld(bRec.wo);
 
@@ -159,8 +168,12 @@ public:
 		// Divide all photons by the total emitted
 		m_photonMap->scale(emitted_photons);
 
+		traceScope.setArgs(tfm::format("{\"emitted\": %i, \"stored\": %i}", emitted_photons, stored_photons));
+
 		/* Build the photon map */
+        NORI_TRACE_SCOPE("buildPhotonMap", "preprocess");
         m_photonMap->build();
+        m_photonMemory.set(sizeof(Photon) * m_photonMap->size());
     }
 
     virtual Color3f Li(const Scene *scene, Sampler *sampler, const Ray3f &_ray) const {
@@ -213,6 +226,8 @@ public:
 			{
 				std::vector<uint32_t> results;
 				m_photonMap->search(isect.p, m_photonRadius, results);
+				NORI_STAT(EStatPhotonLookups);
+				NORI_STAT_ADD(EStatPhotonsTouched, results.size());
 				float area = M_PI * square(m_photonRadius);
 
 				// The uint32_t makes the size() - 1 wrap around. Subtle bug.
@@ -225,6 +240,7 @@ public:
 						// Compute the integral equation
 						BSDFQueryRecord bRec(isect.toLocal(-traced_ray.d), isect.toLocal(-photon.getDirection()), ESolidAngle);
 
+						NORI_STAT(EStatBSDFEvals);
 						L += throughput * bsdf->eval(bRec) * photon.getPower() / area;
 					}
 				}
@@ -234,6 +250,7 @@ public:
 
 			// Sample a reflection ray
 			BSDFQueryRecord bRec(isect.toLocal(-traced_ray.d));
+			NORI_STAT(EStatBSDFSamples);
 			Color3f f = bsdf->sample(bRec, sampler->next2D());
 			Vector3f reflected_dir = isect.toWorld(bRec.wo);
 
@@ -281,6 +298,7 @@ private:
 	int m_rrStart;
 	int m_maxDepth;
     std::unique_ptr<PhotonMap> m_photonMap;
+    MemoryRecord m_photonMemory { EMemPhotonMap };
 };
 
 NORI_REGISTER_CLASS(PhotonMapper, "photonmapper");
@@ -31,6 +31,16 @@ Color3f PointLight::eval(const EmitterQueryRecord &lRec) const
 	return Color3f(0.0f);
 }
 
+bool PointLight::getLightBounds(LightBounds &bounds) const
+{
+	// Emits in all directions from a single point
+	bounds.bbox = BoundingBox3f(m_position);
+	bounds.cosThetaO = -1.0f;
+	bounds.cosThetaE = 0.0f;
+	bounds.power = m_power.getLuminance();
+	return true;
+}
+
 std::string PointLight::toString() const
 {
 	return tfm::format("PointLight[Position={%f,%f,%f}; Power={%f,%f,%f}]", m_position.x(), m_position.y(), m_position.z(), m_power.x(), m_power.y(), m_power.z());
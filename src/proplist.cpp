@@ -60,5 +60,10 @@ DEFINE_PROPERTY_ACCESSOR(Vector2f, Vector2, vector)
 DEFINE_PROPERTY_ACCESSOR(std::string, String, string)
 DEFINE_PROPERTY_ACCESSOR(Transform, Transform, transform)
 
+void PropertyList::merge(const PropertyList &other) {
+    for (const auto &it : other.m_properties)
+        m_properties[it.first] = it.second;
+}
+
 NORI_NAMESPACE_END
 
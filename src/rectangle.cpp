@@ -0,0 +1,162 @@
+#include <nori/mesh.h>
+#include <nori/bsdf.h>
+#include <nori/emitter.h>
+#include <nori/warp.h>
+#include <nori/lightsampler.h>
+#include <Eigen/Geometry>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Analytic rectangle
+ *
+ * The square <tt>[-1, 1]^2</tt> in the XY plane, facing +Z, placed by the
+ * \c toWorld transform (which can turn it into any parallelogram). Its
+ * solid angle is sampled exactly as the union of two spherical triangles,
+ * which are chosen in proportion to their solid angles.
+ */
+class Rectangle : public Mesh {
+public:
+    Rectangle(const PropertyList &propList) {
+        Transform trafo = propList.getTransform("toWorld", Transform());
+        m_center = trafo * Point3f(0.0f, 0.0f, 0.0f);
+        m_du = trafo * Vector3f(1.0f, 0.0f, 0.0f);
+        m_dv = trafo * Vector3f(0.0f, 1.0f, 0.0f);
+        m_normal = (trafo * Normal3f(0.0f, 0.0f, 1.0f)).normalized();
+
+        /* Dual basis, to find the coordinates of points in the plane */
+        float det = m_du.cross(m_dv).dot(m_normal);
+        if (det == 0.0f)
+            throw NoriException("Rectangle: the toWorld transform is degenerate!");
+        m_dualU = m_dv.cross(m_normal) / det;
+        m_dualV = m_normal.cross(m_du) / det;
+
+        m_name = "rectangle";
+        for (int i = 0; i < 4; ++i)
+            m_bbox.expandBy(corner(i));
+    }
+
+    uint32_t getPrimitiveCount() const { return 1; }
+
+    float surfaceArea(uint32_t index) const { return 4.0f * m_du.cross(m_dv).norm(); }
+
+    BoundingBox3f getBoundingBox(uint32_t index) const { return m_bbox; }
+
+    Point3f getCentroid(uint32_t index) const { return m_center; }
+
+    DirectionCone getNormalCone() const { return DirectionCone(m_normal); }
+
+    bool rayIntersect(uint32_t index, const Ray3f &ray, float &u, float &v, float &t) const {
+        float denom = m_normal.dot(ray.d);
+        if (denom == 0.0f)
+            return false;
+        t = m_normal.dot(m_center - ray.o) / denom;
+        if (!(t >= ray.mint && t <= ray.maxt))
+            return false;
+
+        Vector3f d = ray(t) - m_center;
+        float s = d.dot(m_dualU), r = d.dot(m_dualV);
+        if (std::abs(s) > 1.0f || std::abs(r) > 1.0f)
+            return false;
+        u = 0.5f * (s + 1.0f);
+        v = 0.5f * (r + 1.0f);
+        return true;
+    }
+
+    void setHitInformation(uint32_t index, const Ray3f &ray, Intersection &its) const {
+        its.p = m_center + (2.0f * its.uv.x() - 1.0f) * m_du + (2.0f * its.uv.y() - 1.0f) * m_dv;
+        its.geoFrame = its.shFrame = Frame(m_normal);
+    }
+
+    void samplePosition(const Point2f &sample, Point3f &p, Normal3f &n, float optional_u) const {
+        p = m_center + (2.0f * sample.x() - 1.0f) * m_du + (2.0f * sample.y() - 1.0f) * m_dv;
+        n = m_normal;
+    }
+
+    bool sampleSolidAngle(const Point3f &ref, const Point2f &sample, float optional_u,
+                          Point3f &p, Normal3f &n, uint32_t &index) const {
+        index = 0;
+        Vector3f dirs[4];
+        float omega0, omega1;
+        if (!solidAngles(ref, dirs, omega0, omega1)) {
+            samplePosition(sample, p, n, optional_u);
+            return true;
+        }
+
+        /* Triangles (0, 1, 2) and (0, 2, 3) */
+        Vector3f wi = optional_u * (omega0 + omega1) < omega0
+            ? Warp::squareToSphericalTriangle(sample, dirs[0], dirs[1], dirs[2])
+            : Warp::squareToSphericalTriangle(sample, dirs[0], dirs[2], dirs[3]);
+
+        float denom = m_normal.dot(wi);
+        if (denom == 0.0f)
+            return false;
+        p = ref + (m_normal.dot(m_center - ref) / denom) * wi;
+        n = m_normal;
+        return true;
+    }
+
+    float pdfSolidAngle(const Point3f &ref, const Point3f &p, const Normal3f &n, uint32_t index) const {
+        Vector3f dirs[4];
+        float omega0, omega1;
+        if (solidAngles(ref, dirs, omega0, omega1))
+            return 1.0f / (omega0 + omega1);
+
+        Vector3f wi = p - ref;
+        float dist2 = wi.squaredNorm();
+        float costheta_here = fabsf(n.dot(wi)) / std::sqrt(dist2);
+        return dist2 / (costheta_here * surfaceArea(0));
+    }
+
+    std::string toString() const {
+        return tfm::format(
+            "Rectangle[\n"
+            "  center = %s,\n"
+            "  du = %s,\n"
+            "  dv = %s,\n"
+            "  bsdf = %s,\n"
+            "  emitter = %s\n"
+            "]",
+            m_center.toString(),
+            m_du.toString(),
+            m_dv.toString(),
+            m_bsdf ? indent(m_bsdf->toString()) : std::string("null"),
+            m_emitter ? indent(m_emitter->toString()) : std::string("null")
+        );
+    }
+
+private:
+    /// Corners in counter-clockwise order around the normal
+    Point3f corner(int i) const {
+        float s = (i == 1 || i == 2) ? 1.0f : -1.0f, r = i >= 2 ? 1.0f : -1.0f;
+        return m_center + s * m_du + r * m_dv;
+    }
+
+    /**
+     * \brief Compute the directions to the corners and the solid angles of
+     * the two triangles
+     *
+     * \return \c false if the rectangle is too small (or 'ref' lies in its
+     * plane) to be sampled by solid angle
+     */
+    bool solidAngles(const Point3f &ref, Vector3f *dirs, float &omega0, float &omega1) const {
+        for (int i = 0; i < 4; ++i) {
+            dirs[i] = corner(i) - ref;
+            float length = dirs[i].norm();
+            if (length == 0.0f)
+                return false;
+            dirs[i] /= length;
+        }
+        omega0 = Warp::sphericalTriangleArea(dirs[0], dirs[1], dirs[2]);
+        omega1 = Warp::sphericalTriangleArea(dirs[0], dirs[2], dirs[3]);
+        return omega0 + omega1 >= MinSampledSolidAngle;
+    }
+
+    Point3f m_center;
+    Vector3f m_du, m_dv;
+    Vector3f m_dualU, m_dualV;
+    Normal3f m_normal;
+};
+
+NORI_REGISTER_CLASS(Rectangle, "rectangle");
+NORI_NAMESPACE_END
@@ -0,0 +1,282 @@
+#include <nori/regression.h>
+#include <nori/render.h>
+#include <nori/memory.h>
+#include <nori/timer.h>
+#include <filesystem/path.h>
+#include <hypothesis.h>
+#include <fstream>
+
+NORI_NAMESPACE_BEGIN
+
+/* Parse a line of whitespace-separated key=value pairs */
+static std::map<std::string, std::string> parseParameters(const std::string &line) {
+    std::map<std::string, std::string> result;
+    for (const std::string &token : tokenize(line, " \t\r")) {
+        size_t pos = token.find('=');
+        if (pos == std::string::npos)
+            throw NoriException("Expected key=value, got \"%s\"", token);
+        result[token.substr(0, pos)] = token.substr(pos + 1);
+    }
+    return result;
+}
+
+static std::string getParameter(const std::map<std::string, std::string> &params,
+                                const std::string &key, const std::string &def) {
+    auto it = params.find(key);
+    return it == params.end() ? def : it->second;
+}
+
+RegressionSuite::RegressionSuite(const std::string &filename) {
+    std::ifstream is(filename);
+    if (!is)
+        throw NoriException("Unable to open regression suite \"%s\"!", filename);
+    m_basePath = filesystem::path(filename).parent_path().str();
+
+    std::string line;
+    while (std::getline(is, line)) {
+        std::vector<std::string> tokens = tokenize(line, " \t\r");
+        if (tokens.empty() || tokens[0][0] == '#')
+            continue;
+        Parameters params = parseParameters(line);
+        if (!params.count("name") || !params.count("scene"))
+            throw NoriException("Regression case \"%s\" needs a name and a scene!", line);
+        m_cases.push_back(params);
+    }
+}
+
+/* Paths in the suite file are relative to the suite */
+static std::string resolvePath(const std::string &basePath, const std::string &path) {
+    if (basePath.empty() || path.empty() || path[0] == '/' || (path.size() > 1 && path[1] == ':'))
+        return path;
+    return basePath + "/" + path;
+}
+
+/* Render a scene at fixed settings, and return the measurements and the image */
+static Bitmap renderCase(const std::string &scene, const std::string &output, int spp,
+                         uint64_t seed, int threads, RegressionSuite::Result &result) {
+    ImageBlock block(Vector2i(720, 720), nullptr);
+    RenderThread thread(block);
+    thread.setSampleCount(spp);
+    thread.setSeed(seed);
+    thread.setThreadCount(threads);
+    thread.setOutputName(output);
+
+    MemoryAccounting::resetPeak();
+    Timer timer;
+    thread.renderScene(scene);
+    thread.wait();
+    if (!thread.getError().empty())
+        throw NoriException("Rendering \"%s\" failed: %s", scene, thread.getError());
+
+    const Statistics::Snapshot &stats = thread.getStatistics();
+    double rays = (double) (stats[EStatIntersectionRays] + stats[EStatShadowRays]);
+    result.wallTime = timer.elapsed() * 1e-3;
+    result.mraysPerSecond = thread.getRenderTime() > 0 ? rays * 1e-3 / thread.getRenderTime() : 0.0;
+    result.peakMemory = (double) MemoryAccounting::getPeakUsage();
+    return Bitmap(output);
+}
+
+int RegressionSuite::run(bool update) {
+    m_results.clear();
+    int failures = 0;
+    for (const Parameters &params : m_cases) {
+        Result result;
+        try {
+            result = runCase(params, update);
+        } catch (const std::exception &e) {
+            result.name = params.at("name");
+            result.regressions.push_back(std::string("error: ") + e.what());
+        }
+        if (!result.regressions.empty())
+            ++failures;
+        m_results.push_back(result);
+    }
+
+    cout << "------------------------------------------------------" << endl;
+    cout << tfm::format("%-20s %10s %10s %10s %10s %8s", "case", "time (s)", "Mrays/s",
+                        "memory", "relMSE", "SSIM") << endl;
+    for (const Result &r : m_results) {
+        cout << tfm::format("%-20s %10.2f %10.2f %10s %10.3g %8.4f", r.name, r.wallTime,
+                            r.mraysPerSecond, memString((size_t) r.peakMemory), r.relMSE, r.ssim) << endl;
+        for (const std::string &regression : r.regressions)
+            cout << "  REGRESSION: " << regression << endl;
+    }
+    cout << (update ? "Updated " : "Passed ") << (m_results.size() - failures) << "/"
+         << m_results.size() << " cases." << endl;
+    return failures;
+}
+
+RegressionSuite::Result RegressionSuite::runCase(const Parameters &params, bool update) {
+    Result result;
+    result.name = params.at("name");
+    std::string scene = resolvePath(m_basePath, params.at("scene"));
+    std::string reference = resolvePath(m_basePath, getParameter(params, "reference", result.name + ".ref.exr"));
+    std::string output = resolvePath(m_basePath, result.name + ".out.exr");
+    std::string baselineFile = resolvePath(m_basePath, result.name + ".baseline");
+    int spp = toInt(getParameter(params, "spp", "16"));
+    uint64_t seed = strtoull(getParameter(params, "seed", "1").c_str(), nullptr, 10);
+    int threads = toInt(getParameter(params, "threads", "4"));
+
+    cout << "------------------------------------------------------" << endl;
+    cout << "Regression case \"" << result.name << "\"" << endl;
+
+    /* Render a converged reference if there is none yet */
+    if (update && !filesystem::path(reference).exists()) {
+        Result ignored;
+        int referenceSpp = toInt(getParameter(params, "referenceSpp", std::to_string(64 * spp)));
+        renderCase(scene, reference, referenceSpp, seed + 1, threads, ignored);
+    }
+
+    Bitmap image = renderCase(scene, output, spp, seed, threads, result);
+    Bitmap ref(reference);
+    result.relMSE = relMSE(image, ref);
+    result.ssim = ssim(image, ref);
+
+    /* Test for a brightness difference w.r.t. the reference (mean luminance difference of zero).
+       The reconstruction filter correlates neighboring pixels, so the samples of the test are the
+       mean differences of blocks of pixels, which are close to independent. In update mode, the
+       baseline is recorded as is */
+    if (!update) {
+        const int BlockSize = 16;
+        double mean = 0, variance = 0;
+        size_t count = 0;
+        for (int by = 0; by < image.rows(); by += BlockSize) {
+            for (int bx = 0; bx < image.cols(); bx += BlockSize) {
+                int y1 = std::min(by + BlockSize, (int) image.rows()), x1 = std::min(bx + BlockSize, (int) image.cols());
+                double sum = 0;
+                for (int y = by; y < y1; ++y)
+                    for (int x = bx; x < x1; ++x)
+                        sum += image.coeff(y, x).getLuminance() - ref.coeff(y, x).getLuminance();
+                double delta = sum / ((double) (y1 - by) * (x1 - bx));
+                double d = delta - mean;
+                mean += d / (double) ++count;
+                variance += d * (delta - mean);
+            }
+        }
+        variance /= std::max(count, (size_t) 2) - 1;
+        float significance = toFloat(getParameter(params, "significance", "0.01"));
+        std::pair<bool, std::string> biasTest = hypothesis::students_t_test(mean, variance, 0.0,
+            count, significance, (int) m_cases.size());
+        result.biasTest = biasTest.second;
+        if (!biasTest.first)
+            result.regressions.push_back("biased w.r.t. the reference: " + biasTest.second);
+    }
+
+    if (update) {
+        std::ofstream os(baselineFile);
+        os << tfm::format("wallTime=%.6f mraysPerSecond=%.6f peakMemory=%.0f relMSE=%.9g ssim=%.9g\n",
+                          result.wallTime, result.mraysPerSecond, result.peakMemory,
+                          result.relMSE, result.ssim);
+        if (!os)
+            throw NoriException("Unable to write \"%s\"!", baselineFile);
+        return result;
+    }
+
+    std::ifstream is(baselineFile);
+    std::string line;
+    if (!is || !std::getline(is, line)) {
+        result.regressions.push_back("no baseline for this machine (run 'make regress-update' or the suite with --update first)");
+        return result;
+    }
+    Parameters baseline = parseParameters(line);
+    auto tolerance = [&](const char *key, const char *def) {
+        return toFloat(getParameter(params, key, def));
+    };
+    auto base = [&](const char *key) {
+        return toFloat(getParameter(baseline, key, "0"));
+    };
+
+    if (result.wallTime > base("wallTime") * (1 + tolerance("timeTolerance", "0.1")))
+        result.regressions.push_back(tfm::format("slower: %.2fs (baseline %.2fs)",
+            result.wallTime, base("wallTime")));
+    if (result.relMSE > base("relMSE") * (1 + tolerance("errorTolerance", "0.1")))
+        result.regressions.push_back(tfm::format("noisier: relMSE %.4g (baseline %.4g)",
+            result.relMSE, base("relMSE")));
+    if (result.ssim < base("ssim") - tolerance("ssimTolerance", "0.01"))
+        result.regressions.push_back(tfm::format("less similar: SSIM %.4f (baseline %.4f)",
+            result.ssim, base("ssim")));
+    if (result.peakMemory > base("peakMemory") * (1 + tolerance("memoryTolerance", "0.1")))
+        result.regressions.push_back(tfm::format("more memory: %s (baseline %s)",
+            memString((size_t) result.peakMemory), memString((size_t) base("peakMemory"))));
+    return result;
+}
+
+double RegressionSuite::relMSE(const Bitmap &image, const Bitmap &reference) {
+    if (image.rows() != reference.rows() || image.cols() != reference.cols())
+        throw NoriException("Image and reference have different sizes!");
+    double sum = 0;
+    for (int y = 0; y < image.rows(); ++y) {
+        for (int x = 0; x < image.cols(); ++x) {
+            for (int c = 0; c < 3; ++c) {
+                double value = image.coeff(y, x)[c], ref = reference.coeff(y, x)[c];
+                sum += (value - ref) * (value - ref) / (ref * ref + 1e-2);
+            }
+        }
+    }
+    return sum / (3.0 * image.rows() * image.cols());
+}
+
+double RegressionSuite::ssim(const Bitmap &image, const Bitmap &reference) {
+    if (image.rows() != reference.rows() || image.cols() != reference.cols())
+        throw NoriException("Image and reference have different sizes!");
+    int width = (int) image.cols(), height = (int) image.rows();
+
+    /* Summed-area tables of the tonemapped luminances, their squares and their product */
+    const int N = 5;
+    std::vector<double> sat((size_t) (width + 1) * (height + 1) * N, 0.0);
+    auto at = [&](int x, int y, int k) -> double & {
+        return sat[((size_t) y * (width + 1) + x) * N + k];
+    };
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            double a = image.coeff(y, x).getLuminance(), b = reference.coeff(y, x).getLuminance();
+            a = std::max(a, 0.0) / (1 + std::max(a, 0.0));
+            b = std::max(b, 0.0) / (1 + std::max(b, 0.0));
+            double values[N] = { a, b, a * a, b * b, a * b };
+            for (int k = 0; k < N; ++k)
+                at(x + 1, y + 1, k) = values[k] + at(x, y + 1, k) + at(x + 1, y, k) - at(x, y, k);
+        }
+    }
+
+    const double C1 = 0.01 * 0.01, C2 = 0.03 * 0.03;
+    const int radius = 3;
+    double sum = 0;
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            int x0 = std::max(x - radius, 0), x1 = std::min(x + radius + 1, width);
+            int y0 = std::max(y - radius, 0), y1 = std::min(y + radius + 1, height);
+            double n = (double) (x1 - x0) * (y1 - y0), m[N];
+            for (int k = 0; k < N; ++k)
+                m[k] = (at(x1, y1, k) - at(x0, y1, k) - at(x1, y0, k) + at(x0, y0, k)) / n;
+            double varA = m[2] - m[0] * m[0], varB = m[3] - m[1] * m[1], cov = m[4] - m[0] * m[1];
+            sum += ((2 * m[0] * m[1] + C1) * (2 * cov + C2)) /
+                   ((m[0] * m[0] + m[1] * m[1] + C1) * (varA + varB + C2));
+        }
+    }
+    return sum / ((double) width * height);
+}
+
+std::string RegressionSuite::toJSON() const {
+    std::string result = "{\n  \"cases\": [";
+    for (size_t i = 0; i < m_results.size(); ++i) {
+        const Result &r = m_results[i];
+        std::string regressions;
+        for (size_t j = 0; j < r.regressions.size(); ++j) {
+            std::string escaped;
+            for (char c : r.regressions[j]) {
+                if (c == '"' || c == '\\')
+                    escaped += '\\';
+                escaped += (c == '\n') ? ' ' : c;
+            }
+            regressions += tfm::format("%s\"%s\"", j > 0 ? ", " : "", escaped);
+        }
+        result += tfm::format("%s\n    {\"name\": \"%s\", \"wallTime\": %.4f, \"mraysPerSecond\": %.4f, "
+            "\"peakMemory\": %.0f, \"relMSE\": %.6g, \"ssim\": %.6f, \"regressions\": [%s]}",
+            i > 0 ? "," : "", r.name, r.wallTime, r.mraysPerSecond, r.peakMemory,
+            r.relMSE, r.ssim, regressions);
+    }
+    result += "\n  ]\n}\n";
+    return result;
+}
+
+NORI_NAMESPACE_END
@@ -26,11 +26,18 @@
 #include <nori/sampler.h>
 #include <nori/integrator.h>
 #include <nori/gui.h>
+#include <nori/checkpoint.h>
+#include <nori/stats.h>
+#include <nori/aov.h>
+#include <nori/trace.h>
+#include <nori/memory.h>
 #include <tbb/parallel_for.h>
 #include <tbb/blocked_range.h>
 #include <tbb/task_scheduler_init.h>
 #include <filesystem/resolver.h>
 #include <tbb/concurrent_vector.h>
+#include <cstdio>
+#include <fstream>
 
 
 NORI_NAMESPACE_BEGIN
@@ -63,6 +70,12 @@ void RenderThread::stopRendering() {
     }
 }
 
+void RenderThread::wait() {
+    if (m_render_thread.joinable())
+        m_render_thread.join();
+    m_render_status = 0;
+}
+
 float RenderThread::getProgress() {
     if(isBusy()) {
         return m_progress;
@@ -70,8 +83,38 @@ float RenderThread::getProgress() {
     else return 1.f;
 }
 
-static void renderBlock(const Scene *scene, Sampler *sampler, ImageBlock &block, int spp, int run) {
-    const Camera *camera = scene->getCamera();
+bool RenderPartition::containsBlock(const ImageBlock &block) const {
+    int blockId = (int) block.getBlockId();
+    if (blockId < tileBegin || (tileEnd >= 0 && blockId >= tileEnd))
+        return false;
+    if (!region.isValid())
+        return true;
+    BoundingBox2i bounds(block.getOffset(),
+        block.getOffset() + block.getSize() - Vector2i::Constant(1));
+    return region.overlaps(bounds);
+}
+
+bool RenderPartition::operator==(const RenderPartition &other) const {
+    bool sameRegion = region.isValid() ? region == other.region : !other.region.isValid();
+    return sameRegion && tileBegin == other.tileBegin && tileEnd == other.tileEnd &&
+           sampleBegin == other.sampleBegin && sampleEnd == other.sampleEnd;
+}
+
+std::string RenderPartition::getSuffix() const {
+    std::string suffix;
+    if (region.isValid())
+        suffix += tfm::format("_region-%i-%i-%i-%i", region.min.x(), region.min.y(),
+            region.max.x() - region.min.x() + 1, region.max.y() - region.min.y() + 1);
+    if (tileBegin > 0 || tileEnd >= 0)
+        suffix += tfm::format("_tiles-%i-%i", tileBegin, tileEnd);
+    if (sampleBegin > 0 || sampleEnd >= 0)
+        suffix += tfm::format("_samples-%i-%i", sampleBegin, sampleEnd);
+    return suffix;
+}
+
+/* Render one sample of every pixel in the block, and return the number of computed samples */
+static int renderBlock(const Scene *scene, const Camera *camera, Sampler *sampler, ImageBlock &block,
+                       int spp, int run, size_t view, const RenderPartition &partition, CostAOVs *aovs) {
     const Integrator *integrator = scene->getIntegrator();
 
 	// Although the renderer is calling it sample by sample per pixel, we can still pass in the spp coun
@@ -82,12 +125,26 @@ static void renderBlock(const Scene *scene, Sampler *sampler, ImageBlock &block,
 
     /* Clear the block contents */
     block.clear();
+    int sampleCount = 0;
 
     /* For each pixel and pixel sample sample */
     for (int y=0; y<size.y(); ++y) {
         for (int x=0; x<size.x(); ++x) {
 			
 			Point2i pixel = Point2i((x + offset.x()), (y + offset.y()));
+			if (partition.region.isValid() && !partition.region.contains(pixel))
+				continue;
+
+			CostAOVs::Sample cost;
+			if (aovs)
+				cost = CostAOVs::Sample::now();
+
+			sampler->setSampleIndex(pixel, (uint32_t) run);
+			PixelQuery query;
+			query.view = view;
+			query.pixel = pixel;
+			query.pass = (uint32_t) run;
+			NORI_STAT(EStatCameraRays);
             Point2f pixelSample = Point2f((float) (x + offset.x()), (float) (y + offset.y())) + sampler->next2D();
             Point2f apertureSample = sampler->next2D();
 
@@ -96,16 +153,20 @@ static void renderBlock(const Scene *scene, Sampler *sampler, ImageBlock &block,
             Color3f value = camera->sampleRay(ray, pixelSample, apertureSample);
 
             /* Compute the incident radiance */
-            value *= integrator->Li(scene, sampler, ray);
+            value *= integrator->LiPixel(scene, sampler, ray, query);
 
             /* Store in the image block */
             block.put(pixelSample, value);
+            ++sampleCount;
+
+			if (aovs)
+				aovs->put(pixel, CostAOVs::Sample::now() - cost);
         }
     }
+    return sampleCount;
 }
 
-void RenderThread::renderScene(const std::string & filename) {
-
+Scene *RenderThread::loadScene(const std::string &filename) {
     filesystem::path path(filename);
 
     /* Add the parent directory of the scene file to the
@@ -115,73 +176,337 @@ void RenderThread::renderScene(const std::string & filename) {
 
     NoriObject* root = loadFromXML(filename);
 
-	// When the XML root object is a scene, start rendering it ..
-    if (root->getClassType() == NoriObject::EScene) {
-        m_scene = static_cast<Scene *>(root);
+    if (root->getClassType() != NoriObject::EScene) {
+        delete root;
+        return nullptr;
+    }
 
-        const Camera *camera_ = m_scene->getCamera();
-        m_scene->getIntegrator()->preprocess(m_scene);
+    Scene *scene = static_cast<Scene *>(root);
+    {
+        NORI_TRACE_SCOPE("Integrator::preprocess", "preprocess");
+        scene->getIntegrator()->preprocess(scene);
+    }
+    cout << MemoryAccounting::report() << endl;
+    return scene;
+}
 
-        /* Allocate memory for the entire output image and clear it */
-        m_block.init(camera_->getOutputSize(), camera_->getReconstructionFilter());
-        m_block.clear();
+void RenderThread::renderScene(const std::string & filename) {
+    Scene *scene = loadScene(filename);
 
+	// When the XML root object is a scene, start rendering it ..
+    if (scene) {
         /* Determine the filename of the output bitmap */
-        std::string outputName = filename;
-		std::string tempName = filename;
+        std::string outputName = m_outputName.empty() ? filename : m_outputName;
         size_t lastdot = outputName.find_last_of(".");
         if (lastdot != std::string::npos)
             outputName.erase(lastdot, std::string::npos);
-        outputName += ".exr";
 
-        /* Do the following in parallel and asynchronously */
-        m_render_status = 1;
-        m_render_thread = std::thread([this,outputName, tempName] {
-            const Camera *camera = m_scene->getCamera();
-            Vector2i outputSize = camera->getOutputSize();
+        std::vector<const Camera *> cameras;
+        const Sampler *sampler = scene->getSampler();
+        m_overrideCameras.clear();
+        m_overrideSampler.reset();
+
+        try {
+            /* Apply the resolution override to all cameras */
+            PropertyList overrides;
+            if (m_resolution.x() > 0 && m_resolution.y() > 0) {
+                overrides.setInteger("width", m_resolution.x());
+                overrides.setInteger("height", m_resolution.y());
+            }
+            for (const Camera *camera : scene->getCameras()) {
+                if (overrides.has("width")) {
+                    m_overrideCameras.emplace_back(camera->cloneWithOverrides(overrides));
+                    camera = m_overrideCameras.back().get();
+                }
+                cameras.push_back(camera);
+            }
+
+            /* Apply the sample count and seed overrides */
+            if (m_sampleCount > 0 || m_hasSeed) {
+                m_overrideSampler = sampler->clone();
+                if (m_sampleCount > 0)
+                    m_overrideSampler->setSampleCount((size_t) m_sampleCount);
+                if (m_hasSeed)
+                    m_overrideSampler->setSeed(m_seed);
+                sampler = m_overrideSampler.get();
+            }
+        } catch (...) {
+            delete scene;
+            throw;
+        }
+
+        renderLoadedScene(scene, cameras, sampler, outputName, true);
+    }
+}
+
+/* Insert a suffix before the extension of a filename */
+static std::string addSuffix(const std::string &filename, const std::string &suffix) {
+    size_t lastdot = filename.find_last_of(".");
+    size_t lastsep = filename.find_last_of("/\\");
+    if (lastdot == std::string::npos || (lastsep != std::string::npos && lastdot < lastsep))
+        return filename + suffix;
+    return filename.substr(0, lastdot) + suffix + filename.substr(lastdot);
+}
 
-            /* Create a block generator (i.e. a work scheduler) */
-            BlockGenerator blockGenerator(outputSize, NORI_BLOCK_SIZE);
+void RenderThread::renderLoadedScene(Scene *scene, const std::vector<const Camera *> &cameras,
+                                     const Sampler *sampler, const std::string &outputBase, bool ownsScene) {
+    m_scene = scene;
+
+    /* Allocate memory for the entire output image of the first view and clear it */
+    m_block.init(cameras[0]->getOutputSize(), cameras[0]->getReconstructionFilter());
+    m_block.clear();
+
+    /* Determine the output filenames. Scenes with several cameras produce one image per view */
+    bool multiView = cameras.size() > 1;
+    std::vector<std::string> outputNames, rawNames;
+    for (size_t i = 0; i < cameras.size(); ++i) {
+        std::string suffix;
+        if (multiView)
+            suffix = "_" + (cameras[i]->getName().empty() ? std::to_string(i) : cameras[i]->getName());
+
+        std::string rawName;
+        if (!m_rawOutput.empty())
+            rawName = addSuffix(m_rawOutput, suffix);
+        else if (m_partition.isPartial())
+            rawName = outputBase + suffix + m_partition.getSuffix() + ".raw.exr";
+
+        outputNames.push_back(outputBase + suffix + ".exr");
+        rawNames.push_back(rawName);
+    }
+    /* Workers that render partitions of the same scene must not share a checkpoint */
+    std::string checkpointName = outputBase + m_partition.getSuffix() + ".ckpt";
+    float checkpointInterval = m_checkpointInterval;
+    RenderPartition partition = m_partition;
+
+    /* Checkpoints only capture a single view */
+    if (multiView && checkpointInterval > 0) {
+        cerr << "Warning: checkpoints are not supported for scenes with several cameras" << endl;
+        checkpointInterval = 0;
+    }
+
+    /* Load the checkpoint to resume from (if any) */
+    std::shared_ptr<RenderCheckpoint> resume;
+    if (!m_resumeFile.empty()) {
+        try {
+            if (multiView)
+                throw NoriException("Cannot resume a scene with several cameras from a checkpoint!");
+            resume = std::make_shared<RenderCheckpoint>();
+            resume->load(m_resumeFile);
+            resume->restoreBlock(m_block, sampler, m_partition);
+        } catch (...) {
+            if (ownsScene)
+                delete m_scene;
+            m_scene = nullptr;
+            throw;
+        }
+        cout << "Resuming from " << resume->toString() << endl;
+        m_resumeFile.clear();
+    }
+
+    /* Do the following in parallel and asynchronously */
+    int threadCount = m_threadCount;
+    ProgressCallback progressCallback = m_progressCallback;
+    float progressInterval = m_progressInterval;
+    std::string statsFile = m_statsFile;
+    bool costAOVs = m_costAOVs;
+    m_error.clear();
+
+#if !defined(NORI_ENABLE_STATS)
+    if (costAOVs)
+        cerr << "Warning: Nori was compiled without statistics, only the time AOV will be recorded" << endl;
+#endif
+
+    m_render_status = 1;
+    m_render_thread = std::thread([this, cameras, sampler, ownsScene, outputNames, rawNames,
+                                   checkpointName, checkpointInterval, partition, resume,
+                                   threadCount, progressCallback, progressInterval, statsFile, costAOVs] {
+        /* Errors are reported through getError() instead of terminating the program */
+        try {
+            /* The number of worker threads is configured per thread that uses TBB */
+            tbb::task_scheduler_init init(threadCount > 0 ? threadCount :
+                                          tbb::task_scheduler_init::automatic);
+            Trace::setThreadName("render");
+            TraceScope renderScope("render", "render");
+
+            /* Per-view rendering state. The first view accumulates into m_block, which is
+               displayed by the GUI, all other views into their own image blocks */
+            struct View {
+                const Camera *camera;
+                ImageBlock *result;
+                std::unique_ptr<ImageBlock> ownedResult;
+                std::unique_ptr<BlockGenerator> blockGenerator;
+                std::unique_ptr<CostAOVs> aovs;
+                tbb::concurrent_vector< std::unique_ptr<Sampler> > samplers;
+                MemoryRecord samplerMemory { EMemSamplers };
+                int firstBlock; // index of the first block of this view in the shared work list
+            };
 
             cout << "Rendering .. ";
             cout.flush();
             Timer timer;
+            Statistics::Snapshot statsStart = Statistics::collect();
+
+            auto numSamples = sampler->getSampleCount();
+            int numBlocks = 0;
+
+            std::vector<std::unique_ptr<View>> views;
+            for (size_t i = 0; i < cameras.size(); ++i) {
+                std::unique_ptr<View> view(new View());
+                const Camera *camera = cameras[i];
+                view->camera = camera;
+                if (i == 0) {
+                    view->result = &m_block;
+                } else {
+                    view->ownedResult.reset(new ImageBlock(camera->getOutputSize(),
+                                                           camera->getReconstructionFilter()));
+                    view->ownedResult->clear();
+                    view->result = view->ownedResult.get();
+                }
+
+                /* Create a block generator (i.e. a work scheduler) */
+                view->blockGenerator.reset(new BlockGenerator(camera->getOutputSize(), NORI_BLOCK_SIZE));
+                view->firstBlock = numBlocks;
+                if (costAOVs)
+                    view->aovs.reset(new CostAOVs(camera->getOutputSize()));
+                numBlocks += view->blockGenerator->getBlockCount();
+
+                /* Initialize one sampler per block. Every block keeps using
+                   the same sampler in all passes */
+                view->samplers.resize(view->blockGenerator->getBlockCount());
+                view->samplerMemory.set(view->samplers.size() * sampler->getMemoryUsage());
+                ImageBlock block(Vector2i(NORI_BLOCK_SIZE), nullptr);
+                while (view->blockGenerator->next(block)) {
+                    std::unique_ptr<Sampler> blockSampler(sampler->clone());
+                    blockSampler->prepare(block);
+                    view->samplers.at(block.getBlockId()) = std::move(blockSampler);
+                }
+                view->blockGenerator->reset();
+
+                views.push_back(std::move(view));
+            }
 
-            auto numSamples = m_scene->getSampler()->getSampleCount();
-            auto numBlocks = blockGenerator.getBlockCount();
+            /* Let the integrator allocate per-pixel state for the views */
+            m_scene->getIntegrator()->beginRender(cameras);
 
-            tbb::concurrent_vector< std::unique_ptr<Sampler> > samplers;
-            samplers.resize(numBlocks);
+            /* Sample indices rendered by this process */
+            uint32_t beginPass = (uint32_t) std::max(partition.sampleBegin, 0);
+            uint32_t endPass = partition.sampleEnd < 0 ? (uint32_t) numSamples :
+                std::min((uint32_t) partition.sampleEnd, (uint32_t) numSamples);
 
-            for (uint32_t k = 0; k < numSamples ; ++k) {
-                m_progress = k/float(numSamples);
+            uint32_t firstPass = beginPass;
+            if (resume) {
+                resume->restoreSamplers(views[0]->samplers);
+                firstPass = std::max(firstPass, resume->getCompletedPasses());
+            }
+
+            CheckpointWriter checkpointWriter;
+            Timer checkpointTimer;
+            bool checkpointing = checkpointInterval > 0;
+
+            /* Capture the state after 'passes' completed passes and write it in the background */
+            auto writeCheckpoint = [&](uint32_t passes) {
+                std::unique_ptr<RenderCheckpoint> checkpoint(new RenderCheckpoint());
+                m_block.lock();
+                try {
+                    checkpoint->capture(m_block, sampler, partition, passes, views[0]->samplers);
+                } catch (const std::exception &e) {
+                    m_block.unlock();
+                    cerr << "Warning: disabling checkpoints: " << e.what() << endl;
+                    checkpointing = false;
+                    return;
+                }
+                m_block.unlock();
+                checkpointWriter.write(std::move(checkpoint), checkpointName);
+                checkpointTimer.reset();
+            };
+
+            /* Progress is tracked per block and reported at most every 'progressInterval' seconds */
+            uint64_t sessionBlocks = (uint64_t) numBlocks * (endPass > firstPass ? endPass - firstPass : 0);
+            uint64_t totalBlocks = (uint64_t) numBlocks * (endPass > beginPass ? endPass - beginPass : 0);
+            uint64_t previousBlocks = totalBlocks - sessionBlocks;
+            std::atomic<uint64_t> blocksDone(0), samplesDone(0);
+            std::atomic<double> nextReport(0);
+            tbb::mutex progressMutex;
+
+            auto reportProgress = [&](bool force) {
+                uint64_t done = blocksDone;
+                m_progress = totalBlocks > 0 ? (previousBlocks + done) / (float) totalBlocks : 1.f;
+                if (!progressCallback || (!force && timer.elapsed() < nextReport))
+                    return;
+
+                /* Only one thread reports at a time, the others simply continue */
+                tbb::mutex::scoped_lock lock;
+                if (force)
+                    lock.acquire(progressMutex);
+                else if (!lock.try_acquire(progressMutex))
+                    return;
+
+                RenderProgress info;
+                info.elapsed = timer.elapsed();
+                if (!force && info.elapsed < nextReport)
+                    return;
+                float sessionProgress = sessionBlocks > 0 ? done / (float) sessionBlocks : 1.f;
+                info.progress = m_progress;
+                info.samples = samplesDone;
+                info.samplesPerSecond = info.elapsed > 0 ? info.samples * 1000.0 / info.elapsed : 0.0;
+                info.remaining = sessionProgress > 0 ? info.elapsed * (1 - sessionProgress) / sessionProgress : 0.0;
+                progressCallback(info);
+                nextReport = info.elapsed + progressInterval * 1000.0;
+            };
+
+            uint32_t k = firstPass;
+            for (; k < endPass ; ++k) {
                 if(m_render_status == 2)
                     break;
 
+                TraceScope passScope("pass", "render");
+                passScope.setArgs(tfm::format("{\"pass\": %i}", k));
+
+                /* The blocks of all views are scheduled in a single work pool */
                 tbb::blocked_range<int> range(0, numBlocks);
 
                 auto map = [&](const tbb::blocked_range<int> &range) {
-                    // Allocate memory for a small image block to be rendered by the current thread
-                    ImageBlock block(Vector2i(NORI_BLOCK_SIZE),
-                                     camera->getReconstructionFilter());
+                    // Small image blocks to be rendered by the current thread (one per view, allocated on demand)
+                    std::vector<std::unique_ptr<ImageBlock>> blocks(views.size());
 
                     for (int i = range.begin(); i < range.end(); ++i) {
+                        // Look up the view that this work item belongs to
+                        size_t v = 0;
+                        while (v + 1 < views.size() && i >= views[v + 1]->firstBlock)
+                            ++v;
+                        View &view = *views[v];
+
+                        if (!blocks[v])
+                            blocks[v].reset(new ImageBlock(Vector2i(NORI_BLOCK_SIZE),
+                                                           view.camera->getReconstructionFilter()));
+                        ImageBlock &block = *blocks[v];
+
                         // Request an image block from the block generator
-                        blockGenerator.next(block);
+                        view.blockGenerator->next(block);
+
+                        // Skip blocks that belong to other processes
+                        if (!partition.containsBlock(block)) {
+                            ++blocksDone;
+                            continue;
+                        }
 
                         // Get block id to continue using the same sampler
                         auto blockId = block.getBlockId();
-                        if(k == 0) { // Initialize the sampler for the first sample
-                            std::unique_ptr<Sampler> sampler(m_scene->getSampler()->clone());
-                            sampler->prepare(block);
-                            samplers.at(blockId) = std::move(sampler);
-                        }
+                        TraceScope tileScope("tile", "render");
+                        if (Trace::isEnabled())
+                            tileScope.setArgs(tfm::format("{\"block\": %i, \"view\": %i, \"pass\": %i}",
+                                                          blockId, v, k));
 
                         // Render all contained pixels
-                        renderBlock(m_scene, samplers.at(blockId).get(), block, numSamples, k);
+                        int rendered = renderBlock(m_scene, view.camera, view.samplers.at(blockId).get(),
+                                                   block, numSamples, k, v, partition, view.aovs.get());
 
                         // The image block has been processed. Now add it to the "big" block that represents the entire image
-                        m_block.put(block);
+                        view.result->put(block);
+
+                        samplesDone += rendered;
+                        ++blocksDone;
+                        reportProgress(false);
                     }
                 };
 
@@ -193,32 +518,78 @@ void RenderThread::renderScene(const std::string & filename) {
 	            tbb::parallel_for(range, map);
 #endif
 
-                blockGenerator.reset();
+                for (auto &view : views)
+                    view->blockGenerator->reset();
+
+                if (checkpointing && k + 1 < endPass &&
+                        checkpointTimer.elapsed() >= checkpointInterval * 1000)
+                    writeCheckpoint(k + 1);
             }
 
-            cout << "done. (took " << timer.elapsedString() << ")" << endl;
+            /* Keep the completed passes of an interrupted render around */
+            bool interrupted = k < endPass;
+            if (interrupted && checkpointing)
+                writeCheckpoint(k);
+            checkpointWriter.wait();
+            reportProgress(true);
 
-            /* Now turn the rendered image block into
-               a properly normalized bitmap */
-            m_block.lock();
-            std::unique_ptr<Bitmap> bitmap(m_block.toBitmap());
-            m_block.unlock();
+            cout << "done. (took " << timer.elapsedString() << ")" << endl;
 
-            /* Save using the OpenEXR format */
-            bitmap->save(outputName);
+            /* Summarize the work done by this rendering */
+            double renderTime = timer.elapsed();
+            Statistics::Snapshot stats = Statistics::collect() - statsStart;
+            cout << Statistics::summary(stats, renderTime) << endl;
+            m_lastStats = stats;
+            m_lastRenderTime = renderTime;
+            cout << MemoryAccounting::report(true) << endl;
+            if (!statsFile.empty()) {
+                std::ofstream os(statsFile);
+                os << Statistics::toJSON(stats, renderTime);
+                if (!os)
+                    cerr << "Warning: could not write statistics to \"" << statsFile << "\"" << endl;
+            }
 
-            delete m_scene;
-            m_scene = nullptr;
+            for (size_t i = 0; i < views.size(); ++i) {
+                ImageBlock *result = views[i]->result;
+                if (!rawNames[i].empty()) {
+                    /* Keep the weighted samples so that partial renders can be merged */
+                    result->lock();
+                    try {
+                        result->saveRaw(rawNames[i]);
+                    } catch (...) {
+                        result->unlock();
+                        throw;
+                    }
+                    result->unlock();
+                } else {
+                    /* Now turn the rendered image block into
+                       a properly normalized bitmap */
+                    result->lock();
+                    std::unique_ptr<Bitmap> bitmap(result->toBitmap());
+                    result->unlock();
+
+                    /* Save using the OpenEXR format, including the cost images (if any) */
+                    if (views[i]->aovs)
+                        bitmap->save(outputNames[i], views[i]->aovs->toChannels());
+                    else
+                        bitmap->save(outputNames[i]);
+                }
+            }
 
-            m_render_status = 3;
-        });
+            /* The render is complete, so its checkpoint is no longer needed */
+            if (checkpointing && !interrupted)
+                std::remove(checkpointName.c_str());
+        } catch (const std::exception &e) {
+            m_error = e.what();
+            cerr << "Error: rendering failed: " << e.what() << endl;
+        }
 
-    }
-    else {
-        delete root;
-    }
+        if (ownsScene)
+            delete m_scene;
+        m_scene = nullptr;
 
+        m_render_status = 3;
+    });
 }
 
-
 NORI_NAMESPACE_END
\ No newline at end of file
@@ -24,17 +24,20 @@
 #include <nori/emitter.h>
 #include <nori/medium.h>
 #include <nori/phase.h>
+#include <set>
 
 NORI_NAMESPACE_BEGIN
 
-Scene::Scene(const PropertyList &) {
+Scene::Scene(const PropertyList &props) {
     m_bvh = new BVH();
+    m_lightSamplerType = props.getString("lightSampler", "uniform");
 }
 
 Scene::~Scene() {
     delete m_bvh;
     delete m_sampler;
-    delete m_camera;
+    for (Camera *camera : m_cameras)
+        delete camera;
     delete m_integrator;
 	delete m_scene_medium;
 }
@@ -46,7 +49,22 @@ void Scene::activate() {
         throw NoriException("No integrator was specified!");
     if (!m_camera)
         throw NoriException("No camera was specified!");
+
+    if (m_cameras.size() > 1) {
+        /* Views are identified by the camera names */
+        std::set<std::string> names;
+        for (const Camera *camera : m_cameras) {
+            if (camera->getName().empty())
+                throw NoriException("Scenes with several cameras require a "
+                    "name for every camera!");
+            if (!names.insert(camera->getName()).second)
+                throw NoriException("There are several cameras named \"%s\"!",
+                    camera->getName());
+        }
+    }
     
+    m_lightSampler = LightSampler::create(m_lightSamplerType, m_emitters);
+
     if (!m_sampler) {
         /* Create a default (independent) sampler */
         m_sampler = static_cast<Sampler*>(
@@ -85,9 +103,9 @@ void Scene::addChild(NoriObject *obj) {
             break;
 
         case ECamera:
-            if (m_camera)
-                throw NoriException("There can only be one camera per scene!");
-            m_camera = static_cast<Camera *>(obj);
+            if (!m_camera)
+                m_camera = static_cast<Camera *>(obj);
+            m_cameras.push_back(static_cast<Camera *>(obj));
             break;
         
         case EIntegrator:
@@ -115,6 +133,14 @@ std::string Scene::toString() const {
         meshes += "\n";
     }
 
+    std::string cameras;
+    for (size_t i=0; i<m_cameras.size(); ++i) {
+        cameras += std::string("  ") + indent(m_cameras[i]->toString(), 2);
+        if (i + 1 < m_cameras.size())
+            cameras += ",";
+        cameras += "\n";
+    }
+
     std::string lights;
     for (size_t i=0; i<m_emitters.size(); ++i) {
         lights += std::string("  ") + indent(m_emitters[i]->toString(), 2);
@@ -127,7 +153,9 @@ std::string Scene::toString() const {
         "Scene[\n"
         "  integrator = %s,\n"
         "  sampler = %s\n"
-        "  camera = %s,\n"
+        "  lightSampler = %s\n"
+        "  cameras = {\n"
+        "  %s  }\n"
         "  meshes = {\n"
         "  %s  }\n"
         "  emitters = {\n"
@@ -135,7 +163,8 @@ std::string Scene::toString() const {
         "]",
         indent(m_integrator->toString()),
         indent(m_sampler->toString()),
-        indent(m_camera->toString()),
+        m_lightSampler ? m_lightSampler->toString() : m_lightSamplerType,
+        indent(cameras, 2),
         indent(meshes, 2),
         indent(lights,2)
     );
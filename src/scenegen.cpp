@@ -0,0 +1,399 @@
+/* Generator of procedural stress scenes for scaling tests.
+ *
+ * Usage: scenegen <kind> <output directory> [options]
+ *
+ * Writes <output directory>/scene.xml together with the OBJ files that it
+ * references (in <output directory>/meshes). The following kinds exist:
+ *
+ *   triangles  A single heightfield with approximately --size triangles
+ *              (BVH::build and traversal with millions of triangles)
+ *   lights     A floor lit by --size small emissive quads
+ *              (light selection for next event estimation)
+ *   instances  --size randomly placed copies of a tessellated sphere. Nori
+ *              has no instancing, so this measures duplicated geometry
+ *   glass      A stack of --size glass slabs in front of an area light
+ *              (deep specular chains, photon map size)
+ *
+ * All placement is driven by --seed, so the same arguments always produce
+ * the same scene. */
+
+#include <nori/vector.h>
+#include <nori/color.h>
+#include <nori/optionsparser.h>
+#include <pcg32.h>
+#include <fstream>
+#include <sstream>
+#include <memory>
+
+#if defined(_WIN32)
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+using namespace nori;
+
+/// Create a directory (it is fine if it already exists)
+static void makeDirectory(const std::string &path) {
+#if defined(_WIN32)
+    _mkdir(path.c_str());
+#else
+    mkdir(path.c_str(), 0755);
+#endif
+}
+
+/// Minimal triangle mesh that can be written as an OBJ file
+struct TriangleMesh {
+    std::vector<Vector3f> positions;
+    std::vector<Vector3f> normals;   ///< Optional, one per position
+    std::vector<uint32_t> indices;
+
+    uint32_t addVertex(const Vector3f &p) {
+        positions.push_back(p);
+        return (uint32_t) positions.size() - 1;
+    }
+
+    void addTriangle(uint32_t i0, uint32_t i1, uint32_t i2) {
+        indices.push_back(i0);
+        indices.push_back(i1);
+        indices.push_back(i2);
+    }
+
+    void write(const std::string &filename) const {
+        std::ofstream os(filename);
+        if (!os)
+            throw NoriException("Unable to write \"%s\"!", filename);
+        os << "# Generated by scenegen" << endl;
+        for (const Vector3f &p : positions)
+            os << tfm::format("v %.6f %.6f %.6f\n", p.x(), p.y(), p.z());
+        for (const Vector3f &n : normals)
+            os << tfm::format("vn %.6f %.6f %.6f\n", n.x(), n.y(), n.z());
+        for (size_t i = 0; i < indices.size(); i += 3) {
+            if (normals.empty())
+                os << tfm::format("f %i %i %i\n", indices[i] + 1, indices[i + 1] + 1, indices[i + 2] + 1);
+            else
+                os << tfm::format("f %i//%i %i//%i %i//%i\n", indices[i] + 1, indices[i] + 1,
+                    indices[i + 1] + 1, indices[i + 1] + 1, indices[i + 2] + 1, indices[i + 2] + 1);
+        }
+        if (!os)
+            throw NoriException("Error while writing \"%s\"!", filename);
+    }
+};
+
+/// Unit quad in the XZ plane facing +Y
+static TriangleMesh makeQuad() {
+    TriangleMesh mesh;
+    mesh.addVertex(Vector3f(-.5f, 0, -.5f));
+    mesh.addVertex(Vector3f(-.5f, 0, .5f));
+    mesh.addVertex(Vector3f(.5f, 0, .5f));
+    mesh.addVertex(Vector3f(.5f, 0, -.5f));
+    mesh.addTriangle(0, 1, 2);
+    mesh.addTriangle(0, 2, 3);
+    return mesh;
+}
+
+/// Axis-aligned unit cube centered at the origin
+static TriangleMesh makeCube() {
+    TriangleMesh mesh;
+    for (int i = 0; i < 8; ++i)
+        mesh.addVertex(Vector3f((i & 1) ? .5f : -.5f, (i & 2) ? .5f : -.5f, (i & 4) ? .5f : -.5f));
+    const uint32_t faces[6][4] = {
+        { 0, 2, 3, 1 }, { 4, 5, 7, 6 }, { 0, 1, 5, 4 },
+        { 2, 6, 7, 3 }, { 0, 4, 6, 2 }, { 1, 3, 7, 5 }
+    };
+    for (auto &f : faces) {
+        mesh.addTriangle(f[0], f[1], f[2]);
+        mesh.addTriangle(f[0], f[2], f[3]);
+    }
+    return mesh;
+}
+
+/// Smooth unit sphere with 2 * rings * segments triangles
+static TriangleMesh makeSphere(uint32_t rings, uint32_t segments) {
+    TriangleMesh mesh;
+    for (uint32_t i = 0; i <= rings; ++i) {
+        float theta = M_PI * i / rings;
+        for (uint32_t j = 0; j < segments; ++j) {
+            float phi = 2 * M_PI * j / segments;
+            Vector3f p(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+            mesh.addVertex(p);
+            mesh.normals.push_back(p);
+        }
+    }
+    for (uint32_t i = 0; i < rings; ++i) {
+        for (uint32_t j = 0; j < segments; ++j) {
+            uint32_t i0 = i * segments + j, i1 = i * segments + (j + 1) % segments;
+            mesh.addTriangle(i0, i1, i0 + segments);
+            mesh.addTriangle(i1, i1 + segments, i0 + segments);
+        }
+    }
+    return mesh;
+}
+
+/// Square heightfield of (2 * resolution^2) triangles with random bumps
+static TriangleMesh makeHeightfield(uint32_t resolution, pcg32 &rng) {
+    /* Sum of a few random waves */
+    float freq[8][2], phase[8];
+    for (int k = 0; k < 8; ++k) {
+        freq[k][0] = 2 + 30 * rng.nextFloat();
+        freq[k][1] = 2 + 30 * rng.nextFloat();
+        phase[k] = 2 * M_PI * rng.nextFloat();
+    }
+
+    TriangleMesh mesh;
+    for (uint32_t i = 0; i <= resolution; ++i) {
+        for (uint32_t j = 0; j <= resolution; ++j) {
+            float u = i / (float) resolution, v = j / (float) resolution, h = 0;
+            for (int k = 0; k < 8; ++k)
+                h += 0.02f * std::sin(freq[k][0] * u + freq[k][1] * v + phase[k]);
+            mesh.addVertex(Vector3f(2 * u - 1, h, 2 * v - 1));
+        }
+    }
+    for (uint32_t i = 0; i < resolution; ++i) {
+        for (uint32_t j = 0; j < resolution; ++j) {
+            uint32_t i0 = i * (resolution + 1) + j, i1 = i0 + 1;
+            uint32_t i2 = i0 + resolution + 1, i3 = i2 + 1;
+            mesh.addTriangle(i0, i1, i2);
+            mesh.addTriangle(i1, i3, i2);
+        }
+    }
+    return mesh;
+}
+
+/// Writes the XML scene description
+class SceneWriter {
+public:
+    SceneWriter(const std::string &integrator, int spp, int width, int height) {
+        m_xml << "<?xml version=\"1.0\" encoding=\"utf-8\"?>" << endl
+              << "<!-- Generated by scenegen -->" << endl
+              << "<scene>" << endl
+              << "\t<string name=\"lightSampler\" value=\"bvh\"/>" << endl;
+        if (integrator == "photonmapper")
+            m_xml << "\t<integrator type=\"photonmapper\">" << endl
+                  << "\t\t<integer name=\"photonCount\" value=\"1000000\"/>" << endl
+                  << "\t</integrator>" << endl;
+        else
+            m_xml << tfm::format("\t<integrator type=\"%s\"/>\n", integrator);
+        m_xml << "\t<sampler type=\"independent\">" << endl
+              << tfm::format("\t\t<integer name=\"sampleCount\" value=\"%i\"/>\n", spp)
+              << "\t</sampler>" << endl;
+        m_width = width;
+        m_height = height;
+    }
+
+    void camera(const Vector3f &origin, const Vector3f &target, float fov) {
+        m_xml << "\t<camera type=\"perspective\">" << endl
+              << "\t\t<transform name=\"toWorld\">" << endl
+              << tfm::format("\t\t\t<lookat origin=\"%s\" target=\"%s\" up=\"0, 1, 0\"/>\n",
+                             str(origin), str(target))
+              << "\t\t</transform>" << endl
+              << tfm::format("\t\t<float name=\"fov\" value=\"%f\"/>\n", fov)
+              << tfm::format("\t\t<integer name=\"width\" value=\"%i\"/>\n", m_width)
+              << tfm::format("\t\t<integer name=\"height\" value=\"%i\"/>\n", m_height)
+              << "\t</camera>" << endl;
+    }
+
+    /**
+     * \brief Add a mesh
+     *
+     * \param bsdf
+     *     Inner XML of the BSDF, e.g. <tt>type="diffuse"</tt> plus parameters
+     * \param radiance
+     *     Emitted radiance (no emitter if it is zero)
+     */
+    void mesh(const std::string &filename, const std::string &transform,
+              const std::string &bsdf, const Color3f &radiance = Color3f(0.f)) {
+        m_xml << "\t<mesh type=\"obj\">" << endl
+              << tfm::format("\t\t<string name=\"filename\" value=\"%s\"/>\n", filename);
+        if (!transform.empty())
+            m_xml << "\t\t<transform name=\"toWorld\">" << endl << transform << "\t\t</transform>" << endl;
+        m_xml << "\t\t" << bsdf << endl;
+        if (!radiance.isZero())
+            m_xml << "\t\t<emitter type=\"area\">" << endl
+                  << tfm::format("\t\t\t<color name=\"radiance\" value=\"%f, %f, %f\"/>\n",
+                                 radiance.r(), radiance.g(), radiance.b())
+                  << "\t\t</emitter>" << endl;
+        m_xml << "\t</mesh>" << endl;
+    }
+
+    void write(const std::string &filename) {
+        m_xml << "</scene>" << endl;
+        std::ofstream os(filename);
+        os << m_xml.str();
+        if (!os)
+            throw NoriException("Unable to write \"%s\"!", filename);
+    }
+
+    static std::string diffuse(const Color3f &albedo) {
+        return tfm::format("<bsdf type=\"diffuse\"><color name=\"albedo\" value=\"%f, %f, %f\"/></bsdf>",
+                           albedo.r(), albedo.g(), albedo.b());
+    }
+
+    static std::string transform(const Vector3f &scale, float angle, const Vector3f &translate) {
+        std::string result = tfm::format("\t\t\t<scale value=\"%s\"/>\n", str(scale));
+        if (angle != 0)
+            result += tfm::format("\t\t\t<rotate axis=\"0, 1, 0\" angle=\"%f\"/>\n", angle);
+        result += tfm::format("\t\t\t<translate value=\"%s\"/>\n", str(translate));
+        return result;
+    }
+
+private:
+    static std::string str(const Vector3f &v) {
+        return tfm::format("%f, %f, %f", v.x(), v.y(), v.z());
+    }
+
+    std::ostringstream m_xml;
+    int m_width, m_height;
+};
+
+/// Parameters shared by all kinds of scenes
+struct GeneratorOptions {
+    std::string kind, directory, integrator = "path_mis";
+    uint32_t size = 0;
+    uint64_t seed = 1;
+    int spp = 16, width = 320, height = 240;
+};
+
+static void generate(const GeneratorOptions &opts) {
+    pcg32 rng(opts.seed);
+    std::string meshDir = opts.directory + "/meshes";
+    makeDirectory(opts.directory);
+    makeDirectory(meshDir);
+
+    SceneWriter scene(opts.integrator, opts.spp, opts.width, opts.height);
+    makeQuad().write(meshDir + "/quad.obj");
+    std::string floorTransform = SceneWriter::transform(Vector3f(20, 1, 20), 0, Vector3f(0, 0, 0));
+
+    if (opts.kind == "triangles") {
+        uint32_t size = opts.size > 0 ? opts.size : 2000000;
+        uint32_t resolution = std::max((uint32_t) std::sqrt(size / 2.0), 1u);
+        makeHeightfield(resolution, rng).write(meshDir + "/terrain.obj");
+        scene.camera(Vector3f(0, 1.2f, 2.2f), Vector3f(0, 0, 0), 40);
+        scene.mesh("meshes/terrain.obj", "", SceneWriter::diffuse(Color3f(.6f, .5f, .4f)));
+        scene.mesh("meshes/quad.obj", SceneWriter::transform(Vector3f(1, 1, 1), 0, Vector3f(0, 3, 0)) +
+                   "\t\t\t<rotate axis=\"1, 0, 0\" angle=\"180\"/>\n", SceneWriter::diffuse(Color3f(0.f)),
+                   Color3f(15.f));
+    } else if (opts.kind == "lights") {
+        uint32_t size = opts.size > 0 ? opts.size : 5000;
+        scene.camera(Vector3f(0, 6, 12), Vector3f(0, 0, 0), 50);
+        scene.mesh("meshes/quad.obj", floorTransform, SceneWriter::diffuse(Color3f(.5f)));
+        /* Small downward facing quads with random colors and sizes */
+        for (uint32_t i = 0; i < size; ++i) {
+            float s = 0.05f + 0.15f * rng.nextFloat();
+            Vector3f pos(16 * rng.nextFloat() - 8, 0.5f + 3 * rng.nextFloat(), 16 * rng.nextFloat() - 8);
+            Color3f radiance(rng.nextFloat(), rng.nextFloat(), rng.nextFloat());
+            radiance *= 50.f / (s * s * std::sqrt((float) size));
+            scene.mesh("meshes/quad.obj", SceneWriter::transform(Vector3f(s, 1, s), 0, Vector3f(0, 0, 0)) +
+                       "\t\t\t<rotate axis=\"1, 0, 0\" angle=\"180\"/>\n" +
+                       tfm::format("\t\t\t<translate value=\"%f, %f, %f\"/>\n", pos.x(), pos.y(), pos.z()),
+                       SceneWriter::diffuse(Color3f(0.f)), radiance);
+        }
+    } else if (opts.kind == "instances") {
+        uint32_t size = opts.size > 0 ? opts.size : 1000;
+        makeSphere(48, 96).write(meshDir + "/sphere.obj");
+        float extent = 2 * std::cbrt((float) size);
+        scene.camera(Vector3f(0, extent, 2.5f * extent), Vector3f(0, 0, 0), 45);
+        scene.mesh("meshes/quad.obj", SceneWriter::transform(Vector3f(4 * extent, 1, 4 * extent), 0,
+                   Vector3f(0, -extent, 0)), SceneWriter::diffuse(Color3f(.5f)));
+        scene.mesh("meshes/quad.obj", SceneWriter::transform(Vector3f(extent, 1, extent), 0,
+                   Vector3f(0, 0, 0)) + "\t\t\t<rotate axis=\"1, 0, 0\" angle=\"180\"/>\n" +
+                   tfm::format("\t\t\t<translate value=\"0, %f, 0\"/>\n", 2 * extent),
+                   SceneWriter::diffuse(Color3f(0.f)), Color3f(10.f));
+        for (uint32_t i = 0; i < size; ++i) {
+            float s = 0.2f + 0.3f * rng.nextFloat();
+            Vector3f pos = extent * Vector3f(2 * rng.nextFloat() - 1, 2 * rng.nextFloat() - 1,
+                                             2 * rng.nextFloat() - 1);
+            Color3f albedo(rng.nextFloat(), rng.nextFloat(), rng.nextFloat());
+            scene.mesh("meshes/sphere.obj", SceneWriter::transform(Vector3f::Constant(s),
+                       360 * rng.nextFloat(), pos), SceneWriter::diffuse(.8f * albedo));
+        }
+    } else if (opts.kind == "glass") {
+        uint32_t size = opts.size > 0 ? opts.size : 32;
+        makeCube().write(meshDir + "/cube.obj");
+        scene.camera(Vector3f(0, 1, 6), Vector3f(0, 1, 0), 40);
+        scene.mesh("meshes/quad.obj", floorTransform, SceneWriter::diffuse(Color3f(.5f)));
+        scene.mesh("meshes/quad.obj", SceneWriter::transform(Vector3f(4, 1, 4), 0, Vector3f(0, 0, 0)) +
+                   "\t\t\t<rotate axis=\"1, 0, 0\" angle=\"90\"/>\n"
+                   "\t\t\t<translate value=\"0, 2, -3\"/>\n", SceneWriter::diffuse(Color3f(0.f)),
+                   Color3f(8.f));
+        /* Thin slabs stacked along the view direction, slightly rotated against each other */
+        for (uint32_t i = 0; i < size; ++i) {
+            float z = -2.f + 4.f * (i + .5f) / size;
+            scene.mesh("meshes/cube.obj", SceneWriter::transform(Vector3f(2, 2, 2.f / size),
+                       10 * (rng.nextFloat() - .5f), Vector3f(0, 1, z)),
+                       "<bsdf type=\"dielectric\"/>");
+        }
+    } else {
+        throw NoriException("Unknown scene kind \"%s\" (expected triangles, lights, instances or glass)",
+                            opts.kind);
+    }
+
+    scene.write(opts.directory + "/scene.xml");
+    cout << "Wrote \"" << opts.directory << "/scene.xml\"" << endl;
+}
+
+enum OptionIndex { UNKNOWN, HELP, SIZE, SEED, SPP, RESOLUTION, INTEGRATOR };
+
+struct Arg : public option::Arg {
+    static option::ArgStatus Required(const option::Option &option, bool msg) {
+        if (option.arg != 0)
+            return option::ARG_OK;
+        if (msg)
+            cerr << "Error: option '" << std::string(option.name, option.namelen) << "' requires an argument" << endl;
+        return option::ARG_ILLEGAL;
+    }
+};
+
+const option::Descriptor usage[] = {
+    { UNKNOWN,    0, "",  "",           Arg::None,     "Usage: scenegen <triangles|lights|instances|glass> <directory> [options]\n\nOptions:" },
+    { HELP,       0, "h", "help",       Arg::None,     "  -h, --help  \tPrint usage and exit." },
+    { SIZE,       0, "n", "size",       Arg::Required, "  -n, --size <n>  \tTriangles, lights, instances or glass slabs (depends on the kind)." },
+    { SEED,       0, "",  "seed",       Arg::Required, "  --seed <n>  \tSeed of the random placement (default: 1)." },
+    { SPP,        0, "",  "spp",        Arg::Required, "  --spp <n>  \tSamples per pixel (default: 16)." },
+    { RESOLUTION, 0, "r", "resolution", Arg::Required, "  -r, --resolution <w>,<h>  \tImage resolution (default: 320,240)." },
+    { INTEGRATOR, 0, "",  "integrator", Arg::Required, "  --integrator <name>  \tIntegrator (default: path_mis)." },
+    { 0, 0, 0, 0, 0, 0 }
+};
+
+int main(int argc, char **argv) {
+    argc -= (argc > 0);
+    argv += (argc > 0);
+
+    option::Stats stats(usage, argc, argv);
+    std::vector<option::Option> options(stats.options_max), buffer(stats.buffer_max);
+    option::Parser parse(usage, argc, argv, options.data(), buffer.data());
+    if (options[HELP]) {
+        option::printUsage(std::cout, usage);
+        return 0;
+    }
+    if (parse.error() || options[UNKNOWN] || parse.nonOptionsCount() != 2) {
+        option::printUsage(std::cerr, usage);
+        return 2;
+    }
+
+    try {
+        GeneratorOptions opts;
+        opts.kind = parse.nonOption(0);
+        opts.directory = parse.nonOption(1);
+        if (options[SIZE])
+            opts.size = (uint32_t) toInt(options[SIZE].last()->arg);
+        if (options[SEED])
+            opts.seed = strtoull(options[SEED].last()->arg, nullptr, 10);
+        if (options[SPP])
+            opts.spp = toInt(options[SPP].last()->arg);
+        if (options[RESOLUTION]) {
+            std::vector<std::string> tokens = tokenize(options[RESOLUTION].last()->arg, ",");
+            if (tokens.size() != 2)
+                throw NoriException("Expected a resolution of the form <w>,<h>");
+            opts.width = toInt(tokens[0]);
+            opts.height = toInt(tokens[1]);
+        }
+        if (options[INTEGRATOR])
+            opts.integrator = options[INTEGRATOR].last()->arg;
+        generate(opts);
+    } catch (const std::exception &e) {
+        cerr << "Error: " << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,226 @@
+#include <nori/server.h>
+#include <nori/render.h>
+#include <nori/scene.h>
+#include <nori/camera.h>
+#include <nori/sampler.h>
+#include <nori/timer.h>
+#include <Eigen/Geometry>
+#include <iostream>
+#include <thread>
+#include <chrono>
+#include <cerrno>
+#include <cstring>
+
+#if !defined(PLATFORM_WINDOWS)
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+NORI_NAMESPACE_BEGIN
+
+RenderServer::RenderServer(const std::string &sceneFile) {
+    Timer timer;
+    m_scene = RenderThread::loadScene(sceneFile);
+    if (!m_scene)
+        throw NoriException("\"%s\" does not describe a scene!", sceneFile);
+    cout << "Scene \"" << sceneFile << "\" is resident (loading took "
+         << timer.elapsedString() << ")" << endl;
+}
+
+RenderServer::~RenderServer() {
+    delete m_scene;
+}
+
+void RenderServer::render(const std::string &job) {
+    PropertyList overrides;
+    std::string output, cameraName;
+    int sampleCount = -1;
+    bool hasOrigin = false, hasTarget = false, hasUp = false;
+    Vector3f origin, target, up;
+
+    for (const std::string &token : tokenize(job, " \t\r")) {
+        size_t pos = token.find('=');
+        if (pos == std::string::npos)
+            throw NoriException("Expected key=value, got \"%s\"", token);
+        std::string key = token.substr(0, pos), value = token.substr(pos + 1);
+
+        if (key == "output")
+            output = value;
+        else if (key == "camera")
+            cameraName = value;
+        else if (key == "spp")
+            sampleCount = toInt(value);
+        else if (key == "width" || key == "height")
+            overrides.setInteger(key, toInt(value));
+        else if (key == "fov")
+            overrides.setFloat(key, toFloat(value));
+        else if (key == "origin")
+            origin = toVector3f(value), hasOrigin = true;
+        else if (key == "target")
+            target = toVector3f(value), hasTarget = true;
+        else if (key == "up")
+            up = toVector3f(value), hasUp = true;
+        else
+            throw NoriException("Unknown job parameter \"%s\"", key);
+    }
+
+    if (output.empty())
+        throw NoriException("The job does not specify an output file");
+    if (sampleCount == 0 || sampleCount < -1)
+        throw NoriException("Invalid sample count %i", sampleCount);
+
+    if (hasOrigin || hasTarget || hasUp) {
+        if (!hasOrigin || !hasTarget || !hasUp)
+            throw NoriException("The camera look-at requires origin, target and up");
+
+        /* Same convention as the <lookat> tag of the scene parser */
+        Vector3f dir = (target - origin).normalized();
+        Vector3f left = up.normalized().cross(dir).normalized();
+        Vector3f newUp = dir.cross(left).normalized();
+
+        Eigen::Matrix4f trafo;
+        trafo << left, newUp, dir, origin,
+                  0, 0, 0, 1;
+        overrides.setTransform("toWorld", Transform(trafo));
+    }
+
+    /* Only create a new camera when needed, otherwise reuse the scene's */
+    std::unique_ptr<Camera> jobCamera;
+    const Camera *camera = m_scene->getCamera();
+    if (!cameraName.empty()) {
+        auto it = std::find_if(m_scene->getCameras().begin(), m_scene->getCameras().end(),
+            [&](const Camera *c) { return c->getName() == cameraName; });
+        if (it == m_scene->getCameras().end())
+            throw NoriException("The scene has no camera named \"%s\"", cameraName);
+        camera = *it;
+    }
+    if (overrides.has("width") || overrides.has("height") ||
+        overrides.has("fov") || overrides.has("toWorld")) {
+        jobCamera.reset(camera->cloneWithOverrides(overrides));
+        camera = jobCamera.get();
+    }
+
+    std::unique_ptr<Sampler> sampler(m_scene->getSampler()->clone());
+    if (sampleCount > 0)
+        sampler->setSampleCount((size_t) sampleCount);
+
+    std::string outputBase = output;
+    if (endsWith(toLower(outputBase), ".exr"))
+        outputBase.erase(outputBase.size() - 4);
+
+    ImageBlock block(Vector2i(720, 720), nullptr);
+    RenderThread thread(block);
+    thread.renderLoadedScene(m_scene, { camera }, sampler.get(), outputBase, false);
+    thread.wait();
+    if (!thread.getError().empty())
+        throw NoriException("%s", thread.getError());
+}
+
+bool RenderServer::process(const std::string &line, std::string &reply, int &failures) {
+    reply.clear();
+
+    std::vector<std::string> tokens = tokenize(line, " \t\r");
+    if (tokens.empty() || tokens[0][0] == '#')
+        return true;
+    if (tokens.size() == 1 && tokens[0] == "quit")
+        return false;
+
+    try {
+        render(line);
+        for (const std::string &token : tokens)
+            if (token.compare(0, 7, "output=") == 0)
+                reply = "ok " + token.substr(7);
+    } catch (const std::exception &e) {
+        reply = std::string("error ") + e.what();
+        ++failures;
+    }
+    return true;
+}
+
+int RenderServer::serve(std::istream &input, std::ostream &output) {
+    int failures = 0;
+    std::string line, reply;
+    while (std::getline(input, line)) {
+        if (!process(line, reply, failures))
+            break;
+        if (!reply.empty())
+            output << reply << endl;
+    }
+    return failures;
+}
+
+#if !defined(PLATFORM_WINDOWS)
+int RenderServer::serveSocket(const std::string &path) {
+    sockaddr_un addr;
+    if (path.size() >= sizeof(addr.sun_path))
+        throw NoriException("Socket path \"%s\" is too long!", path);
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server < 0)
+        throw NoriException("Unable to create a socket!");
+    unlink(path.c_str());
+    if (bind(server, (sockaddr *) &addr, sizeof(addr)) != 0 || listen(server, 4) != 0) {
+        close(server);
+        throw NoriException("Unable to listen on \"%s\"!", path);
+    }
+    cout << "Waiting for render jobs on \"" << path << "\"" << endl;
+
+    int failures = 0;
+    bool running = true;
+    while (running) {
+        int client = accept(server, nullptr, nullptr);
+        if (client < 0) {
+            int error = errno;
+            if (error == EINTR || error == ECONNABORTED)
+                continue;
+
+            /* Running out of descriptors or buffers persists for a while:
+               back off instead of spinning on accept() */
+            if (error == EMFILE || error == ENFILE || error == ENOBUFS || error == ENOMEM) {
+                cerr << "accept() failed: " << strerror(error) << ", retrying in one second" << endl;
+                std::this_thread::sleep_for(std::chrono::seconds(1));
+                continue;
+            }
+
+            close(server);
+            unlink(path.c_str());
+            throw NoriException("Unable to accept connections on \"%s\": %s", path, strerror(error));
+        }
+
+        /* Split the incoming data into lines and process them in order */
+        std::string pending, reply;
+        char buffer[4096];
+        ssize_t count;
+        while (running && (count = read(client, buffer, sizeof(buffer))) > 0) {
+            pending.append(buffer, (size_t) count);
+            size_t pos;
+            while (running && (pos = pending.find('\n')) != std::string::npos) {
+                std::string line = pending.substr(0, pos);
+                pending.erase(0, pos + 1);
+                running = process(line, reply, failures);
+                if (!reply.empty()) {
+                    reply += '\n';
+                    if (write(client, reply.data(), reply.size()) < 0)
+                        break;
+                }
+            }
+        }
+        close(client);
+    }
+
+    close(server);
+    unlink(path.c_str());
+    return failures;
+}
+#else
+int RenderServer::serveSocket(const std::string &path) {
+    throw NoriException("RenderServer::serveSocket(): UNIX domain sockets "
+        "are not supported on this platform!");
+}
+#endif
+
+NORI_NAMESPACE_END
@@ -0,0 +1,116 @@
+#include <nori/sampler.h>
+#include <nori/block.h>
+#include <nori/qmc.h>
+#include <iostream>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Sobol sampler with hash-based Owen scrambling
+ *
+ * Generates the samples of a pixel from the first two dimensions of the
+ * Sobol sequence (a (0,2)-sequence, so every power-of-two prefix of the
+ * pixel samples is stratified in all elementary intervals). Following
+ * Burley's "Practical Hash-based Owen Scrambling" (JCGT 2020), the points
+ * are randomized with a nested uniform (Owen) scramble, and higher
+ * dimensions are padded: every \ref next1D() or \ref next2D() call uses
+ * its own Owen-scrambled shuffle of the sample index, which decorrelates
+ * the dimensions without needing direction numbers for each of them.
+ *
+ * All scrambling seeds are derived from the pixel and the global seed, so
+ * the samples of a pixel do not depend on the image block or thread that
+ * computes them. Sample counts should be powers of two for the best
+ * stratification.
+ */
+class Sobol : public Sampler {
+public:
+    Sobol(const PropertyList &propList) {
+        m_sampleCount = (size_t) propList.getInteger("sampleCount", 1);
+        m_seed = (uint64_t) propList.getInteger("seed", 0);
+    }
+
+    virtual ~Sobol() { }
+
+    std::unique_ptr<Sampler> clone() const {
+        std::unique_ptr<Sobol> cloned(new Sobol());
+        cloned->m_sampleCount = m_sampleCount;
+        cloned->m_seed = m_seed;
+        cloned->m_pixelSeed = m_pixelSeed;
+        cloned->m_sampleIndex = m_sampleIndex;
+        cloned->m_dimension = m_dimension;
+        return std::move(cloned);
+    }
+
+    void prepare(const ImageBlock &block) {
+        setSampleIndex(block.getOffset(), 0);
+    }
+
+    void setSampleIndex(const Point2i &pixel, uint32_t sampleIndex) {
+        uint64_t pixelIndex = ((uint64_t) (uint32_t) pixel.y() << 32) | (uint32_t) pixel.x();
+        m_pixelSeed = (uint32_t) QMC::mix64(pixelIndex ^ QMC::mix64(m_seed));
+        m_sampleIndex = sampleIndex;
+        m_dimension = 0;
+    }
+
+    void generate() {
+        m_sampleIndex = 0;
+        m_dimension = 0;
+    }
+
+    void advance() {
+        m_sampleIndex++;
+        m_dimension = 0;
+    }
+
+    float next1D() {
+        return QMC::scrambledSobol1D(m_sampleIndex, QMC::hashCombine(m_pixelSeed, m_dimension++));
+    }
+
+    Point2f next2D() {
+        return QMC::scrambledSobol2D(m_sampleIndex, QMC::hashCombine(m_pixelSeed, m_dimension++));
+    }
+
+    void next1DArray(float *values, size_t count) {
+        for (size_t i = 0; i < count; ++i)
+            values[i] = QMC::scrambledSobol1D(m_sampleIndex, QMC::hashCombine(m_pixelSeed, m_dimension + (uint32_t) i));
+        m_dimension += (uint32_t) count;
+    }
+
+    void next2DArray(Point2f *values, size_t count) {
+        for (size_t i = 0; i < count; ++i)
+            values[i] = QMC::scrambledSobol2D(m_sampleIndex, QMC::hashCombine(m_pixelSeed, m_dimension + (uint32_t) i));
+        m_dimension += (uint32_t) count;
+    }
+
+    void serialize(std::ostream &stream) const {
+        stream.write(reinterpret_cast<const char *>(&m_seed), sizeof(uint64_t));
+        stream.write(reinterpret_cast<const char *>(&m_pixelSeed), sizeof(uint32_t));
+        stream.write(reinterpret_cast<const char *>(&m_sampleIndex), sizeof(uint32_t));
+        stream.write(reinterpret_cast<const char *>(&m_dimension), sizeof(uint32_t));
+    }
+
+    void unserialize(std::istream &stream) {
+        stream.read(reinterpret_cast<char *>(&m_seed), sizeof(uint64_t));
+        stream.read(reinterpret_cast<char *>(&m_pixelSeed), sizeof(uint32_t));
+        stream.read(reinterpret_cast<char *>(&m_sampleIndex), sizeof(uint32_t));
+        stream.read(reinterpret_cast<char *>(&m_dimension), sizeof(uint32_t));
+        if (!stream)
+            throw NoriException("Sobol::unserialize(): truncated sampler state!");
+    }
+
+    size_t getMemoryUsage() const { return sizeof(Sobol); }
+
+    virtual std::string toString() const {
+        return tfm::format("Sobol[sampleCount=%i, seed=%i]", m_sampleCount, m_seed);
+    }
+protected:
+    Sobol() { }
+
+private:
+    uint32_t m_pixelSeed = 0;
+    uint32_t m_sampleIndex = 0;
+    uint32_t m_dimension = 0;
+};
+
+NORI_REGISTER_CLASS(Sobol, "sobol");
+NORI_NAMESPACE_END
@@ -0,0 +1,156 @@
+#include <nori/mesh.h>
+#include <nori/bsdf.h>
+#include <nori/emitter.h>
+#include <nori/warp.h>
+#include <nori/lightsampler.h>
+#include <Eigen/Geometry>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Analytic sphere
+ *
+ * A single primitive with an exact intersection and normals, given by
+ * its \c center and \c radius. The normals point outwards. Seen from
+ * outside, the sphere is sampled exactly by solid angle: directions are
+ * uniform within the cone that it subtends (as in PBRT v4).
+ */
+class Sphere : public Mesh {
+public:
+    Sphere(const PropertyList &propList) {
+        m_center = propList.getPoint3("center", Point3f(0.0f));
+        m_radius = propList.getFloat("radius", 1.0f);
+        if (!(m_radius > 0.0f))
+            throw NoriException("Sphere: the radius must be positive!");
+
+        m_name = "sphere";
+        m_bbox = BoundingBox3f(m_center - Vector3f::Constant(m_radius),
+                               m_center + Vector3f::Constant(m_radius));
+    }
+
+    uint32_t getPrimitiveCount() const { return 1; }
+
+    float surfaceArea(uint32_t index) const { return 4 * M_PI * m_radius * m_radius; }
+
+    BoundingBox3f getBoundingBox(uint32_t index) const { return m_bbox; }
+
+    Point3f getCentroid(uint32_t index) const { return m_center; }
+
+    DirectionCone getNormalCone() const { return DirectionCone::entireSphere(); }
+
+    bool rayIntersect(uint32_t index, const Ray3f &ray, float &u, float &v, float &t) const {
+        /* Solve in double precision, the discriminant cancels badly for distant spheres */
+        Eigen::Vector3d o = (ray.o - m_center).cast<double>(), d = ray.d.cast<double>();
+        double A = d.squaredNorm(), B = 2 * o.dot(d), C = o.squaredNorm() - (double) m_radius * m_radius;
+
+        /* The component of 'o' perpendicular to the ray gives an accurate discriminant */
+        Eigen::Vector3d f = o - (o.dot(d) / A) * d;
+        double discrim = 4 * A * ((double) m_radius * m_radius - f.squaredNorm());
+        if (discrim < 0)
+            return false;
+
+        double q = -0.5 * (B + std::copysign(std::sqrt(discrim), B));
+        double t0 = q / A, t1 = C / q;
+        if (t0 > t1)
+            std::swap(t0, t1);
+
+        if (t0 >= ray.mint && t0 <= ray.maxt)
+            t = (float) t0;
+        else if (t1 >= ray.mint && t1 <= ray.maxt)
+            t = (float) t1;
+        else
+            return false;
+        u = v = 0.0f;
+        return true;
+    }
+
+    void setHitInformation(uint32_t index, const Ray3f &ray, Intersection &its) const {
+        Normal3f n = (ray(its.t) - m_center).normalized();
+
+        /* Reproject onto the surface */
+        its.p = m_center + m_radius * n;
+
+        /* Spherical coordinates of the normal */
+        float phi = std::atan2(n.y(), n.x());
+        if (phi < 0)
+            phi += 2 * M_PI;
+        its.uv = Point2f(phi * INV_TWOPI, std::acos(clamp(n.z(), -1.0f, 1.0f)) * INV_PI);
+
+        its.geoFrame = its.shFrame = Frame(n);
+    }
+
+    void samplePosition(const Point2f &sample, Point3f &p, Normal3f &n, float optional_u) const {
+        n = Warp::squareToUniformSphere(sample);
+        p = m_center + m_radius * n;
+    }
+
+    bool sampleSolidAngle(const Point3f &ref, const Point2f &sample, float optional_u,
+                          Point3f &p, Normal3f &n, uint32_t &index) const {
+        index = 0;
+        Vector3f toCenter = m_center - ref;
+        float dist2 = toCenter.squaredNorm();
+        float sin2ThetaMax = m_radius * m_radius / dist2;
+
+        /* Points inside the sphere see all of it: sample by area */
+        if (sin2ThetaMax >= 1.0f) {
+            samplePosition(sample, p, n, optional_u);
+            return true;
+        }
+
+        /* Uniformly sample cos(theta) within the cone around the center */
+        float sinThetaMax = std::sqrt(sin2ThetaMax);
+        float oneMinusCosTheta = sample.x() * coneOneMinusCos(sin2ThetaMax);
+        float cosTheta = 1.0f - oneMinusCosTheta;
+        float sin2Theta = oneMinusCosTheta * (2.0f - oneMinusCosTheta);
+
+        /* Angle 'alpha' between the sampled point and -toCenter, seen from the center */
+        float cosAlpha = sin2Theta / sinThetaMax +
+            cosTheta * std::sqrt(std::max(0.0f, 1.0f - sin2Theta / sin2ThetaMax));
+        cosAlpha = std::min(cosAlpha, 1.0f);
+        float sinAlpha = std::sqrt(std::max(0.0f, 1.0f - cosAlpha * cosAlpha));
+        float phi = 2.0f * M_PI * sample.y();
+
+        Frame frame(toCenter / std::sqrt(dist2));
+        n = -frame.toWorld(Vector3f(sinAlpha * std::cos(phi), sinAlpha * std::sin(phi), cosAlpha));
+        p = m_center + m_radius * n;
+        return true;
+    }
+
+    float pdfSolidAngle(const Point3f &ref, const Point3f &p, const Normal3f &n, uint32_t index) const {
+        float sin2ThetaMax = m_radius * m_radius / (m_center - ref).squaredNorm();
+        if (sin2ThetaMax < 1.0f)
+            return INV_TWOPI / coneOneMinusCos(sin2ThetaMax);
+
+        Vector3f wi = p - ref;
+        float dist2 = wi.squaredNorm();
+        float costheta_here = fabsf(n.dot(wi)) / std::sqrt(dist2);
+        return dist2 / (costheta_here * surfaceArea(0));
+    }
+
+    std::string toString() const {
+        return tfm::format(
+            "Sphere[\n"
+            "  center = %s,\n"
+            "  radius = %f,\n"
+            "  bsdf = %s,\n"
+            "  emitter = %s\n"
+            "]",
+            m_center.toString(),
+            m_radius,
+            m_bsdf ? indent(m_bsdf->toString()) : std::string("null"),
+            m_emitter ? indent(m_emitter->toString()) : std::string("null")
+        );
+    }
+
+private:
+    /// Return 1 - cos(thetaMax) for a cone given by sin^2(thetaMax), without cancellation
+    static float coneOneMinusCos(float sin2ThetaMax) {
+        return sin2ThetaMax / (1.0f + std::sqrt(1.0f - sin2ThetaMax));
+    }
+
+    Point3f m_center;
+    float m_radius;
+};
+
+NORI_REGISTER_CLASS(Sphere, "sphere");
+NORI_NAMESPACE_END
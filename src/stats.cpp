@@ -0,0 +1,135 @@
+#include <nori/stats.h>
+#include <tbb/mutex.h>
+#include <set>
+
+NORI_NAMESPACE_BEGIN
+
+/* Registry of the counters of all live threads, plus the
+   accumulated counts of threads that have already exited */
+namespace {
+    struct Registry {
+        tbb::mutex mutex;
+        std::set<Statistics::ThreadCounters *> threads;
+        Statistics::Snapshot retired;
+    };
+
+    Registry &registry() {
+        static Registry *registry = new Registry(); /* Never destroyed: threads may exit late */
+        return *registry;
+    }
+}
+
+Statistics::ThreadCounters::ThreadCounters() {
+    for (int i = 0; i < EStatCounterCount; ++i)
+        value[i].store(0, std::memory_order_relaxed);
+    Registry &reg = registry();
+    tbb::mutex::scoped_lock lock(reg.mutex);
+    reg.threads.insert(this);
+}
+
+Statistics::ThreadCounters::~ThreadCounters() {
+    Registry &reg = registry();
+    tbb::mutex::scoped_lock lock(reg.mutex);
+    for (int i = 0; i < EStatCounterCount; ++i)
+        reg.retired.value[i] += value[i].load(std::memory_order_relaxed);
+    reg.threads.erase(this);
+}
+
+Statistics::Snapshot Statistics::Snapshot::operator-(const Snapshot &start) const {
+    Snapshot result;
+    for (int i = 0; i < EStatCounterCount; ++i)
+        result.value[i] = value[i] - start.value[i];
+    return result;
+}
+
+Statistics::Snapshot Statistics::collect() {
+    Registry &reg = registry();
+    tbb::mutex::scoped_lock lock(reg.mutex);
+    Snapshot result = reg.retired;
+    for (const ThreadCounters *counters : reg.threads)
+        for (int i = 0; i < EStatCounterCount; ++i)
+            result.value[i] += counters->value[i].load(std::memory_order_relaxed);
+    return result;
+}
+
+const char *Statistics::counterName(EStatCounter counter) {
+    switch (counter) {
+        case EStatCameraRays:       return "cameraRays";
+        case EStatIntersectionRays: return "intersectionRays";
+        case EStatShadowRays:       return "shadowRays";
+        case EStatBVHNodes:         return "bvhNodes";
+        case EStatTriangleTests:    return "triangleTests";
+        case EStatBSDFSamples:      return "bsdfSamples";
+        case EStatBSDFEvals:        return "bsdfEvals";
+        case EStatEmitterSamples:   return "emitterSamples";
+        case EStatPhotonLookups:    return "photonLookups";
+        case EStatPhotonsTouched:   return "photonsTouched";
+        default:                    return "unknown";
+    }
+}
+
+/* Quantities that are derived from the raw counters */
+namespace {
+    struct Derived {
+        uint64_t rays, extensionRays;
+        double mraysPerSecond, pathLength, nodesPerRay, trianglesPerRay, photonsPerLookup;
+
+        Derived(const Statistics::Snapshot &s, double elapsed) {
+            rays = s[EStatIntersectionRays] + s[EStatShadowRays];
+            extensionRays = s[EStatIntersectionRays] > s[EStatCameraRays] ?
+                s[EStatIntersectionRays] - s[EStatCameraRays] : 0;
+            mraysPerSecond = elapsed > 0 ? rays / (elapsed * 1000.0) : 0.0;
+            pathLength = s[EStatCameraRays] > 0 ?
+                s[EStatIntersectionRays] / (double) s[EStatCameraRays] : 0.0;
+            nodesPerRay = rays > 0 ? s[EStatBVHNodes] / (double) rays : 0.0;
+            trianglesPerRay = rays > 0 ? s[EStatTriangleTests] / (double) rays : 0.0;
+            photonsPerLookup = s[EStatPhotonLookups] > 0 ?
+                s[EStatPhotonsTouched] / (double) s[EStatPhotonLookups] : 0.0;
+        }
+    };
+}
+
+std::string Statistics::summary(const Snapshot &s, double elapsed) {
+#if defined(NORI_ENABLE_STATS)
+    Derived d(s, elapsed);
+    return tfm::format(
+        "Render statistics:\n"
+        "  Rays           : %i camera, %i extension, %i shadow (%.2f Mrays/s)\n"
+        "  Path length    : %.2f segments per camera ray\n"
+        "  BVH traversal  : %.1f nodes, %.1f triangle tests per ray\n"
+        "  BSDF           : %i samples, %i evaluations\n"
+        "  Emitters       : %i samples\n"
+        "  Photon map     : %i lookups, %.1f photons per lookup",
+        s[EStatCameraRays], d.extensionRays, s[EStatShadowRays], d.mraysPerSecond,
+        d.pathLength, d.nodesPerRay, d.trianglesPerRay,
+        s[EStatBSDFSamples], s[EStatBSDFEvals], s[EStatEmitterSamples],
+        s[EStatPhotonLookups], d.photonsPerLookup);
+#else
+    return "Render statistics are disabled (build with NORI_STATS=ON)";
+#endif
+}
+
+std::string Statistics::toJSON(const Snapshot &s, double elapsed) {
+    Derived d(s, elapsed);
+    std::string result = "{\n";
+    result += tfm::format("  \"enabled\": %s,\n", 
+#if defined(NORI_ENABLE_STATS)
+        "true"
+#else
+        "false"
+#endif
+    );
+    result += tfm::format("  \"elapsedMs\": %f,\n", elapsed);
+    for (int i = 0; i < EStatCounterCount; ++i)
+        result += tfm::format("  \"%s\": %i,\n", counterName((EStatCounter) i), s.value[i]);
+    result += tfm::format("  \"extensionRays\": %i,\n", d.extensionRays);
+    result += tfm::format("  \"mraysPerSecond\": %f,\n", d.mraysPerSecond);
+    result += tfm::format("  \"averagePathLength\": %f,\n", d.pathLength);
+    result += tfm::format("  \"nodesPerRay\": %f,\n", d.nodesPerRay);
+    result += tfm::format("  \"trianglesPerRay\": %f,\n", d.trianglesPerRay);
+    result += tfm::format("  \"photonsPerLookup\": %f\n", d.photonsPerLookup);
+    result += "}\n";
+    return result;
+}
+
+NORI_NAMESPACE_END
@@ -0,0 +1,102 @@
+#include <nori/trace.h>
+#include <tbb/mutex.h>
+#include <fstream>
+#include <memory>
+
+NORI_NAMESPACE_BEGIN
+
+std::atomic<bool> Trace::s_enabled(false);
+std::chrono::steady_clock::time_point Trace::s_origin = std::chrono::steady_clock::now();
+
+/* Per-thread event buffers. Buffers of threads that have exited are kept
+   in the registry, so their events still show up in the exported trace */
+namespace {
+    struct ThreadBuffer {
+        int id;
+        std::string name;
+        std::vector<Trace::Event> events;
+    };
+
+    struct Registry {
+        tbb::mutex mutex;
+        std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+    };
+
+    Registry &registry() {
+        static Registry *registry = new Registry(); /* Never destroyed: threads may exit late */
+        return *registry;
+    }
+
+    ThreadBuffer &localBuffer() {
+        static thread_local std::shared_ptr<ThreadBuffer> buffer;
+        if (!buffer) {
+            Registry &reg = registry();
+            tbb::mutex::scoped_lock lock(reg.mutex);
+            buffer = std::make_shared<ThreadBuffer>();
+            buffer->id = (int) reg.buffers.size();
+            buffer->name = tfm::format("thread %i", buffer->id);
+            reg.buffers.push_back(buffer);
+        }
+        return *buffer;
+    }
+
+    std::string escape(const std::string &str) {
+        std::string result;
+        for (char c : str) {
+            if (c == '"' || c == '\\')
+                result += '\\';
+            result += c;
+        }
+        return result;
+    }
+}
+
+void Trace::enable() {
+    s_origin = std::chrono::steady_clock::now();
+    s_enabled = true;
+}
+
+void Trace::record(Event &&event) {
+    localBuffer().events.push_back(std::move(event));
+}
+
+void Trace::setThreadName(const std::string &name) {
+    ThreadBuffer &buffer = localBuffer();
+    tbb::mutex::scoped_lock lock(registry().mutex);
+    buffer.name = name;
+}
+
+void Trace::save(const std::string &filename) {
+    std::ofstream os(filename);
+    if (!os)
+        throw NoriException("Unable to open trace file \"%s\" for writing!", filename);
+
+    Registry &reg = registry();
+    tbb::mutex::scoped_lock lock(reg.mutex);
+
+    size_t eventCount = 0;
+    os << "{\"traceEvents\": [" << endl;
+    bool first = true;
+    for (const auto &buffer : reg.buffers) {
+        os << (first ? "  " : ",\n  ")
+           << tfm::format("{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": %i, "
+                          "\"args\": {\"name\": \"%s\"}}", buffer->id, escape(buffer->name));
+        first = false;
+        for (const Event &event : buffer->events) {
+            os << tfm::format(",\n  {\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"pid\": 0, "
+                              "\"tid\": %i, \"ts\": %i, \"dur\": %i", event.name, event.category,
+                              buffer->id, event.start, event.duration);
+            if (!event.args.empty())
+                os << ", \"args\": " << event.args;
+            os << "}";
+        }
+        eventCount += buffer->events.size();
+    }
+    os << endl << "], \"displayTimeUnit\": \"ms\"}" << endl;
+
+    if (!os)
+        throw NoriException("Error while writing trace file \"%s\"!", filename);
+    cout << "Wrote " << eventCount << " trace events to \"" << filename << "\"" << endl;
+}
+
+NORI_NAMESPACE_END
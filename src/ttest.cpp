@@ -21,6 +21,7 @@
 #include <nori/camera.h>
 #include <nori/integrator.h>
 #include <nori/sampler.h>
+#include <nori/stats.h>
 #include <hypothesis.h>
 #include <pcg32.h>
 
@@ -54,6 +55,11 @@ NORI_NAMESPACE_BEGIN
  *
  * 2. that the average radiance received by a camera within some scene
  *    matches a given value (modulo noise).
+ *
+ * 3. with <tt>pairs="true"</tt>, that consecutive pairs of scenes have the
+ *    same average radiance, e.g. to check that two integrators (or two
+ *    variants of one) converge to the same result. When statistics are
+ *    compiled in, the number of rays per path is reported for each scene.
  */
 class StudentsTTest : public NoriObject {
 public:
@@ -78,6 +84,14 @@ public:
 #else
 		m_sampleCount = propList.getInteger("sampleCount", 100000);
 #endif
+
+        /* Sampler used to render the test scenes, and its number of samples per pixel */
+        m_samplerType = propList.getString("sampler", "independent");
+        m_pixelSamples = propList.getInteger("pixelSamples", 16);
+
+        /* Compare consecutive pairs of scenes with each other instead of against
+           reference values (e.g. the same scene rendered with two integrators) */
+        m_pairs = propList.getBoolean("pairs", false);
     }
 
     virtual ~StudentsTTest() {
@@ -149,26 +163,38 @@ public:
                 }
             }
         } else {
-            if (m_references.size() != m_scenes.size())
+            if (m_pairs) {
+                if (m_scenes.size() % 2 != 0)
+                    throw NoriException("Comparing pairs of scenes requires an even number of scenes!");
+            } else if (m_references.size() != m_scenes.size()) {
                 throw NoriException("Specified a different number of scenes and reference values!");
+            }
 
-            Sampler *sampler = static_cast<Sampler *>(
-                NoriObjectFactory::createInstance("independent", PropertyList()));
+            PropertyList samplerProps;
+            samplerProps.setInteger("sampleCount", m_pixelSamples);
+            std::unique_ptr<Sampler> sampler(static_cast<Sampler *>(
+                NoriObjectFactory::createInstance(m_samplerType, samplerProps)));
 
-            int ctr = 0;
-            for (auto scene : m_scenes) {
+            /* Estimate the mean and variance of the luminance of the camera paths of a scene */
+            auto measure = [&](const Scene *scene, int index, double &mean, double &variance) {
                 const Integrator *integrator = scene->getIntegrator();
                 const Camera *camera = scene->getCamera();
-                float reference = m_references[ctr++];
 
                 cout << "------------------------------------------------------" << endl;
                 cout << "Testing scene: " << scene->toString() << endl;
-                ++total;
-
                 cout << "Generating " << m_sampleCount << " paths.. " << endl;
 
-                double mean = 0, variance = 0;
+#if defined(NORI_ENABLE_STATS)
+                Statistics::Snapshot statsStart = Statistics::collect();
+#endif
+                mean = 0;
+                variance = 0;
                 for (int k=0; k<m_sampleCount; ++k) {
+                    /* Stratified samplers only stratify the samples of one pixel,
+                       so every group of m_pixelSamples paths is one "pixel" */
+                    sampler->setSampleIndex(Point2i(k / m_pixelSamples, index),
+                        (uint32_t) (k % m_pixelSamples));
+
                     /* Sample a ray from the camera */
                     Ray3f ray;
                     Point2f pixelSample = (sampler->next2D().array()
@@ -176,7 +202,7 @@ public:
                     Color3f value = camera->sampleRay(ray, pixelSample, sampler->next2D());
 
                     /* Compute the incident radiance */
-                    value *= integrator->Li(scene, sampler, ray);
+                    value *= integrator->Li(scene, sampler.get(), ray);
 
                     /* Numerically robust online variance estimation using an
                        algorithm proposed by Donald Knuth (TAOCP vol.2, 3rd ed., p.232) */
@@ -187,13 +213,53 @@ public:
                 }
                 variance /= m_sampleCount - 1;
 
-                std::pair<bool, std::string>
-                    result = hypothesis::students_t_test(mean, variance, reference,
-                        m_sampleCount, m_significanceLevel, (int) m_references.size());
+#if defined(NORI_ENABLE_STATS)
+                /* Report the ray cost, e.g. to compare integrator variants */
+                Statistics::Snapshot stats = Statistics::collect() - statsStart;
+                cout << tfm::format("Rays per path: %.3f intersection, %.3f shadow",
+                    stats[EStatIntersectionRays] / (double) m_sampleCount,
+                    stats[EStatShadowRays] / (double) m_sampleCount) << endl;
+#endif
+            };
+
+            if (m_pairs) {
+                /* Two-sample test for equal means. With the large sample counts
+                   used here, the normal approximation of Welch's test is accurate */
+                int testCount = (int) m_scenes.size() / 2;
+                double alpha = 1.0 - std::pow(1.0 - m_significanceLevel, 1.0 / testCount);
+                for (size_t i = 0; i < m_scenes.size(); i += 2) {
+                    double mean[2], variance[2];
+                    for (int j = 0; j < 2; ++j)
+                        measure(m_scenes[i + j], (int) (i + j), mean[j], variance[j]);
+                    ++total;
+
+                    double stddev = std::sqrt((variance[0] + variance[1]) / m_sampleCount);
+                    double z = stddev > 0 ? (mean[0] - mean[1]) / stddev : 0.0;
+                    double pval = std::erfc(std::abs(z) / std::sqrt(2.0));
+                    bool accepted = pval >= alpha || (stddev == 0 && mean[0] == mean[1]);
 
-                if (result.first)
-                    ++passed;
-                cout << result.second << endl;
+                    cout << tfm::format("Means: %f and %f, z = %f, p-value = %f (significance level %f): %s",
+                        mean[0], mean[1], z, pval, alpha, accepted ? "Accepted the null hypothesis"
+                                                                   : "Reject the null hypothesis") << endl;
+                    if (accepted)
+                        ++passed;
+                }
+            } else {
+                int ctr = 0;
+                for (auto scene : m_scenes) {
+                    float reference = m_references[ctr];
+                    double mean, variance;
+                    measure(scene, ctr++, mean, variance);
+                    ++total;
+
+                    std::pair<bool, std::string>
+                        result = hypothesis::students_t_test(mean, variance, reference,
+                            m_sampleCount, m_significanceLevel, (int) m_references.size());
+
+                    if (result.first)
+                        ++passed;
+                    cout << result.second << endl;
+                }
             }
         }
         cout << "Passed " << passed << "/" << total << " tests." << endl;
@@ -203,10 +269,16 @@ public:
         return tfm::format(
             "StudentsTTest[\n"
             "  significanceLevel = %f,\n"
-            "  sampleCount= %i\n"
+            "  sampleCount= %i,\n"
+            "  sampler = %s,\n"
+            "  pixelSamples = %i,\n"
+            "  pairs = %s\n"
             "]",
             m_significanceLevel,
-            m_sampleCount
+            m_sampleCount,
+            m_samplerType,
+            m_pixelSamples,
+            m_pairs ? "true" : "false"
         );
     }
 
@@ -218,6 +290,9 @@ private:
     std::vector<float> m_references;
     float m_significanceLevel;
     int m_sampleCount;
+    std::string m_samplerType;
+    int m_pixelSamples;
+    bool m_pairs;
 };
 
 NORI_REGISTER_CLASS(StudentsTTest, "ttest");
@@ -18,122 +18,119 @@ public:
 		m_rrStart = props.getInteger("rrStart", 5);
 	}
 
-	Color3f LiAttenuatedDirect(const Scene* scene, Sampler* sampler, const Ray3f& ray, const Intersection& isect) const
+	// Sample components of one surface vertex, drawn with one next1DArray() and one next2DArray() call
+	struct SurfaceSamples
 	{
-		Color3f L_ems(0.0f), L_mats(0.0f);
-		const BSDF* bsdf = isect.mesh->getBSDF();
-		float distance_to_light;
-		const Medium* m = scene->getSceneMedium();
-		Color3f transmittance(1.0);
-
-		// Choose a light
-		float pdf = 1.0f / scene->getLights().size();
-		const Emitter* random_emitter = scene->getRandomEmitter(sampler->next1D());
+		float lightSelection, emitter1D, bsdf1D, roulette;
+		Point2f emitter2D, bsdf2D;
 
-		// Emitter Sampling
-		// Perform only if not a delta bsdf		
-		if (!bsdf->isDelta())
+		SurfaceSamples(Sampler* sampler)
 		{
-			EmitterQueryRecord eRec;
-			float pdf_e, pdf_m;
-			eRec.ref = isect.p;
+			float u1D[4];
+			Point2f u2D[2];
+			sampler->next1DArray(u1D, 4);
+			sampler->next2DArray(u2D, 2);
+			lightSelection = u1D[0];
+			emitter1D = u1D[1];
+			bsdf1D = u1D[2];
+			roulette = u1D[3];
+			emitter2D = u2D[0];
+			bsdf2D = u2D[1];
+		}
+	};
 
-			Color3f Li = random_emitter->sample(eRec, sampler->next2D(), sampler->next1D());
-			pdf_e = eRec.pdf;
+	// Sample components of one medium scattering vertex, drawn the same way
+	struct MediumSamples
+	{
+		float lightSelection, emitter1D;
+		Point2f emitter2D, phaseMIS2D, phase2D;
 
-			BSDFQueryRecord bRec(isect.toLocal(-ray.d), isect.toLocal(eRec.wi), ESolidAngle);
-			Color3f f = bsdf->eval(bRec);
-			pdf_m = bsdf->pdf(bRec);
-			if (pdf_e != 0.0f)
-			{
-				float mis = pdf_e / (pdf_m + pdf_e);
+		MediumSamples(Sampler* sampler)
+		{
+			float u1D[2];
+			Point2f u2D[3];
+			sampler->next1DArray(u1D, 2);
+			sampler->next2DArray(u2D, 3);
+			lightSelection = u1D[0];
+			emitter1D = u1D[1];
+			emitter2D = u2D[0];
+			phaseMIS2D = u2D[1];
+			phase2D = u2D[2];
+		}
+	};
 
-				// Compute lighting
-				L_ems = f * Li * fabsf(isect.shFrame.n.dot(eRec.wi));
-				distance_to_light = eRec.dist;
+	// Estimate the attenuated direct lighting of a surface point by emitter sampling, weighted with MIS.
+	// The BSDF-sampling half of MIS is supplied by the continuation ray in Li().
+	Color3f LiAttenuatedDirect(const Scene* scene, const Ray3f& ray, const Intersection& isect, const SurfaceSamples& u) const
+	{
+		const BSDF* bsdf = isect.mesh->getBSDF();
+		const Medium* m = scene->getSceneMedium();
 
-				// Compute shadow ray only when 
-				if (L_ems.isValid() && !L_ems.isZero())
-				{
-					// Trace a shadow ray only now
-					Ray3f shadow_ray(isect.p, eRec.wi, Epsilon, (1.0f - Epsilon) * eRec.dist);
-					float V = scene->rayIntersect(shadow_ray) ? 0.0f : 1.0f;
-					transmittance = m->eval_transmittance(shadow_ray);
+		// A delta BSDF can never connect to a light sample
+		if (bsdf->isDelta())
+			return Color3f(0.0f);
 
-					L_ems *= V * transmittance;
-				}
-				else
-					L_ems = Color3f(0.0f);
+		// Choose a light
+		float pdf;
+		const Emitter* random_emitter = scene->getLightSampler()->sample(isect.p, isect.shFrame.n, u.lightSelection, pdf);
+		if (!random_emitter)
+			return Color3f(0.0f);
 
+		EmitterQueryRecord eRec;
+		eRec.ref = isect.p;
+		eRec.refNormal = bsdf->getLightSamplingNormal(isect.shFrame.n, -ray.d);
 
-				if (!random_emitter->isDelta())
-				{
-					// The BSDF has no way of generating a direction that would hit this light
-					// Hence multiply by MIS value only when 
-					L_ems *= mis;
-				}
-			}
-		}
+		Color3f Li = random_emitter->sample(eRec, u.emitter2D, u.emitter1D);
+		if (eRec.pdf == 0.0f)
+			return Color3f(0.0f);
 
-		// BSDF sampling
-		// If the chosen light was a delta light, we can't expect the BSDF to sample a direction that will hit the light
+		BSDFQueryRecord bRec(isect.toLocal(-ray.d), isect.toLocal(eRec.wi), ESolidAngle);
+		bRec.uv = isect.uv;
+		Color3f L_ems = bsdf->eval(bRec) * Li * fabsf(isect.shFrame.n.dot(eRec.wi));
+
+		// The BSDF has no way of generating a direction that would hit a delta light.
+		// Otherwise, MIS against the continuation ray, which could hit any light
 		if (!random_emitter->isDelta())
 		{
-			BSDFQueryRecord bRec(isect.toLocal(-ray.d));
-			Color3f f = bsdf->sample(bRec, sampler->next2D());
-			float pdf_m = bRec.pdf;
-
-			if (!f.isZero() && pdf_m != 0.0f && !isnan(pdf_m))
-			{
-				Intersection light_isect;
-				Ray3f next_bounce_ray(isect.p, isect.toWorld(bRec.wo), Epsilon, INFINITY);
-				if (scene->rayIntersect(next_bounce_ray, light_isect))
-				{
-					// check if a light soruce
-					if (light_isect.mesh->isEmitter() && light_isect.mesh->getEmitter() == random_emitter)
-					{
-						next_bounce_ray.maxt = light_isect.t;
-						const Emitter* light = light_isect.mesh->getEmitter();
-
-						EmitterQueryRecord eRec;
-						eRec.ref = isect.p;
-						eRec.wi = isect.toWorld(bRec.wo);
-						eRec.n = light_isect.shFrame.n;
-						eRec.emitter = light;
-						eRec.p = light_isect.p;
-						eRec.dist = light_isect.t;
-
-						Color3f Li = light->eval(eRec);
-						float mis = 1.0f;
-
-						// If the BSDF was delta, the light could have never generated this reverse direction
-						if (!bsdf->isDelta())
-						{
-							float pdf_e = light->pdf(eRec);
-							mis = pdf_m / (pdf_m + pdf_e);
-						}
-
-						transmittance = m->eval_transmittance(next_bounce_ray);
-						L_mats = transmittance * (f * Li * fabsf(Frame::cosTheta(bRec.wo)));
-						L_mats *= mis;
-					}
-				}
-			}
+			float pdf_e = pdf * eRec.pdf;
+			L_ems *= pdf_e / (bsdf->pdf(bRec) + pdf_e);
 		}
 
+		// Compute shadow ray only when needed
+		if (!L_ems.isValid() || L_ems.isZero())
+			return Color3f(0.0f);
+		Ray3f shadow_ray(isect.p, eRec.wi, Epsilon, (1.0f - Epsilon) * eRec.dist);
+		if (scene->rayIntersect(shadow_ray))
+			return Color3f(0.0f);
+		L_ems *= m->eval_transmittance(shadow_ray);
+
 		// Divide by the pdf of choosing the random light
-		return ((L_ems + L_mats) / pdf);
+		return L_ems / pdf;
 	}
 
-	Color3f LmSingleScatter(const Scene* scene, Sampler* sampler, const Ray3f& ray, const MediumSamplingRecord& mRec, const Point3f& scatter_point) const
+	// MIS weight of emission that was found by BSDF sampling the ray 'eRec.ref' -> 'eRec.p'
+	float emissionWeight(const Scene* scene, const Emitter* light, const EmitterQueryRecord& eRec,
+		const Normal3f& n, float pdf_m) const
+	{
+		if (light->isDelta() || isnan(pdf_m))
+			return 1.0f;
+
+		float pdf_e = light->pdf(eRec) * scene->getLightSampler()->pdf(eRec.ref, n, light);
+		return pdf_m / (pdf_m + pdf_e);
+	}
+
+	Color3f LmSingleScatter(const Scene* scene, const Ray3f& ray, const MediumSamplingRecord& mRec, const Point3f& scatter_point,
+		const MediumSamples& u) const
 	{
 		float pdf = 1.0f;
 
 		const Medium* m = scene->getSceneMedium();
 
 		// Compute direct lighting to emitter
-		const Emitter* emitter = scene->getRandomEmitter(sampler->next1D());
-		float light_pdf = 1.0f / scene->getLights().size();
+		float light_pdf;
+		const Emitter* emitter = scene->getLightSampler()->sample(scatter_point, Normal3f(0.0f), u.lightSelection, light_pdf);
+		if (!emitter)
+			return Color3f(0.0f);
 
 		Color3f Lm_emit(0.f), Lm_phase(0.0f);
 		// Choose a point on the light source
@@ -142,7 +139,7 @@ public:
 			float pdf_e;
 			eRec.ref = scatter_point;
 
-			Color3f Li = emitter->sample(eRec, sampler->next2D(), sampler->next1D());
+			Color3f Li = emitter->sample(eRec, u.emitter2D, u.emitter1D);
 			pdf_e = eRec.pdf;
 
 			float phase_fun = INV_FOURPI;
@@ -179,7 +176,7 @@ public:
 		// importance sample phase function with MIS
 		{
 			auto pFun = m->m_phase_funtion;
-			Vector3f random_direction = Warp::squareToUniformSphere(sampler->next2D());
+			Vector3f random_direction = Warp::squareToUniformSphere(u.phaseMIS2D);
 			float pdf_phase = INV_FOURPI;
 			float phase_fun = INV_FOURPI;
 
@@ -197,6 +194,7 @@ public:
 					eRec.dist = isect.t;
 					eRec.p = isect.p;
 					eRec.n = isect.shFrame.n;
+					eRec.primIndex = isect.primIndex;
 					eRec.emitter = light;
 
 					Color3f Li = light->eval(eRec);
@@ -229,23 +227,38 @@ public:
 
 		MediumSamplingRecord mRec;
 
+		// How the current ray was generated. Emission that it hits is weighted with MIS
+		// against emitter sampling, unless it comes from the camera or a specular bounce.
+		// After a medium scattering event, LmSingleScatter() accounts for all emission.
+		bool wasLastBounceSpecular = true, wasLastVertexInMedium = false;
+		float lastPdf = 0.0f;
+		Normal3f lastNormal(0.0f);
+
 		// compute intersection and update the valid range for the first ray
-		if (scene->rayIntersect(traced_ray, isect))
+		bool hitSurface = scene->rayIntersect(traced_ray, isect);
+		if (hitSurface)
 			traced_ray.maxt = isect.t;
 		else
 			return L;			// for now dont trace these rays.
 		
-		while (depth < m_maxDepth || m_maxDepth == -1)
+		while (true)
 		{
+			// Vertices beyond the maximum depth only contribute the emission that is hit
+			bool lastVertex = depth >= m_maxDepth && m_maxDepth != -1;
+
 			if (m->sample_distance(traced_ray, mRec, sampler->next2D()))
 			{
+				if (lastVertex)
+					break;
+
 				// Compute scattered point
 				Point3f scattered_pt = traced_ray(mRec.t);
 
 				// Compute scattering term
 				// SingleScatter includes all transmittance terms for this scattering event.
 				// So don't bother adding it here
-				L += throughput * mRec.m_sigmaS * LmSingleScatter(scene, sampler, traced_ray, mRec, scattered_pt) / mRec.pdf_success;
+				MediumSamples u(sampler);
+				L += throughput * mRec.m_sigmaS * LmSingleScatter(scene, traced_ray, mRec, scattered_pt, u) / mRec.pdf_success;
 
 				// update throughput
 				// however throughput has to be updated correctly.
@@ -254,40 +267,63 @@ public:
 				// sample a next direction
 				Vector3f scatter_dir;
 				PhaseFunctionSamplingRecord pRec(mRec, scattered_pt, -ray.d, scatter_dir);
-				float phase_fn = m->m_phase_funtion->sample(pRec, sampler->next2D());
+				float phase_fn = m->m_phase_funtion->sample(pRec, u.phase2D);
 
 				traced_ray = Ray3f(scattered_pt, pRec.wo);
+				wasLastVertexInMedium = true;
 				depth++;
 			}
 			else
 			{
+				if (!hitSurface)
+					break;
+
 				// transmitted branch from surface
 				throughput *= mRec.transmittance / mRec.pdf_failure;
 
 				// check if emitter
-				if (isect.mesh->isEmitter() && (depth == 0))
+				if (isect.mesh->isEmitter())
 				{
-
-					EmitterQueryRecord eRec;
-					eRec.ref = traced_ray.o;
-					eRec.wi = traced_ray.d;
-					eRec.n = isect.shFrame.n;
-					L += throughput * mRec.transmittance * isect.mesh->getEmitter()->eval(eRec);
+					if (depth == 0)
+					{
+						EmitterQueryRecord eRec;
+						eRec.ref = traced_ray.o;
+						eRec.wi = traced_ray.d;
+						eRec.n = isect.shFrame.n;
+						L += throughput * mRec.transmittance * isect.mesh->getEmitter()->eval(eRec);
+					}
+					else if (!wasLastVertexInMedium)
+					{
+						// The continuation ray found an emitter: this is the BSDF-sampling half of MIS
+						const Emitter* light = isect.mesh->getEmitter();
+						EmitterQueryRecord eRec(light, traced_ray.o, isect.p, isect.shFrame.n, isect.primIndex);
+						Color3f Le = light->eval(eRec);
+						if (!Le.isZero() && !wasLastBounceSpecular)
+							Le *= emissionWeight(scene, light, eRec, lastNormal, lastPdf);
+						L += throughput * Le;
+					}
 				}
 
+				if (lastVertex)
+					break;
+
 				const BSDF* bsdf = isect.mesh->getBSDF();
 
 				// NEE
-				Color3f Li = LiAttenuatedDirect(scene, sampler, traced_ray, isect);
-				Color3f debug = throughput * mRec.transmittance * Li;
-				L += throughput * Li;
+				SurfaceSamples u(sampler);
+				L += throughput * LiAttenuatedDirect(scene, traced_ray, isect, u);
 
-				// Sample a reflection ray
+				// Sample a reflection ray, which also continues the path
 				BSDFQueryRecord bRec(isect.toLocal(-traced_ray.d));
-				Color3f f = bsdf->sample(bRec, sampler->next2D());
+				bRec.uv = isect.uv;
+				Color3f f = bsdf->sample(bRec, u.bsdf2D, u.bsdf1D);
 				Vector3f reflected_dir = isect.toWorld(bRec.wo);
 
 				throughput *= f * fabsf(Frame::cosTheta(bRec.wo));
+				wasLastBounceSpecular = bsdf->isDelta();
+				wasLastVertexInMedium = false;
+				lastPdf = bRec.pdf;
+				lastNormal = isect.shFrame.n;
 
 				// Check if we've reached a zero throughput. No point in proceeding further.
 				if (throughput.isZero())
@@ -296,15 +332,10 @@ public:
 				// Check for russian roulette
 				if (depth > m_rrStart)
 				{
-					if (sampler->next1D() < 0.5f)
+					if (u.roulette < 0.5f)
 						break;
 					else throughput *= 2.0f;
 				}
-				else if (depth > m_maxDepth && m_maxDepth != -1)
-				{
-					// forcibly terminate
-					break;
-				}
 
 				// Propogate
 				traced_ray = Ray3f(isect.p, reflected_dir, Epsilon, INFINITY);
@@ -312,7 +343,8 @@ public:
 			}
 
 			// update the ray params
-			if (scene->rayIntersect(traced_ray, isect))
+			hitSurface = scene->rayIntersect(traced_ray, isect);
+			if (hitSurface)
 				traced_ray.maxt = isect.t;			
 		}
 
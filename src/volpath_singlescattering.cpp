@@ -5,6 +5,7 @@
 #include <nori/medium.h>
 #include <nori/phase.h>
 #include <nori/warp.h>
+#include <nori/stats.h>
 
 NORI_NAMESPACE_BEGIN
 
@@ -27,8 +28,10 @@ public:
 		Color3f transmittance(1.0);
 
 		// Choose a light
-		float pdf = 1.0f / scene->getLights().size();
-		const Emitter* random_emitter = scene->getRandomEmitter(sampler->next1D());
+		float pdf;
+		const Emitter* random_emitter = scene->getLightSampler()->sample(isect.p, isect.shFrame.n, sampler->next1D(), pdf);
+		if (!random_emitter)
+			return Color3f(0.0f);
 
 		// Emitter Sampling
 		// Perform only if not a delta bsdf		
@@ -38,10 +41,12 @@ public:
 			float pdf_e, pdf_m;
 			eRec.ref = isect.p;
 
+			NORI_STAT(EStatEmitterSamples);
 			Color3f Li = random_emitter->sample(eRec, sampler->next2D(), sampler->next1D());
 			pdf_e = eRec.pdf;
 
 			BSDFQueryRecord bRec(isect.toLocal(-ray.d), isect.toLocal(eRec.wi), ESolidAngle);
+			NORI_STAT(EStatBSDFEvals);
 			Color3f f = bsdf->eval(bRec);
 			pdf_m = bsdf->pdf(bRec);
 			if (pdf_e != 0.0f && !isnan(pdf_m))
@@ -80,6 +85,7 @@ public:
 		if (!random_emitter->isDelta())
 		{
 			BSDFQueryRecord bRec(isect.toLocal(-ray.d));
+			NORI_STAT(EStatBSDFSamples);
 			Color3f f = bsdf->sample(bRec, sampler->next2D());
 			float pdf_m = bRec.pdf;
 
@@ -101,6 +107,7 @@ public:
 						eRec.n = light_isect.shFrame.n;
 						eRec.emitter = light;
 						eRec.p = light_isect.p;
+						eRec.primIndex = light_isect.primIndex;
 						eRec.dist = light_isect.t;
 
 						Color3f Li = light->eval(eRec);
@@ -139,8 +146,10 @@ public:
 		const Medium* m = scene->getSceneMedium();
 		
 		// Compute direct lighting to emitter
-		const Emitter* emitter = scene->getRandomEmitter(sampler->next1D());
-		float light_pdf = 1.0f / scene->getLights().size();
+		float light_pdf;
+		const Emitter* emitter = scene->getLightSampler()->sample(ray(rand_distance), Normal3f(0.0f), sampler->next1D(), light_pdf);
+		if (!emitter)
+			return Color3f(0.0f);
 
 		Color3f Lm_emit(0.f), Lm_phase(0.0f);
 		// Choose a point on the light source
@@ -149,6 +158,7 @@ public:
 			float pdf_e;
 			eRec.ref = ray(rand_distance);
 
+			NORI_STAT(EStatEmitterSamples);
 			Color3f Li = emitter->sample(eRec, sampler->next2D(), sampler->next1D());
 			pdf_e = eRec.pdf;
 
@@ -204,6 +214,7 @@ public:
 					eRec.dist = isect.t;
 					eRec.p = isect.p;
 					eRec.n = isect.shFrame.n;
+					eRec.primIndex = isect.primIndex;
 					eRec.emitter = light;
 
 					Color3f Li = light->eval(eRec);
@@ -277,6 +288,7 @@ public:
 
 			// Sample a reflection ray
 			BSDFQueryRecord bRec(isect.toLocal(-traced_ray.d));
+			NORI_STAT(EStatBSDFSamples);
 			Color3f f = bsdf->sample(bRec, sampler->next2D());
 			Vector3f reflected_dir = isect.toWorld(bRec.wo);
 
@@ -19,6 +19,7 @@
 #include <nori/warp.h>
 #include <nori/vector.h>
 #include <nori/frame.h>
+#include <Eigen/Geometry>
 
 NORI_NAMESPACE_BEGIN
 
@@ -72,6 +73,48 @@ float Warp::squareToUniformSpherePdf(const Vector3f &v) {
     return INV_FOURPI;
 }
 
+/* Equal-area octahedral mapping */
+Vector3f Warp::squareToEqualAreaSphere(const Point2f &sample) {
+    float u = 2.0f * sample.x() - 1.0f, v = 2.0f * sample.y() - 1.0f;
+    float up = std::abs(u), vp = std::abs(v);
+
+    /* Signed distance from the diagonals, which map to the equator */
+    float signedDistance = 1.0f - (up + vp);
+    float r = 1.0f - std::abs(signedDistance);
+    float phi = (r == 0.0f ? 1.0f : (vp - up) / r + 1.0f) * (float) M_PI / 4.0f;
+    float z = std::copysign(1.0f - r * r, signedDistance);
+
+    float cosPhi = std::copysign(std::cos(phi), u);
+    float sinPhi = std::copysign(std::sin(phi), v);
+    float scale = r * std::sqrt(std::max(0.0f, 2.0f - r * r));
+    return Vector3f(cosPhi * scale, sinPhi * scale, z);
+}
+
+Point2f Warp::equalAreaSphereToSquare(const Vector3f &v) {
+    float x = std::abs(v.x()), y = std::abs(v.y()), z = std::abs(v.z());
+    float r = std::sqrt(std::max(0.0f, 1.0f - z));
+
+    /* Polynomial fit of atan(b) * 2 / pi on [0, 1] */
+    float a = std::max(x, y), b = std::min(x, y);
+    b = a == 0.0f ? 0.0f : b / a;
+    float phi = 0.406758566246788489601959989e-5f + b * (0.636226545274016134946890922156f +
+        b * (0.61572017898280213493197203466e-2f + b * (-0.247333733281268944196501420480f +
+        b * (0.881770664775316294736387951347e-1f + b * (0.419038818029165735901852432784e-1f +
+        b * -0.251390972343483509333252996350e-1f)))));
+    if (x < y)
+        phi = 1.0f - phi;
+
+    float sv = phi * r, su = r - sv;
+    if (v.z() < 0.0f) {
+        std::swap(su, sv);
+        su = 1.0f - su;
+        sv = 1.0f - sv;
+    }
+    su = std::copysign(su, v.x());
+    sv = std::copysign(sv, v.y());
+    return Point2f(0.5f * (su + 1.0f), 0.5f * (sv + 1.0f));
+}
+
 
 /* Uniform Hemisphere */
 Vector3f Warp::squareToUniformHemisphere(const Point2f &sample) {
@@ -101,6 +144,74 @@ float Warp::squareToUniformSphereCapPdf(const Vector3f &v, float cosThetaMax) {
 }
 
 
+/* SphericalTriangle */
+namespace {
+    /// Angle between two unit vectors, accurate also for (nearly) parallel ones
+    double angleBetween(const Eigen::Vector3d &v1, const Eigen::Vector3d &v2) {
+        if (v1.dot(v2) < 0)
+            return M_PI - 2 * std::asin(std::min((v1 + v2).norm() / 2, 1.0));
+        return 2 * std::asin(std::min((v2 - v1).norm() / 2, 1.0));
+    }
+
+    /// Component of 'v' that is orthogonal to the unit vector 'w', normalized
+    Eigen::Vector3d orthogonalTo(const Eigen::Vector3d &v, const Eigen::Vector3d &w) {
+        Eigen::Vector3d r = v - v.dot(w) * w;
+        double len = r.norm();
+        return len > 0 ? Eigen::Vector3d(r / len) : r;
+    }
+}
+
+Vector3f Warp::squareToSphericalTriangle(const Point2f &sample, const Vector3f &_a,
+                                         const Vector3f &_b, const Vector3f &_c) {
+    /* Double precision, since the angles of small triangles cancel badly */
+    Eigen::Vector3d a = _a.cast<double>(), b = _b.cast<double>(), c = _c.cast<double>();
+
+    /* Normals of the great circles through the edges */
+    Eigen::Vector3d nab = a.cross(b), nbc = b.cross(c), nca = c.cross(a);
+    if (nab.squaredNorm() == 0 || nbc.squaredNorm() == 0 || nca.squaredNorm() == 0)
+        return _a;
+    nab.normalize(); nbc.normalize(); nca.normalize();
+
+    /* Interior angles at the vertices */
+    double alpha = angleBetween(nab, -nca);
+    double beta = angleBetween(nbc, -nab);
+    double gamma = angleBetween(nca, -nbc);
+
+    /* Area of the sub-triangle (a, b, c') with the sampled fraction of the area */
+    double areaPi = alpha + beta + gamma;
+    double subAreaPi = M_PI + sample.x() * (areaPi - M_PI);
+
+    /* Find the cosine of the arc b-c' from the area of the sub-triangle */
+    double cosAlpha = std::cos(alpha), sinAlpha = std::sin(alpha);
+    double sinPhi = std::sin(subAreaPi) * cosAlpha - std::cos(subAreaPi) * sinAlpha;
+    double cosPhi = std::cos(subAreaPi) * cosAlpha + std::sin(subAreaPi) * sinAlpha;
+    double k1 = cosPhi + cosAlpha;
+    double k2 = sinPhi - sinAlpha * a.dot(b);
+    double cosBp = (k2 + (k2 * cosPhi - k1 * sinPhi) * cosAlpha) /
+                   ((k2 * sinPhi + k1 * cosPhi) * sinAlpha);
+    if (!std::isfinite(cosBp))
+        cosBp = 1;
+    cosBp = std::min(std::max(cosBp, -1.0), 1.0);
+    double sinBp = std::sqrt(std::max(0.0, 1 - cosBp * cosBp));
+
+    /* c' lies on the arc from a to c */
+    Eigen::Vector3d cp = cosBp * a + sinBp * orthogonalTo(c, a);
+
+    /* Sample a point on the arc from b to c' */
+    double cosTheta = 1 - sample.y() * (1 - cp.dot(b));
+    double sinTheta = std::sqrt(std::max(0.0, 1 - cosTheta * cosTheta));
+    Eigen::Vector3d w = cosTheta * b + sinTheta * orthogonalTo(cp, b);
+
+    return Vector3f(w.normalized().cast<float>());
+}
+
+float Warp::sphericalTriangleArea(const Vector3f &a, const Vector3f &b, const Vector3f &c) {
+    /* Van Oosterom and Strackee's formula */
+    float triple = std::abs(a.dot(b.cross(c)));
+    float denom = 1.0f + a.dot(b) + b.dot(c) + c.dot(a);
+    return 2.0f * std::atan2(triple, denom);
+}
+
 /* CosineHemisphere */
 Vector3f Warp::squareToCosineHemisphere(const Point2f &sample) {
     float theta = 0.5f * acosf(1.0f - 2 * sample.x());